@@ -0,0 +1,90 @@
+#include "pch.h"
+#include "ArenaAllocator.h"
+
+ArenaAllocator::ArenaAllocator(int32_t blockSize) : m_blockSize(blockSize)
+{
+	for (int32_t i = 0; i < ClassCount; ++i)
+		m_freeLists[i] = nullptr;
+}
+
+ArenaAllocator::~ArenaAllocator()
+{
+	Reset();
+}
+
+void *ArenaAllocator::Allocate(int32_t bytes)
+{
+	int32_t sizeClass = GetSizeClass(bytes);
+	int32_t classBytes = 1 << (sizeClass + MinClassShift);
+
+	std::lock_guard lock(m_mutex);
+
+	ArenaFreeNode *node = m_freeLists[sizeClass];
+	if (node) // Reuse a previously freed slot of the same class
+	{
+		m_freeLists[sizeClass] = node->Next;
+		return node;
+	}
+
+	if (classBytes > m_blockSize) // Too large for a shared block, give it its own block
+	{
+		void *memory = std::malloc(classBytes);
+		m_blocks.push_back(memory);
+		m_reservedBytes += classBytes;
+		return memory;
+	}
+
+	if (m_currentLeft < classBytes) // Current block is exhausted
+	{
+		m_current = reinterpret_cast<char *>(std::malloc(m_blockSize));
+		m_currentLeft = m_blockSize;
+		m_blocks.push_back(m_current);
+		m_reservedBytes += m_blockSize;
+	}
+
+	void *memory = m_current; // Classes are powers of two and blocks start aligned, so every slot stays aligned to min(class, 16)
+	m_current += classBytes;
+	m_currentLeft -= classBytes;
+	return memory;
+}
+
+void ArenaAllocator::Free(void *memory, int32_t bytes)
+{
+	if (!memory)
+		return;
+	int32_t sizeClass = GetSizeClass(bytes);
+
+	std::lock_guard lock(m_mutex);
+
+	ArenaFreeNode *node = reinterpret_cast<ArenaFreeNode *>(memory);
+	node->Next = m_freeLists[sizeClass];
+	m_freeLists[sizeClass] = node;
+}
+
+void ArenaAllocator::Reset()
+{
+	std::lock_guard lock(m_mutex);
+
+	for (void *block : m_blocks)
+		std::free(block);
+	m_blocks.clear();
+	for (int32_t i = 0; i < ClassCount; ++i)
+		m_freeLists[i] = nullptr;
+
+	m_current = nullptr;
+	m_currentLeft = 0;
+	m_reservedBytes = 0;
+}
+
+int32_t ArenaAllocator::GetSizeClassBytes(int32_t bytes)
+{
+	return 1 << (GetSizeClass(bytes) + MinClassShift);
+}
+
+int32_t ArenaAllocator::GetSizeClass(int32_t bytes)
+{
+	int32_t sizeClass = 0;
+	while ((1 << (sizeClass + MinClassShift)) < bytes)
+		++sizeClass;
+	return sizeClass;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <mutex>
+
+#include "exports.h"
+
+class ArenaFreeNode
+{
+public:
+	ArenaFreeNode *Next;
+};
+
+class ArenaAllocator
+{
+public:
+	XENGINEAPI ArenaAllocator(int32_t blockSize = 65536);
+	XENGINEAPI ~ArenaAllocator();
+	XENGINEAPI void *Allocate(int32_t bytes); // Allocate from the free list of the size class or bump from the current block
+	XENGINEAPI void Free(void *memory, int32_t bytes); // Return memory to the free list of its size class
+	XENGINEAPI void Reset(); // Release every block at once
+	XENGINEAPI int32_t GetSizeClassBytes(int32_t bytes); // Size that will actually be reserved for an allocation
+	inline uint64_t GetReservedBytes() { return m_reservedBytes; }
+private:
+	static constexpr int32_t MinClassShift = 4; // Smallest size class is 16 bytes
+	static constexpr int32_t ClassCount = 28;
+
+	int32_t GetSizeClass(int32_t bytes);
+
+	std::mutex m_mutex;
+
+	std::vector<void *> m_blocks;
+	ArenaFreeNode *m_freeLists[ClassCount];
+
+	char *m_current = nullptr;
+	int32_t m_currentLeft = 0;
+	int32_t m_blockSize;
+	uint64_t m_reservedBytes = 0;
+};
@@ -0,0 +1,191 @@
+#include "pch.h"
+#include "AssetBudget.h"
+#include "AssetManager.h"
+#include "LocalMemoryAllocator.h"
+
+AssetBudgetManager::AssetBudgetManager(LocalMemoryAllocator *assetMemory) : m_assetMemory(assetMemory)
+{
+}
+
+void AssetBudgetManager::SetBudget(std::string type, uint64_t cpuBytes, uint64_t gpuBytes)
+{
+	std::lock_guard lock(m_mutex);
+	AssetTypeBudget& budget = GetBudget(type);
+	budget.CpuBudget = cpuBytes;
+	budget.GpuBudget = gpuBytes;
+}
+
+void AssetBudgetManager::SetResidency(IAsset *asset, uint64_t cpuBytes, uint64_t gpuBytes)
+{
+	std::lock_guard lock(m_mutex);
+	if (!cpuBytes && !gpuBytes && m_residency.find(asset) == m_residency.end()) // Nothing to track, and it may be getting disposed
+		return;
+
+	AssetResidency& residency = GetResidency(asset);
+	residency.Budget->CpuBytes += cpuBytes - residency.CpuBytes;
+	residency.Budget->GpuBytes += gpuBytes - residency.GpuBytes;
+	residency.CpuBytes = cpuBytes;
+	residency.GpuBytes = gpuBytes;
+}
+
+void AssetBudgetManager::Release(IAssetLoader *loader, IAsset *asset)
+{
+	std::lock_guard lock(m_mutex);
+	AssetResidency& residency = GetResidency(asset);
+	RemoveFromLru(residency);
+	residency.Loader = loader;
+	residency.Unreferenced = true;
+	residency.LruEntry = m_lru.insert(m_lru.end(), asset);
+	residency.InLru = true;
+}
+
+void AssetBudgetManager::Retain(IAsset *asset)
+{
+	std::unique_lock lock(m_mutex);
+	AssetResidency& residency = GetResidency(asset);
+	m_unloaded.wait(lock, [&residency]() { return !residency.Unloading; }); // Must not hand out an asset whose memory is being freed
+	RemoveFromLru(residency);
+	residency.Unreferenced = false;
+}
+
+void AssetBudgetManager::Forget(IAsset *asset)
+{
+	std::unique_lock lock(m_mutex);
+	auto iter = m_residency.find(asset);
+	if (iter == m_residency.end())
+		return;
+	m_unloaded.wait(lock, [&iter]() { return !iter->second.Unloading; }); // Map nodes stay put, and only Forget erases them
+
+	AssetResidency& residency = iter->second;
+	RemoveFromLru(residency);
+	residency.Budget->CpuBytes -= residency.CpuBytes;
+	residency.Budget->GpuBytes -= residency.GpuBytes;
+	m_residency.erase(iter);
+}
+
+int32_t AssetBudgetManager::Enforce()
+{
+	std::unique_lock lock(m_mutex);
+	int32_t evicted = 0;
+	while (UpdateEvicting())
+	{
+		IAsset *victim = nullptr;
+		for (IAsset *asset : m_lru)
+		{
+			AssetResidency& residency = m_residency[asset];
+			if ((m_arenaEvicting && residency.CpuBytes > 0) || (residency.Budget->Evicting && residency.CpuBytes + residency.GpuBytes > 0))
+			{
+				victim = asset;
+				break;
+			}
+		}
+		if (!victim) // Everything left over budget is still referenced
+			break;
+
+		Evict(lock, victim);
+		++evicted;
+	}
+	return evicted;
+}
+
+int32_t AssetBudgetManager::EvictUnreferenced(uint64_t cpuBytes)
+{
+	std::unique_lock lock(m_mutex);
+	int32_t evicted = 0;
+	uint64_t freed = 0;
+	while (freed < cpuBytes)
+	{
+		auto iter = std::find_if(m_lru.begin(), m_lru.end(), [this](IAsset *asset) { return m_residency[asset].CpuBytes > 0; });
+		if (iter == m_lru.end())
+			break;
+
+		IAsset *victim = *iter;
+		freed += m_residency[victim].CpuBytes;
+		Evict(lock, victim);
+		++evicted;
+	}
+	return evicted;
+}
+
+int32_t AssetBudgetManager::EvictAll()
+{
+	std::unique_lock lock(m_mutex);
+	int32_t evicted = 0;
+	while (!m_lru.empty())
+	{
+		Evict(lock, m_lru.front());
+		++evicted;
+	}
+	return evicted;
+}
+
+std::vector<AssetTypeBudget> AssetBudgetManager::GetBudgets()
+{
+	std::lock_guard lock(m_mutex);
+	std::vector<AssetTypeBudget> budgets;
+	budgets.reserve(m_budgets.size());
+	for (auto& pair : m_budgets)
+		budgets.push_back(pair.second);
+	return budgets;
+}
+
+AssetTypeBudget& AssetBudgetManager::GetBudget(std::string type)
+{
+	AssetTypeBudget& budget = m_budgets[type];
+	budget.Type = type;
+	return budget;
+}
+
+AssetResidency& AssetBudgetManager::GetResidency(IAsset *asset)
+{
+	AssetResidency& residency = m_residency[asset];
+	if (!residency.Budget)
+		residency.Budget = &GetBudget(asset->GetTypeName());
+	return residency;
+}
+
+bool AssetBudgetManager::UpdateEvicting()
+{
+	bool evicting = false;
+	for (auto& pair : m_budgets)
+	{
+		AssetTypeBudget& budget = pair.second;
+		bool over = (budget.CpuBudget && budget.CpuBytes > budget.CpuBudget) || (budget.GpuBudget && budget.GpuBytes > budget.GpuBudget);
+		bool settled = (!budget.CpuBudget || budget.CpuBytes <= budget.CpuBudget * AssetBudgetLowWatermark) &&
+			(!budget.GpuBudget || budget.GpuBytes <= budget.GpuBudget * AssetBudgetLowWatermark);
+		if (over)
+			budget.Evicting = true;
+		else if (settled)
+			budget.Evicting = false;
+		evicting |= budget.Evicting;
+	}
+
+	if (m_assetMemory->IsOverSoftLimit())
+		m_arenaEvicting = true;
+	else if (m_assetMemory->GetUsedSize() <= m_assetMemory->GetSoftLimit() * AssetBudgetLowWatermark)
+		m_arenaEvicting = false;
+
+	return evicting || m_arenaEvicting;
+}
+
+void AssetBudgetManager::RemoveFromLru(AssetResidency& residency)
+{
+	if (residency.InLru)
+		m_lru.erase(residency.LruEntry);
+	residency.InLru = false;
+}
+
+void AssetBudgetManager::Evict(std::unique_lock<std::mutex>& lock, IAsset *asset)
+{
+	AssetResidency& residency = m_residency[asset];
+	RemoveFromLru(residency); // Also keeps a loader that frees nothing on unload from being picked again
+	++residency.Budget->Evictions;
+	IAssetLoader *loader = residency.Loader;
+	residency.Unloading = true;
+
+	lock.unlock(); // SetResidency from the unload takes the lock, Retain and Forget wait for Unloading to clear
+	loader->Unload(asset);
+	lock.lock();
+	residency.Unloading = false;
+	m_unloaded.notify_all();
+}
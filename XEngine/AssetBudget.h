@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "exports.h"
+
+constexpr double AssetBudgetLowWatermark = 0.875; // Once over a budget, evict down to this fraction of it so residency does not flip back and forth at the limit
+
+class IAsset;
+class IAssetLoader;
+class LocalMemoryAllocator;
+
+class AssetTypeBudget
+{
+public:
+	std::string Type;
+	uint64_t CpuBudget = 0; // Bytes, 0 for no limit
+	uint64_t GpuBudget = 0;
+	uint64_t CpuBytes = 0; // Resident now, as reported by the assets
+	uint64_t GpuBytes = 0;
+	int32_t Evictions = 0;
+	bool Evicting = false; // Went over budget and has not come down to the low watermark yet
+};
+
+class AssetResidency
+{
+public:
+	IAssetLoader *Loader = nullptr;
+	AssetTypeBudget *Budget = nullptr;
+	uint64_t CpuBytes = 0;
+	uint64_t GpuBytes = 0;
+	bool Unreferenced = false;
+	bool Unloading = false; // Being evicted with m_mutex released, referencing or forgetting the asset waits until the unload is done
+	bool InLru = false;
+	std::list<IAsset *>::iterator LruEntry;
+};
+
+class AssetBudgetManager // Resident bytes per asset type, unreferenced assets are unloaded least recently released first once a budget is exceeded
+{
+public:
+	XENGINEAPI AssetBudgetManager(LocalMemoryAllocator *assetMemory); // Going over its soft limit counts as over budget for every type
+	XENGINEAPI void SetBudget(std::string type, uint64_t cpuBytes, uint64_t gpuBytes);
+	XENGINEAPI void SetResidency(IAsset *asset, uint64_t cpuBytes, uint64_t gpuBytes); // Reported by the asset whenever its memory changes
+	XENGINEAPI void Release(IAssetLoader *loader, IAsset *asset); // Last reference dropped, stays resident until it is evicted
+	XENGINEAPI void Retain(IAsset *asset); // Referenced again, waits out an eviction already unloading it, the asset then has to be loaded again
+	XENGINEAPI void Forget(IAsset *asset); // Before the asset is disposed, also waits out an eviction
+	XENGINEAPI int32_t Enforce(); // Evict until every budget is met, returns how many assets were unloaded
+	XENGINEAPI int32_t EvictUnreferenced(uint64_t cpuBytes); // Make room for a load regardless of budgets, as far as unreferenced assets allow
+	XENGINEAPI int32_t EvictAll();
+	XENGINEAPI std::vector<AssetTypeBudget> GetBudgets();
+private:
+	AssetTypeBudget& GetBudget(std::string type); // Everything below is under m_mutex
+	AssetResidency& GetResidency(IAsset *asset);
+	bool UpdateEvicting(); // True if any budget still needs evicting
+	void RemoveFromLru(AssetResidency& residency);
+	void Evict(std::unique_lock<std::mutex>& lock, IAsset *asset); // Unloads with the lock released, the loader reports the freed memory through SetResidency
+
+	LocalMemoryAllocator *m_assetMemory;
+	bool m_arenaEvicting = false;
+
+	std::mutex m_mutex;
+	std::condition_variable m_unloaded; // Signaled whenever an eviction finishes unloading
+	std::unordered_map<std::string, AssetTypeBudget> m_budgets; // Nodes stay put, residencies point into it
+	std::unordered_map<IAsset *, AssetResidency> m_residency;
+	std::list<IAsset *> m_lru; // Unreferenced and still resident, least recently released first
+};
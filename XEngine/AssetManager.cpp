@@ -3,8 +3,14 @@
 
 #include <filesystem>
 
-AssetManager::AssetManager(int32_t loadMemSize, int32_t assetMemSize) : m_loadMemory(loadMemSize, 4096, true), m_assetMemory(assetMemSize, 1e6, true)
+AssetManager::AssetManager(uint64_t loadMemSize, uint64_t assetMemSize, int32_t ioCore, bool hugePages)
+	: m_loadMemory(loadMemSize, 4096, true, hugePages), m_assetMemory(assetMemSize, 1e6, true, hugePages),
+	m_budgets(&m_assetMemory), m_ioCore(ioCore)
 {
+	m_loadMemory.SetName("Asset load memory");
+	m_loadMemory.SetSlabLimit(SlabMaxSize); // Asset headers are small and short-lived, only bulk data should take up the arena's 4096 allocations
+	m_assetMemory.SetName("Asset memory");
+	m_assetMemory.SetDefragBudget(1 << 22, 64); // Asset churn leaves holes, close them a little every frame
 	m_running = true;
 	m_assetLoadingThread = new std::thread(&AssetManager::PerformThreadTasks, this);
 }
@@ -34,6 +40,7 @@ void AssetManager::DeleteAsset(UniqueId asset)
 	StoredAssetPtr& assetPtr = m_assets[asset];
 	IAssetLoader *loader = m_loaders[assetPtr.Asset->GetTypeName()];
 
+	m_budgets.Forget(assetPtr.Asset);
 	loader->Dispose(assetPtr.Asset);
 	m_pathToId[assetPtr.VirtualPath] = 0;
 
@@ -130,9 +137,14 @@ void AssetManager::ReassignPath(UniqueId id, std::string path)
 	ptr.VirtualPath = path;
 }
 
-void AssetManager::PushLoadRequest(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer loadData)
+void AssetManager::PushLoadRequest(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer loadData, std::function<void()> onFinished)
 {
-	m_loadRequests.push(AssetLoadRequest(loader, asset, loadData));
+	m_loadRequests.push(AssetLoadRequest(loader, asset, loadData, onFinished));
+}
+
+CallbackAwaiter AssetManager::LoadAsync(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer loadData)
+{
+	return CallbackAwaiter([this, loader, asset, loadData](std::function<void()> resume) { PushLoadRequest(loader, asset, loadData, resume); });
 }
 
 void AssetManager::PushUnloadRequest(IAssetLoader *loader, IAsset *asset)
@@ -158,8 +170,12 @@ void AssetManager::PerformThreadTasks()
 	AssetLoadRequest request(nullptr, nullptr, nullptr);
 	AssetUnloadRequest uRequest(nullptr, nullptr);
 	AssetExportRequest eRequest("", {});
+	TagCurrentThread(ThreadTag::IO, 0, m_ioCore);
+
+	std::vector<AssetLoadRequest> deferred;
 	while (m_running)
 	{
+		FrameArena::SyncThread();
 		while (m_loadRequests.try_pop(request))
 		{
 			std::vector<AssetLoadRange> loadRanges = request.Loader->Load(request.Asset, request.LoadData);
@@ -168,9 +184,16 @@ void AssetManager::PerformThreadTasks()
 			for (AssetLoadRange& range : loadRanges)
 				totalSize += range.Size;
 
-			if (!request.Loader->CanLoad(request.Asset, request.LoadData) && !m_loadMemory.WillFit(totalSize))
+			bool fits = request.Loader->CanLoad(request.Asset, request.LoadData) || m_loadMemory.WillFit(totalSize);
+			if (!fits && m_budgets.EvictUnreferenced(totalSize) > 0)
+				fits = request.Loader->CanLoad(request.Asset, request.LoadData) || m_loadMemory.WillFit(totalSize);
+			if (!fits)
 			{
-				m_loadRequests.push(request);
+				int32_t attempts = ++request.Attempts;
+				if ((attempts & (attempts - 1)) == 0) // Backs off, a load that does not fit tends to not fit for a while
+					XEngine::LogAnywhere("AssetManager: no room to load a " + request.Asset->GetTypeName() + " asset of " + std::to_string(totalSize) + " bytes (" +
+						std::to_string(attempts) + " attempts), everything resident is still referenced", LogMessageType::Warning);
+				deferred.push_back(request); // Retried on the next pass instead of spinning on it now
 				continue;
 			}
 
@@ -186,6 +209,8 @@ void AssetManager::PerformThreadTasks()
 				loadRanges, loadMemories);
 
 			request.Loader->FinishLoad(request.Asset, loadRanges, loadMemories, request.LoadData);
+			if (request.OnFinished)
+				request.OnFinished();
 		}
 		while (m_unloadRequests.try_pop(uRequest))
 		{
@@ -195,6 +220,10 @@ void AssetManager::PerformThreadTasks()
 		{
 			ExportAssetBundleToDisc(eRequest.Path, eRequest.Assets);
 		}
+		m_budgets.Enforce();
+		for (AssetLoadRequest& later : deferred)
+			m_loadRequests.push(later);
+		deferred.clear();
 		XEngineInstance->DoIdleWork();
 	}
 }
@@ -252,6 +281,16 @@ LocalMemoryAllocator& AssetManager::GetLoadMemory()
 	return m_loadMemory;
 }
 
+AssetBudgetManager& AssetManager::GetBudgets()
+{
+	return m_budgets;
+}
+
+void AssetManager::SetAssetBudget(std::string type, uint64_t cpuBytes, uint64_t gpuBytes)
+{
+	m_budgets.SetBudget(type, cpuBytes, gpuBytes);
+}
+
 void AssetManager::Copy(IAsset *src, IAsset *dest)
 {
 	if (src->GetTypeName() != dest->GetTypeName())
@@ -275,7 +314,9 @@ void AssetManager::DeleteBundleAssetsFromMemory(std::string filePath)
 
 void AssetManager::CleanUnusedMemory()
 {
-	// TODO: IMPLEMENT
+	m_budgets.EvictAll();
+	for (auto loaderPair : m_loaders)
+		loaderPair.second->CleanupUnusedMemory();
 }
 
 IAssetLoader::~IAssetLoader()
@@ -2,15 +2,17 @@
 
 #include <string>
 #include <vector>
-#include <concurrent_unordered_map.h>
 #include <thread>
 
 #include "UUID.h"
+#include "ConcurrentHashMap.h"
 
 #include "ListAllocator.h"
 #include "GraphicsDefs.h"
 #include "AssetBundleReader.h"
 #include "LocalMemoryAllocator.h"
+#include "AssetBudget.h"
+#include "AsyncTask.h"
 
 class IAsset
 {
@@ -91,10 +93,13 @@ using AssetMemoryPointer = ListMemoryPointer *;
 class AssetLoadRequest 
 {
 public:
-	AssetLoadRequest(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer ptr) : Loader(loader), Asset(asset), LoadData(ptr) { }
+	AssetLoadRequest(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer ptr, std::function<void()> onFinished = nullptr) 
+		: Loader(loader), Asset(asset), LoadData(ptr), OnFinished(onFinished) { }
 	IAssetLoader *Loader;
 	IAsset *Asset;
 	LoadMemoryPointer LoadData;
+	std::function<void()> OnFinished; // Called on the loading thread after FinishLoad
+	int32_t Attempts = 0; // Passes it was put off for lack of memory
 };
 
 class AssetUnloadRequest
@@ -116,7 +121,7 @@ public:
 class AssetManager
 {
 public:
-	XENGINEAPI AssetManager(int32_t loadMemSize, int32_t assetMemSize);
+	XENGINEAPI AssetManager(uint64_t loadMemSize, uint64_t assetMemSize, int32_t ioCore = -1, bool hugePages = false); // The loading thread is pinned to ioCore unless it is -1
 	XENGINEAPI ~AssetManager();
 
 	XENGINEAPI void AddAsset(std::string path, IAsset *asset);
@@ -132,11 +137,13 @@ public:
 
 	XENGINEAPI LocalMemoryAllocator& GetAssetMemory();
 	XENGINEAPI LocalMemoryAllocator& GetLoadMemory();
+	XENGINEAPI AssetBudgetManager& GetBudgets();
+	XENGINEAPI void SetAssetBudget(std::string type, uint64_t cpuBytes, uint64_t gpuBytes); // Per title, 0 for no limit
 
 	XENGINEAPI void Copy(IAsset *src, IAsset *dest);
 	XENGINEAPI UniqueId Duplicate(IAsset *src, std::string newPath);
 
-	XENGINEAPI void CleanUnusedMemory();
+	XENGINEAPI void CleanUnusedMemory(); // Unload every unreferenced asset, whatever the budgets
 
 	XENGINEAPI void RegisterImporter(IFormatImporter *importer);
 	XENGINEAPI void RegisterLoader(IAssetLoader *loader);
@@ -146,7 +153,8 @@ public:
 	XENGINEAPI std::string& GetPathById(UniqueId id);
 	XENGINEAPI void ReassignPath(UniqueId id, std::string path);
 
-	XENGINEAPI void PushLoadRequest(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer loadData);
+	XENGINEAPI void PushLoadRequest(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer loadData, std::function<void()> onFinished = nullptr);
+	XENGINEAPI CallbackAwaiter LoadAsync(IAssetLoader *loader, IAsset *asset, LoadMemoryPointer loadData); // Pushes the request when awaited, resumes after FinishLoad
 	XENGINEAPI void PushUnloadRequest(IAssetLoader *loader, IAsset *asset);
 
 	XENGINEAPI void ImportAsAssets(std::string path, std::string filePath, void *settings);
@@ -161,20 +169,22 @@ private:
 
 	std::atomic_bool m_running;
 	std::thread *m_assetLoadingThread;
+	int32_t m_ioCore;
 	void PerformThreadTasks();
 
 	void ExportAssetBundleToDisc(std::string filePath, std::vector<UniqueId>& assets);
 
 	LocalMemoryAllocator m_loadMemory;
 	LocalMemoryAllocator m_assetMemory;
+	AssetBudgetManager m_budgets;
 
 	std::unordered_map<std::string, IAssetLoader *> m_loaders;
 	std::unordered_map<std::string, IFormatImporter *> m_importers;
 
-	concurrency::concurrent_queue<AssetLoadRequest> m_loadRequests;
-	concurrency::concurrent_queue<AssetUnloadRequest> m_unloadRequests;
-	concurrency::concurrent_queue<AssetExportRequest> m_exportRequests;
+	ConcurrentQueue<AssetLoadRequest> m_loadRequests;
+	ConcurrentQueue<AssetUnloadRequest> m_unloadRequests;
+	ConcurrentQueue<AssetExportRequest> m_exportRequests;
 
-	concurrency::concurrent_unordered_map<std::string, UniqueId> m_pathToId;
-	concurrency::concurrent_unordered_map<UniqueId, StoredAssetPtr> m_assets;
+	ConcurrentHashMap<std::string, UniqueId> m_pathToId;
+	ConcurrentHashMap<UniqueId, StoredAssetPtr> m_assets;
 };
@@ -0,0 +1,27 @@
+#include "pch.h"
+#include "AsyncTask.h"
+
+#include <fstream>
+
+WorkerManager *GetAsyncTaskManager()
+{
+	return XEngineInstance->GetWorkerManager();
+}
+
+AsyncTask<std::vector<char>> ReadFileAsync(std::string path)
+{
+	co_await SwitchToWorkers(); // Keep the blocking read off the awaiting thread
+
+	std::vector<char> data;
+	std::ifstream stream(path.c_str(), std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+	if (!stream.is_open())
+	{
+		XEngineInstance->LogMessage("Could not open " + path, LogMessageType::Error);
+		co_return data;
+	}
+
+	data.resize(stream.tellg());
+	stream.seekg(0);
+	stream.read(data.data(), data.size());
+	co_return data;
+}
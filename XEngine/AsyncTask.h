@@ -0,0 +1,180 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "WorkerManager.h"
+#include "GraphicsDefs.h"
+
+XENGINEAPI WorkerManager *GetAsyncTaskManager(); // Pool that coroutines are resumed on
+
+template<class Promise>
+class AsyncTaskFinalAwaiter
+{
+public:
+	bool await_ready() noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+	{
+		Promise& promise = handle.promise();
+		std::coroutine_handle<> continuation = promise.Continuation;
+		promise.Done.store(true, std::memory_order_release);
+		if (--promise.References == 0) // The task object is gone, nobody will read the result
+			handle.destroy();
+		return continuation ? continuation : std::noop_coroutine(); // Resume the awaiting coroutine directly instead of going through the queue
+	}
+	void await_resume() noexcept { }
+};
+
+class AsyncTaskPromiseBase
+{
+public:
+	std::suspend_always initial_suspend() noexcept { return {}; } // Started by co_await or Start, so the continuation is always set first
+	void unhandled_exception() { Exception = std::current_exception(); }
+
+	std::coroutine_handle<> Continuation;
+	std::exception_ptr Exception;
+	std::atomic_int References = 2; // Held by the task object and by the running coroutine
+	std::atomic_bool Done = false;
+};
+
+template<class T>
+class AsyncTask;
+
+template<class T>
+class AsyncTaskPromise : public AsyncTaskPromiseBase
+{
+public:
+	AsyncTask<T> get_return_object() { return AsyncTask<T>(std::coroutine_handle<AsyncTaskPromise>::from_promise(*this)); }
+	AsyncTaskFinalAwaiter<AsyncTaskPromise> final_suspend() noexcept { return {}; }
+	void return_value(T value) { Value = std::move(value); }
+
+	std::optional<T> Value;
+};
+
+template<>
+class AsyncTaskPromise<void> : public AsyncTaskPromiseBase
+{
+public:
+	AsyncTask<void> get_return_object();
+	AsyncTaskFinalAwaiter<AsyncTaskPromise> final_suspend() noexcept { return {}; }
+	void return_void() { }
+};
+
+template<class T = void>
+class AsyncTask // Lazily started coroutine, resumed on the worker pool by the awaitables below
+{
+public:
+	using promise_type = AsyncTaskPromise<T>;
+
+	AsyncTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) { }
+	AsyncTask(AsyncTask&& other) noexcept : m_handle(other.m_handle), m_started(other.m_started) { other.m_handle = nullptr; }
+	AsyncTask(const AsyncTask&) = delete;
+	~AsyncTask() { Release(); }
+	AsyncTask& operator=(AsyncTask&& other) noexcept
+	{
+		Release();
+		m_handle = other.m_handle;
+		m_started = other.m_started;
+		other.m_handle = nullptr;
+		return *this;
+	}
+
+	void Start() // Run on the pool without awaiting, the task object may be dropped afterwards
+	{
+		m_started = true;
+		GetAsyncTaskManager()->Schedule(m_handle);
+	}
+	bool IsDone() { return m_handle && m_handle.promise().Done.load(std::memory_order_acquire); }
+	T Get() // For code outside of coroutines, executes queued tasks while waiting
+	{
+		if (!m_started)
+			Start();
+		WorkerManager *manager = GetAsyncTaskManager();
+		while (!IsDone())
+			if (!manager->RunPendingTask())
+				std::this_thread::yield();
+		return TakeResult();
+	}
+
+	bool await_ready() { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation)
+	{
+		m_started = true;
+		m_handle.promise().Continuation = continuation;
+		return m_handle; // Run the awaited task on this thread until its first suspension
+	}
+	T await_resume() { return TakeResult(); }
+private:
+	T TakeResult()
+	{
+		promise_type& promise = m_handle.promise();
+		if (promise.Exception)
+			std::rethrow_exception(promise.Exception);
+		if constexpr (!std::is_void_v<T>)
+			return std::move(*promise.Value);
+	}
+
+	void Release()
+	{
+		if (!m_handle)
+			return;
+		if (!m_started) // Never ran, nothing else references the frame
+			m_handle.destroy();
+		else if (--m_handle.promise().References == 0)
+			m_handle.destroy();
+		m_handle = nullptr;
+	}
+
+	std::coroutine_handle<promise_type> m_handle;
+	bool m_started = false;
+};
+
+inline AsyncTask<void> AsyncTaskPromise<void>::get_return_object()
+{
+	return AsyncTask<void>(std::coroutine_handle<AsyncTaskPromise>::from_promise(*this));
+}
+
+class WorkerSwitchAwaiter // co_await to continue on a pool thread
+{
+public:
+	bool await_ready() { return false; }
+	void await_suspend(std::coroutine_handle<> handle) { GetAsyncTaskManager()->Schedule(handle); }
+	void await_resume() { }
+};
+
+class CallbackAwaiter // Suspends until the callback handed to subscribe is invoked, from any thread
+{
+public:
+	CallbackAwaiter(std::function<void(std::function<void()>)> subscribe) : m_subscribe(subscribe) { }
+
+	bool await_ready() { return false; }
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		std::function<void(std::function<void()>)> subscribe = std::move(m_subscribe); // The coroutine may resume before subscribe returns, taking this awaiter with it
+		subscribe([handle]() { GetAsyncTaskManager()->Schedule(handle); }); // Resume on the pool, not on the thread that completed the work
+	}
+	void await_resume() { }
+private:
+	std::function<void(std::function<void()>)> m_subscribe;
+};
+
+inline WorkerSwitchAwaiter SwitchToWorkers()
+{
+	return WorkerSwitchAwaiter();
+}
+
+inline CallbackAwaiter WaitForSync(GraphicsSyncObject *sync) // Resumes once the context signals the fence, the caller keeps sync alive
+{
+	return CallbackAwaiter([sync](std::function<void()> resume) { sync->AddSignalCallback(resume); });
+}
+
+inline CallbackAwaiter WaitForSync(std::shared_ptr<GraphicsSyncObject> sync) // The sync object is kept alive until it is signaled
+{
+	return CallbackAwaiter([sync](std::function<void()> resume) { sync->AddSignalCallback([sync, resume]() { resume(); }); });
+}
+
+XENGINEAPI AsyncTask<std::vector<char>> ReadFileAsync(std::string path); // Read a whole file on a pool thread
@@ -2,10 +2,11 @@
 #include "ChunkAllocator.h"
 
 #include <memory>
+#include <atomic>
 
 // Initialize the variables
-MemoryChunkAllocator::MemoryChunkAllocator(int32_t objectsPerChunk, int32_t bytesPerObject) : m_objectsPerChunk(objectsPerChunk), m_bytesPerObject(bytesPerObject), 
-	m_bufferedCount(0), m_chunkCount(0), m_fullChunks(0)
+MemoryChunkAllocator::MemoryChunkAllocator(int32_t objectsPerChunk, int32_t bytesPerObject, MemoryChunkObjectPointer pointerSpace) : m_objectsPerChunk(objectsPerChunk), 
+	m_bytesPerObject(bytesPerObject), m_bufferedCount(0), m_chunkCount(0), m_fullChunks(0), m_pointerSpace(pointerSpace)
 { 
 	m_mutex = new std::mutex;
 }
@@ -13,13 +14,29 @@ MemoryChunkAllocator::MemoryChunkAllocator(int32_t objectsPerChunk, int32_t byte
 void MemoryChunkAllocator::CleanupAllocator()
 {
 	for (MemoryChunk& c : m_allChunks)
-		std::free(c.Memory); // Free all chunk memory
+		MemoryChunkPool::GetInstance().ReleaseChunk(c.Memory, (m_objectsPerChunk + 1) * m_bytesPerObject); // Hand all chunk memory to the pool
 	delete m_mutex;
 }
 
 MemoryChunkObjectPointer MemoryChunkAllocator::AllocateObject()
 {
+	MemoryChunkObjectPointer ptr;
 	m_mutex->lock();
+	AllocateSlot(ptr);
+	m_mutex->unlock();
+	return ptr;
+}
+
+void MemoryChunkAllocator::AllocateObjects(int32_t count, MemoryChunkObjectPointer *pointers, void **memory)
+{
+	m_mutex->lock();
+	for (int32_t i = 0; i < count; ++i)
+		memory[i] = AllocateSlot(pointers[i]).Memory;
+	m_mutex->unlock();
+}
+
+MemoryChunkObject& MemoryChunkAllocator::AllocateSlot(MemoryChunkObjectPointer& ptr)
+{
 	if (m_fullChunks == m_allChunks.size()) // If all chunks are full
 	{
 		for (int32_t i = 0; i < m_bufferedCount + 1; ++i) // Add empty chunks for future allocations and this one
@@ -34,21 +51,18 @@ MemoryChunkObjectPointer MemoryChunkAllocator::AllocateObject()
 	MemoryChunk& chunk = m_allChunks[m_chunkCount - 1]; // Get last chunk
 	MemoryChunkObject& obj = chunk.Objects[chunk.ObjectCount]; // Get next object slot
 
-	/* No clue what this does
-	if (chunk.ObjectCount == 0)
-		chunk.Index = chunk.ObjectCount;*/
-
 	++chunk.ObjectCount; // Increase object count
 
 	if (chunk.ObjectCount == m_objectsPerChunk) // If there is no more space in this chunk
 		++m_fullChunks; // Mark this chunk as full
 
-	MemoryChunkObjectPointer ptr = ((chunk.Index * static_cast<long long>(m_objectsPerChunk) + chunk.ObjectCount) << 32) | obj.AllocCount; // Make a unique pointer to object
+	++obj.AllocCount;
+	ptr = m_pointerSpace | ++m_allocationCount; // Make a unique pointer to object, allocators used in lockstep hand out the same sequence
 
+	obj.Pointer = ptr;
 	m_objectIndirectionTable[ptr] = &obj; // Add this pointer as being a pointer to this object
 
-	m_mutex->unlock();
-	return ptr;
+	return obj;
 }
 
 void MemoryChunkAllocator::FreeObject(MemoryChunkObjectPointer ptr)
@@ -83,10 +97,7 @@ void MemoryChunkAllocator::FreeObject(MemoryChunkObjectPointer ptr)
 		--m_chunkCount;
 		std::memset(chunk->Memory, 0, m_objectsPerChunk * m_bytesPerObject); // Clear the chunk memory
 		if (m_allChunks.size() - m_chunkCount > m_bufferedCount) // If the "buffered" boundary is overstepped (too many empty chunks around)
-		{
-			std::free(m_allChunks.back().Memory);
-			m_allChunks.pop_back();
-		}
+			ReleaseLastChunk();
 	}
 	m_mutex->unlock();
 }
@@ -99,6 +110,50 @@ void *MemoryChunkAllocator::GetObjectMemory(MemoryChunkObjectPointer ptr)
 	return val;
 }
 
+bool MemoryChunkAllocator::ContainsObject(MemoryChunkObjectPointer ptr)
+{
+	m_mutex->lock();
+	bool found = m_objectIndirectionTable.contains(ptr);
+	m_mutex->unlock();
+	return found;
+}
+
+void MemoryChunkAllocator::GetObjectLocation(MemoryChunkObjectPointer ptr, int32_t& chunk, int32_t& row)
+{
+	m_mutex->lock();
+	MemoryChunkObject *obj = m_objectIndirectionTable[ptr];
+	chunk = obj->ChunkIndex;
+	row = obj->IntrachunkIndex;
+	m_mutex->unlock();
+}
+
+void MemoryChunkAllocator::PermuteObjects(const std::vector<int32_t>& order)
+{
+	m_mutex->lock();
+	std::vector<char> temp(order.size() * m_bytesPerObject);
+	std::vector<MemoryChunkObjectPointer> pointers(order.size());
+	for (int32_t i = 0; i < order.size(); ++i) // Gather in the new order
+	{
+		MemoryChunkObject& src = m_allChunks[order[i] / m_objectsPerChunk].Objects[order[i] % m_objectsPerChunk];
+		std::memcpy(temp.data() + i * m_bytesPerObject, src.Memory, m_bytesPerObject);
+		pointers[i] = src.Pointer;
+	}
+	for (int32_t i = 0; i < order.size(); ++i) // Scatter back and repoint the lookup table
+	{
+		MemoryChunkObject& dest = m_allChunks[i / m_objectsPerChunk].Objects[i % m_objectsPerChunk];
+		std::memcpy(dest.Memory, temp.data() + i * m_bytesPerObject, m_bytesPerObject);
+		dest.Pointer = pointers[i];
+		m_objectIndirectionTable[pointers[i]] = &dest;
+	}
+	m_mutex->unlock();
+}
+
+MemoryChunkObjectPointer MemoryChunkAllocator::ReservePointerSpace()
+{
+	static std::atomic<MemoryChunkObjectPointer> nextSpace = 1;
+	return nextSpace++ << ChunkPointerSpaceBits;
+}
+
 void MemoryChunkAllocator::SetBufferedChunkCount(int32_t count)
 {
 	m_mutex->lock();
@@ -106,10 +161,7 @@ void MemoryChunkAllocator::SetBufferedChunkCount(int32_t count)
 	for (int32_t i = 0; i < m_bufferedCount - (m_allChunks.size() - m_chunkCount); ++i) // Allocate the amount of chunks needed to meet the empty chunk requirement
 		AllocateNewChunk();
 	for (int32_t i = 0; i < (m_allChunks.size() - m_chunkCount) - m_bufferedCount; ++i) // Delete the chunks if there are too many empty ones
-	{
-		std::free(m_allChunks.back().Memory);
-		m_allChunks.pop_back();
-	}
+		ReleaseLastChunk();
 	m_mutex->unlock();
 }
 
@@ -129,7 +181,7 @@ void MemoryChunkAllocator::AllocateNewChunk()
 	MemoryChunk& chunk = m_allChunks.back();
 	chunk.Index = m_allChunks.size() - 1; // Get the last chunk index
 	chunk.ObjectCount = 0;
-	chunk.Memory = std::calloc(m_objectsPerChunk + 1, m_bytesPerObject); // Allocate chunk memory with 0s in all bytes
+	chunk.Memory = MemoryChunkPool::GetInstance().AcquireChunk((m_objectsPerChunk + 1) * m_bytesPerObject); // Get chunk memory with 0s in all bytes
 	/*
 	size_t space = (m_objectsPerChunk + 1) * m_bytesPerObject;
 	chunk.Memory = std::align(16, m_objectsPerChunk * m_bytesPerObject, chunk.Memory, space); // Align for SIMD
@@ -145,3 +197,110 @@ void MemoryChunkAllocator::AllocateNewChunk()
 		obj.Pointer = 0;
 	}
 }
+
+void MemoryChunkAllocator::ReleaseLastChunk()
+{
+	MemoryChunkPool::GetInstance().ReleaseChunk(m_allChunks.back().Memory, (m_objectsPerChunk + 1) * m_bytesPerObject);
+	m_allChunks.pop_back();
+}
+
+MemoryChunkPool::~MemoryChunkPool()
+{
+	Trim();
+}
+
+void *MemoryChunkPool::AcquireChunk(int32_t bytes)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		auto iter = m_freeChunks.find(bytes);
+		if (iter != m_freeChunks.end() && !iter->second.empty()) // A chunk of this size was released by some archetype
+		{
+			void *memory = iter->second.back();
+			iter->second.pop_back();
+			m_pooledBytes -= bytes;
+			std::memset(memory, 0, bytes);
+			return memory;
+		}
+
+		if (void *memory = CarveChunk(bytes))
+			return memory;
+	}
+	return std::calloc(1, bytes);
+}
+
+void MemoryChunkPool::ReleaseChunk(void *memory, int32_t bytes)
+{
+	std::lock_guard lock(m_mutex);
+	if (m_pooledBytes + bytes <= m_maxPooledBytes || IsSlabChunk(memory)) // Slab chunks stay pooled whatever the limit, decommitting part of a huge page would split it into small ones
+	{
+		m_freeChunks[bytes].push_back(memory);
+		m_pooledBytes += bytes;
+	}
+	else
+		std::free(memory);
+}
+
+void MemoryChunkPool::SetMaxPooledBytes(uint64_t bytes)
+{
+	std::lock_guard lock(m_mutex);
+	m_maxPooledBytes = bytes;
+}
+
+void MemoryChunkPool::Trim()
+{
+	std::lock_guard lock(m_mutex);
+	for (auto& sizePair : m_freeChunks)
+	{
+		std::vector<void *> kept;
+		for (void *memory : sizePair.second)
+		{
+			if (IsSlabChunk(memory))
+				kept.push_back(memory);
+			else
+			{
+				std::free(memory);
+				m_pooledBytes -= sizePair.first;
+			}
+		}
+		sizePair.second.swap(kept);
+	}
+}
+
+void MemoryChunkPool::SetHugePageSlabs(bool enabled)
+{
+	std::lock_guard lock(m_mutex);
+	m_useSlabs = enabled;
+}
+
+void *MemoryChunkPool::CarveChunk(int32_t bytes)
+{
+	if (!m_useSlabs)
+		return nullptr;
+	if (!m_slab)
+		m_slab = std::make_unique<VirtualMemoryRange>(ChunkSlabReserveSize, true);
+
+	uint64_t offset = (m_slabUsed + ChunkSlabAlignment - 1) / ChunkSlabAlignment * ChunkSlabAlignment;
+	uint64_t end = offset + bytes;
+	if (end > m_slabCommitted)
+	{
+		uint64_t committed = std::min((end + HugePageSize - 1) / HugePageSize * HugePageSize, m_slab->GetReservedSize()); // Whole huge pages at a time
+		if (end > committed || !m_slab->Commit(m_slabCommitted, committed - m_slabCommitted))
+			return nullptr;
+		m_slabCommitted = committed;
+	}
+	m_slabUsed = end;
+	return reinterpret_cast<char *>(m_slab->GetBase()) + offset; // Freshly committed pages are zeroed
+}
+
+bool MemoryChunkPool::IsSlabChunk(void *memory)
+{
+	char *base = m_slab ? reinterpret_cast<char *>(m_slab->GetBase()) : nullptr;
+	return base && memory >= base && memory < base + m_slabUsed;
+}
+
+MemoryChunkPool& MemoryChunkPool::GetInstance()
+{
+	static MemoryChunkPool pool;
+	return pool;
+}
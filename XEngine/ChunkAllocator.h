@@ -1,12 +1,19 @@
 #pragma once
 #include <vector>
 #include <map>
+#include <memory>
 #include <mutex>
 
 #include "exports.h"
+#include "VirtualMemory.h"
 
 using MemoryChunkObjectPointer = long long;
 
+constexpr uint64_t ChunkSlabReserveSize = 1ull << 35; // Address space chunks are carved from when slabs are on, committed as it is used
+constexpr uint64_t ChunkSlabAlignment = 64;
+constexpr int32_t ChunkPointerSpaceBits = 40; // Low bits of a pointer count the allocations made in its space
+constexpr MemoryChunkObjectPointer ChunkPointerSpaceMask = ~((1ll << ChunkPointerSpaceBits) - 1);
+
 class MemoryChunkObject
 {
 public:
@@ -26,18 +33,51 @@ public:
 	std::vector<MemoryChunkObject> Objects;
 };
 
+class MemoryChunkPool
+{
+public:
+	XENGINEAPI ~MemoryChunkPool();
+	XENGINEAPI void *AcquireChunk(int32_t bytes); // Reuse a released chunk of the same size or allocate a new one, always zeroed
+	XENGINEAPI void ReleaseChunk(void *memory, int32_t bytes); // Keep a chunk for any allocator that needs the same size
+	XENGINEAPI void SetMaxPooledBytes(uint64_t bytes); // Heap chunks released past this limit go back to the heap
+	XENGINEAPI void Trim(); // Return every pooled heap chunk to the heap, slab chunks stay pooled
+	XENGINEAPI void SetHugePageSlabs(bool enabled); // Carve new chunks out of one huge page backed range instead of separate heap allocations
+	inline uint64_t GetPooledBytes() { return m_pooledBytes; }
+
+	XENGINEAPI static MemoryChunkPool& GetInstance(); // Pool shared by the allocators of every archetype
+private:
+	void *CarveChunk(int32_t bytes); // Null if slabs are off or out of room, m_mutex must be held
+	bool IsSlabChunk(void *memory);
+
+	std::mutex m_mutex;
+	std::map<int32_t, std::vector<void *>> m_freeChunks; // Map from a chunk byte size to released chunks of that size
+	uint64_t m_pooledBytes = 0;
+	uint64_t m_maxPooledBytes = 64ull << 20;
+
+	bool m_useSlabs = false;
+	std::unique_ptr<VirtualMemoryRange> m_slab; // Reserved the first time slabs are used, never shrinks
+	uint64_t m_slabUsed = 0;
+	uint64_t m_slabCommitted = 0;
+};
+
 class MemoryChunkAllocator
 {
 public:
-	XENGINEAPI MemoryChunkAllocator(int32_t objectsPerChunk, int32_t bytesPerObject);
+	XENGINEAPI MemoryChunkAllocator(int32_t objectsPerChunk, int32_t bytesPerObject, MemoryChunkObjectPointer pointerSpace = 0);
 	XENGINEAPI void CleanupAllocator();
 	XENGINEAPI MemoryChunkObjectPointer AllocateObject(); // Allocate an empty, new object
+	XENGINEAPI void AllocateObjects(int32_t count, MemoryChunkObjectPointer *pointers, void **memory); // Allocate several objects under one lock, returning their pointers and raw memory
 	XENGINEAPI void FreeObject(MemoryChunkObjectPointer obj); // Free an object from a chunk
 	XENGINEAPI void *GetObjectMemory(MemoryChunkObjectPointer ptr); // Get the raw memory of an object
+	XENGINEAPI bool ContainsObject(MemoryChunkObjectPointer ptr); // Allocated here and not freed since
+	XENGINEAPI void GetObjectLocation(MemoryChunkObjectPointer ptr, int32_t& chunk, int32_t& row); // Get the chunk and row currently holding an object
+	XENGINEAPI void PermuteObjects(const std::vector<int32_t>& order); // Object at position i moves from position order[i], pointers keep following their objects
 	XENGINEAPI void SetBufferedChunkCount(int32_t count); // Set the amount of chunks that should be empty whenever all chunks fill up (performance improvement until more need to be allocated)
 	XENGINEAPI std::vector<MemoryChunk>& GetAllChunks(); // Get all the chunks
 	XENGINEAPI int32_t GetActiveChunkCount();
 	inline int32_t GetPerObjectSize() { return m_bytesPerObject; } // Get the size of an individual object
+
+	XENGINEAPI static MemoryChunkObjectPointer ReservePointerSpace(); // Pointer range that never collides with other spaces, share it between allocators used in lockstep
 private:
 	std::mutex *m_mutex;
 
@@ -48,7 +88,12 @@ private:
 	int32_t m_bufferedCount; // Amount of empty chunks needed
 
 	void AllocateNewChunk();
+	void ReleaseLastChunk();
+	MemoryChunkObject& AllocateSlot(MemoryChunkObjectPointer& ptr); // Reserve the next slot, mutex must be held
 
 	int32_t m_objectsPerChunk;
 	int32_t m_bytesPerObject;
+
+	MemoryChunkObjectPointer m_pointerSpace; // High bits of every pointer this allocator hands out
+	MemoryChunkObjectPointer m_allocationCount = 0;
 };
\ No newline at end of file
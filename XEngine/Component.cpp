@@ -1,30 +1,31 @@
 #include "pch.h"
 #include <algorithm>
+#include <array>
+#include <execution>
+#include <numeric>
 
 ComponentManager::ComponentManager(Scene *scene) : m_scene(scene)
 {
 	m_componentChunkSize = 32; // Set size of chunk for components
-	m_componentDisposedChunkSize = 8; // Set size of chunk for disposed components
+	m_compactionBudget = 0.0005f; // Spend at most half a millisecond per frame compacting
 }
 
 ComponentManager::~ComponentManager()
 {
-	for (auto pair : m_componentGroupTypes)
+	for (ComponentGroupType *type : m_groupTypes)
 	{
-		for (MemoryChunkAllocator& alloc : pair.second->Allocators)
+		for (MemoryChunkAllocator& alloc : type->Allocators)
 			alloc.CleanupAllocator();
-		for (MemoryChunkAllocator& alloc : pair.second->DisposedAllocators)
-			alloc.CleanupAllocator();
-		delete pair.second; // Delete all component group types
+		delete type; // Delete all component group types
 	}
 }
 
 void ComponentManager::InitializeFilteringGroups()
 {
 	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
-	for (auto comp : registrar->GetComponentMap()) // Add filtering group for each possible component alone
+	for (InternalTypeInfo& info : registrar->GetComponentInfos()) // Add filtering group for each possible component alone
 	{
-		AddFilteringGroup({ registrar->GetComponentIdByName("EntityIdComponent"), comp.first });
+		AddFilteringGroup({ StaticComponentInfo<EntityIdComponent>::GetIdentifier(), info.Identifier });
 	}
 }
 
@@ -43,11 +44,11 @@ FilteringGroupId ComponentManager::AddFilteringGroup(std::vector<ComponentTypeId
 		{
 			internalId = m_filteringCompsToInternalFiltering[setComp] = GenerateID(); // Generate new unordered filtering group id
 			auto& vec = m_internalFilteringIdToComponentGroup[internalId] = std::vector<ComponentGroupType *>(); // Create list of component group types associated with this unordered filtering group
-			for (auto compGroup : m_componentGroupTypes)
+			for (ComponentGroupType *type : m_groupTypes)
 			{
-				if (std::includes(compGroup.first.begin(), compGroup.first.end(), setComp.begin(), setComp.end())) // Is this unordered filtering group contained in this component group type
+				if (std::includes(type->ComponentTypes.begin(), type->ComponentTypes.end(), setComp.begin(), setComp.end())) // Is this unordered filtering group contained in this component group type
 				{
-					vec.push_back(compGroup.second);
+					vec.push_back(type);
 				}
 			}
 		}
@@ -55,6 +56,9 @@ FilteringGroupId ComponentManager::AddFilteringGroup(std::vector<ComponentTypeId
 
 		UniqueId id = m_filteringToId[components] = GenerateID(); // Generate new filtering group id
 		m_idToFiltering[id] = components; // Set the component order associated with the filtering group
+		std::vector<int32_t>& indices = m_idToFilteringIndices[id];
+		for (ComponentTypeId comp : components) // Resolve the dense indices once instead of per chunk
+			indices.push_back(registrar->GetComponentIndex(comp));
 		m_filteringIdToInternalId[id] = internalId; // Set the unordered filtering group associated with this filtering group
 		return id;
 	}
@@ -63,28 +67,34 @@ FilteringGroupId ComponentManager::AddFilteringGroup(std::vector<ComponentTypeId
 
 std::vector<ComponentDataIterator> *ComponentManager::GetFilteringGroup(FilteringGroupId filteringGroup, bool disposed)
 {
-	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
-	
 	std::vector<ComponentDataIterator> *filtering = new std::vector<ComponentDataIterator>; // Prepare a list for the iterators
-	std::vector<UniqueId>& order = m_idToFiltering[filteringGroup]; // Get the order of the components
+	std::vector<int32_t>& order = m_idToFilteringIndices[filteringGroup]; // Get the order of the components
 	auto& compTypes = m_internalFilteringIdToComponentGroup[m_filteringIdToInternalId[filteringGroup]]; // Get the types of components
 	for (ComponentGroupType *type : compTypes)
 	{
-		int32_t chunkCount = (disposed ? type->DisposedAllocators[0] : type->Allocators[0]).GetActiveChunkCount(); // Get the chunk count
+		if (disposed ? type->KilledRows.empty() && !type->Dropping : type->Dropping) // Nothing was killed in this type, or nothing in it is alive
+			continue;
+
+		std::vector<MemoryChunkAllocator>& allocators = type->Allocators;
+		int32_t chunkCount = allocators[0].GetActiveChunkCount(); // Get the chunk count
 		for (int32_t chunk = 0; chunk < chunkCount; ++chunk)
 		{
-			std::vector<void *> compBlocks(type->ComponentTypes.size()); // Component pointers
-			std::vector<int32_t> sizes(type->ComponentTypes.size()); // Component sizes
+			const uint64_t *tombstones = type->GetMask(disposed ? type->KilledMasks : type->TombstoneMasks, chunk);
+			if (disposed && !tombstones) // Disposal only visits chunks with killed rows
+				continue;
+
+			FrameVector<void *> compBlocks(order.size()); // Component pointers
+			FrameVector<int32_t> sizes(order.size()); // Component sizes
 
 			for (int32_t comp = 0; comp < order.size(); ++comp)
 			{
-				auto allocator = (disposed ? type->CompTypeToDisposedAllocator : type->CompTypeToAllocator)[order[comp]]; // Find the correct allocator for this usage
-				compBlocks[comp] = allocator->GetAllChunks()[chunk].Memory;
-				sizes[comp] = allocator->GetPerObjectSize();
+				MemoryChunkAllocator& allocator = allocators[type->GetColumn(order[comp])];
+				compBlocks[comp] = allocator.GetAllChunks()[chunk].Memory;
+				sizes[comp] = allocator.GetPerObjectSize();
 			}
 
-			int32_t count = type->Allocators[0].GetAllChunks()[0].ObjectCount;
-			filtering->push_back(ComponentDataIterator(sizes, compBlocks, 0, count));
+			int32_t count = allocators[0].GetAllChunks()[chunk].ObjectCount;
+			filtering->push_back(ComponentDataIterator(std::move(sizes), std::move(compBlocks), 0, count, tombstones, disposed));
 		}
 	}
 
@@ -93,8 +103,7 @@ std::vector<ComponentDataIterator> *ComponentManager::GetFilteringGroup(Filterin
 
 ComponentGroupId ComponentManager::AllocateComponentGroup(std::set<ComponentTypeId> components)
 {
-	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
-	components.insert(registrar->GetComponentIdByName("EntityIdComponent"));
+	components.insert(StaticComponentInfo<EntityIdComponent>::GetIdentifier());
 
 	ComponentGroupId id = GenerateID();
 
@@ -103,6 +112,53 @@ ComponentGroupId ComponentManager::AllocateComponentGroup(std::set<ComponentType
 	return id;
 }
 
+void ComponentManager::InstantiateComponentGroups(ComponentRowTemplate& rowTemplate, int32_t count, ComponentGroupId *ids)
+{
+	ComponentGroupType *type = GetComponentGroupType(rowTemplate.Components);
+
+	std::vector<MemoryChunkObjectPointer> ptrs(count);
+	StampRows(type->ComponentIndices, type->Allocators, &type->OverflowArena, rowTemplate, count, ids, ptrs.data());
+
+	for (int32_t row = 0; row < count; ++row)
+		m_componentGroups[ids[row]] = std::make_pair(ptrs[row], type);
+}
+
+void ComponentManager::StampRows(const std::vector<int32_t>& componentIndices, std::vector<MemoryChunkAllocator>& allocators, ArenaAllocator *arena,
+	ComponentRowTemplate& rowTemplate, int32_t count, ComponentGroupId *ids, MemoryChunkObjectPointer *ptrs, bool pointerIds)
+{
+	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+
+	std::vector<void *> rows(count);
+	for (int32_t i = 0; i < componentIndices.size(); ++i) // Columns allocate in lockstep, so every column yields the same pointers
+	{
+		MemoryChunkAllocator& allocator = allocators[i];
+		allocator.AllocateObjects(count, ptrs, rows.data());
+
+		const char *image = rowTemplate.RowImage.data() + rowTemplate.ColumnOffsets[i];
+		int32_t size = allocator.GetPerObjectSize();
+		for (int32_t row = 0; row < count; ++row) // Stamp the baked defaults into every reserved row
+			std::memcpy(rows[row], image, size);
+
+		InternalTypeInfo& info = registrar->GetComponentInfoByIndex(componentIndices[i]);
+		if (info.Index == EntityIdComponentIndex) // Per-instance fix-up: fresh entity ids
+		{
+			for (int32_t row = 0; row < count; ++row)
+				*reinterpret_cast<UniqueId *>(rows[row]) = ids[row] = pointerIds ? ptrs[row] : GenerateID();
+		}
+		else if (info.Buffered) // Per-instance fix-up: buffers must not share the template's storage
+		{
+			std::vector<char>& elements = rowTemplate.BufferData[i];
+			for (int32_t row = 0; row < count; ++row)
+			{
+				BufferedComponent *buffer = Upcast<BufferedComponent>(rows[row], info.BufferOffset);
+				buffer->InitializeBufferStore(arena, info.BufferElementSize, info.BufferInlineCapacity, info.BufferInlineOffset);
+				if (!elements.empty())
+					buffer->SetRawBufferData(elements.data(), elements.size() / info.BufferElementSize);
+			}
+		}
+	}
+}
+
 ComponentGroupType *ComponentManager::GetComponentGroupType(std::set<ComponentTypeId> components)
 {
 	auto iter = m_componentGroupTypes.find(components);
@@ -125,22 +181,16 @@ ComponentGroupType *ComponentManager::GetComponentGroupType(std::set<ComponentTy
 		type->ChunkSize = m_componentChunkSize;
 		type->ComponentTypes = std::vector<UniqueId>(components.begin(), components.end()); // Copy the components to an internal vector
 		type->Allocators.reserve(type->ComponentTypes.size()); // Preallocate space for vectors
-		type->DisposedAllocators.reserve(type->ComponentTypes.size());
+		type->Columns.resize(registrar->GetComponentCount(), -1);
 		for (UniqueId id : type->ComponentTypes)
 		{
-			int32_t size = registrar->GetComponentSize(id);
-			type->Allocators.push_back(MemoryChunkAllocator(type->ChunkSize, size)); // Create allocators for the type
-			type->DisposedAllocators.push_back(MemoryChunkAllocator(m_componentDisposedChunkSize, size));
-			type->CompTypeToAllocator[id] = &type->Allocators.back();
-			type->CompTypeToDisposedAllocator[id] = &type->DisposedAllocators.back();
-		}
-		for (auto pair : m_filteringCompsToInternalFiltering)
-		{
-			if (std::includes(components.begin(), components.end(), pair.first.begin(), pair.first.end())) // Do any filtering groups use this component group
-			{
-				m_internalFilteringIdToComponentGroup[pair.second].push_back(type); // If so add this group to the unordered filtering group
-			}
+			InternalTypeInfo& info = registrar->GetComponentInfo(id);
+			type->Columns[info.Index] = type->ComponentIndices.size();
+			type->ComponentIndices.push_back(info.Index);
+			type->Allocators.push_back(MemoryChunkAllocator(type->ChunkSize, info.Size)); // Create allocators for the type
 		}
+		m_groupTypes.push_back(type);
+		AddToFilteringGroups(type, components);
 
 		compGroupTypeAddMutex.unlock();
 		return type;
@@ -148,6 +198,17 @@ ComponentGroupType *ComponentManager::GetComponentGroupType(std::set<ComponentTy
 	return iter->second;
 }
 
+void ComponentManager::AddToFilteringGroups(ComponentGroupType *type, const std::set<ComponentTypeId>& components)
+{
+	for (auto& pair : m_filteringCompsToInternalFiltering)
+	{
+		if (std::includes(components.begin(), components.end(), pair.first.begin(), pair.first.end())) // Do any filtering groups use this component group
+		{
+			m_internalFilteringIdToComponentGroup[pair.second].push_back(type); // If so add this group to the unordered filtering group
+		}
+	}
+}
+
 void ComponentManager::DeleteComponentGroup(ComponentGroupId id)
 {
 	m_moveToDisposed.insert(id); // Stage for disposal loop
@@ -155,31 +216,31 @@ void ComponentManager::DeleteComponentGroup(ComponentGroupId id)
 
 void ComponentManager::CopyComponentData(ComponentGroupId dest, ComponentGroupId src, ComponentTypeId compId)
 {
-	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	InternalTypeInfo& info = XEngine::GetInstance().GetECSRegistrar()->GetComponentInfo(compId);
 
-	auto destPair = m_componentGroups[dest];
-	auto srcPair = m_componentGroups[src];
+	auto destPair = GetComponentGroup(dest);
+	auto srcPair = GetComponentGroup(src);
 
-	std::memcpy(destPair.second->CompTypeToAllocator[compId]->GetObjectMemory(destPair.first), // Copy memory to memory
-		srcPair.second->CompTypeToAllocator[compId]->GetObjectMemory(srcPair.first), registrar->GetComponentSize(compId));
+	std::memcpy(destPair.second->Allocators[destPair.second->GetColumn(info.Index)].GetObjectMemory(destPair.first), // Copy memory to memory
+		srcPair.second->Allocators[srcPair.second->GetColumn(info.Index)].GetObjectMemory(srcPair.first), info.Size);
 }
 
 std::vector<UniqueId>& ComponentManager::GetComponentIdsFromComponentGroup(ComponentGroupId componentGroup)
 {
-	return m_componentGroups[componentGroup].second->ComponentTypes;
+	return GetComponentGroup(componentGroup).second->ComponentTypes;
 }
 
 std::vector<Component *> ComponentManager::GetComponentGroupData(ComponentGroupId componentGroup)
 {
 	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
 
-	auto pair = m_componentGroups[componentGroup];
+	auto pair = GetComponentGroup(componentGroup);
 	std::vector<Component *> data(pair.second->ComponentTypes.size()); // Preallocate with size
 
 	for (int32_t i = 0; i < pair.second->ComponentTypes.size(); ++i)
 	{
 		data[i] = Upcast<Component>(pair.second->Allocators[i].GetObjectMemory(pair.first), // Cast from Derived to Component 
-			registrar->GetComponentPointerOffset(pair.second->ComponentTypes[i]));
+			registrar->GetComponentInfoByIndex(pair.second->ComponentIndices[i]).ComponentOffset);
 	}
 
 	return data;
@@ -187,18 +248,20 @@ std::vector<Component *> ComponentManager::GetComponentGroupData(ComponentGroupI
 
 Component *ComponentManager::GetComponentGroupData(ComponentGroupId componentGroup, ComponentTypeId id)
 {
-	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	InternalTypeInfo& info = XEngine::GetInstance().GetECSRegistrar()->GetComponentInfo(id);
 	Component *ret = nullptr;
 
-	auto pair = m_componentGroups[componentGroup];
-	auto movedPair = m_componentGroups[componentGroup];
+	auto pair = GetComponentGroup(componentGroup);
+	int32_t column = pair.second->GetColumn(info.Index);
 
-	if (std::find(pair.second->ComponentTypes.begin(), pair.second->ComponentTypes.end(), id) != pair.second->ComponentTypes.end()) // Is it in the non-moved components
-		ret = Upcast<Component>(pair.second->CompTypeToAllocator[id]->GetObjectMemory(pair.first),
-			registrar->GetComponentPointerOffset(id));
-	else if (std::find(movedPair.second->ComponentTypes.begin(), movedPair.second->ComponentTypes.end(), id) != movedPair.second->ComponentTypes.end()) // Or is it in the moved components
-		ret = Upcast<Component>(movedPair.second->CompTypeToAllocator[id]->GetObjectMemory(movedPair.first),
-			registrar->GetComponentPointerOffset(id));
+	if (column >= 0) // Is it in the non-moved components
+		ret = Upcast<Component>(pair.second->Allocators[column].GetObjectMemory(pair.first), info.ComponentOffset);
+	else
+	{
+		std::pair<MemoryChunkObjectPointer, ComponentGroupType *> moved;
+		if (m_movedComponentGroups.try_get(componentGroup, moved) && (column = moved.second->GetColumn(info.Index)) >= 0) // Or is it in the moved components
+			ret = Upcast<Component>(moved.second->Allocators[column].GetObjectMemory(moved.first), info.ComponentOffset);
+	}
 
 	return ret;
 }
@@ -211,54 +274,241 @@ void ComponentManager::RebuildComponentGroup(ComponentGroupId componentGroup, st
 void ComponentManager::ExecuteSingleThreadOps()
 {
 	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	for (int32_t i = 0; i < m_groupTypes.size(); ++i) // Systems have disposed of last frame's killed rows, they now only wait for compaction
+	{
+		ComponentGroupType *type = m_groupTypes[i];
+		if (type->Dropping) // Rows of a detached cell are not freed one by one, its chunks go at once
+		{
+			DropCellType(type);
+			m_groupTypes.erase(m_groupTypes.begin() + i--);
+			continue;
+		}
+		type->TombstonedRows.insert(type->TombstonedRows.end(), type->KilledRows.begin(), type->KilledRows.end());
+		type->KilledRows.clear();
+		type->KilledMasks.clear();
+	}
+	for (UniqueId id : m_disposed)
+		m_componentGroups.erase(id); // Erase component group from list
+	m_disposed.clear(); // Clear "disposed"
 	for (auto& pair : m_movedComponentGroups) 
 	{
-		auto originalPair = m_componentGroups[pair.first];
-		for (ComponentTypeId comp : pair.second.second->ComponentTypes) // Loop through all components in the original component group
+		auto originalPair = GetComponentGroup(pair.first);
+		ComponentGroupType *destType = pair.second.second;
+		ComponentGroupType *srcType = originalPair.second;
+		if (!srcType) // The cell the entity was in has been dropped since, the new row goes unused
+		{
+			FreeRow(destType, pair.second.first);
+			continue;
+		}
+		for (int32_t i = 0; i < destType->ComponentIndices.size(); ++i) // Loop through all components in the moved component group
 		{
-			std::memcpy(pair.second.second->CompTypeToAllocator[comp]->GetObjectMemory(pair.second.first), // Copy memory from original to moved
-				originalPair.second->CompTypeToAllocator[comp]->GetObjectMemory(originalPair.first), registrar->GetComponentSize(comp));
-			originalPair.second->CompTypeToAllocator[comp]->FreeObject(originalPair.first); // Destroy original component group
+			InternalTypeInfo& info = registrar->GetComponentInfoByIndex(destType->ComponentIndices[i]);
+			int32_t srcColumn = srcType->GetColumn(info.Index);
+			if (srcColumn < 0) // Newly added components keep their fresh state
+				continue;
+
+			void *memory = destType->Allocators[i].GetObjectMemory(pair.second.first);
+			std::memcpy(memory, srcType->Allocators[srcColumn].GetObjectMemory(originalPair.first), info.Size); // Copy memory from original to moved
+			if (info.Buffered) // Overflow memory belongs to the original archetype's arena
+				Upcast<BufferedComponent>(memory, info.BufferOffset)->MoveBufferStore(&destType->OverflowArena);
 		}
+		for (int32_t i = 0; i < srcType->ComponentIndices.size(); ++i)
+		{
+			InternalTypeInfo& info = registrar->GetComponentInfoByIndex(srcType->ComponentIndices[i]);
+			if (info.Buffered && destType->GetColumn(info.Index) < 0) // Removed buffered component
+				Upcast<BufferedComponent>(srcType->Allocators[i].GetObjectMemory(originalPair.first), info.BufferOffset)->DestroyBufferStore();
+		}
+		FreeRow(srcType, originalPair.first); // Destroy original component group
 		m_componentGroups[pair.first] = pair.second;
+		ReleaseOverflowIfEmpty(srcType);
 	}
 	m_movedComponentGroups.clear(); // Clear "to be moved"
-	for (UniqueId id : m_disposed)
+
 	{
-		auto pair = m_componentGroups[id];
-		for (int32_t i = 0; i < pair.second->ComponentTypes.size(); ++i)
+		std::lock_guard lock(m_cellMutex);
+		XEngine::GetInstance().AddBeginMarker("ECS Cell Attach");
+		for (int32_t i = 0; i < m_pendingCells.size(); ++i)
 		{
-			if (registrar->IsComponentBuffered(pair.second->ComponentTypes[i]))
-				Upcast<BufferedComponent>(pair.second->DisposedAllocators[i].GetObjectMemory(pair.first), // Destroy buffer if necessary
-					registrar->GetBufferPointerOffset(pair.second->ComponentTypes[i]))->DestroyBufferStore();
-			pair.second->DisposedAllocators[i].FreeObject(pair.first); // Dispose of the cleaned up object
+			if (!m_pendingCells[i]->IsReady()) // Still building, try again next frame
+				continue;
+			AdoptCell(m_pendingCells[i]);
+			m_pendingCells.erase(m_pendingCells.begin() + i--);
 		}
-		m_componentGroups.unsafe_erase(id); // Erase component group from list
+		for (ComponentGroupType *type : m_detachedCellTypes)
+			KillCellRows(type);
+		m_detachedCellTypes.clear();
+		XEngine::GetInstance().AddEndMarker("ECS Cell Attach");
 	}
-	m_disposed.clear(); // Clear "disposed"
 	for (UniqueId id : m_moveToDisposed)
 	{
-		auto& pair = m_componentGroups[id];
-		MemoryChunkObjectPointer ptr = 0;
-		for (int32_t i = 0; i < pair.second->ComponentTypes.size(); ++i)
+		auto pair = GetComponentGroup(id);
+		ComponentGroupType *type = pair.second;
+		if (!type) // Already erased by a previous kill
+			continue;
+
+		int32_t chunk, row;
+		type->Allocators[0].GetObjectLocation(pair.first, chunk, row);
+		const uint64_t *tombstones = type->GetMask(type->TombstoneMasks, chunk);
+		if (tombstones && (tombstones[row >> 6] >> (row & 63) & 1)) // Killed before, rows of attached cells are found until they are freed
+			continue;
+		SetMaskBit(type->TombstoneMasks, chunk, row, true); // Kill the row in place, live iterators skip it from now on
+		SetMaskBit(type->KilledMasks, chunk, row, true); // Systems see it through their Dispose pass
+
+		type->KilledRows.push_back(pair.first);
+		m_disposed.push_back(id);
+	}
+	m_moveToDisposed.clear(); // Clear "to be disposed"
+
+	XEngine::GetInstance().AddBeginMarker("ECS Compaction");
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(m_compactionBudget));
+	for (int32_t i = 1; i <= m_groupTypes.size(); ++i) // Free disposed rows incrementally, leftovers stay tombstoned until the next frame
+	{
+		int32_t index = (m_compactionCursor + i) % m_groupTypes.size(); // Start after the type that ran out of time last frame, so none of them starves
+		if (!m_groupTypes[index]->Dropping && !CompactTombstones(m_groupTypes[index], deadline))
 		{
-			MemoryChunkAllocator& alloc = pair.second->Allocators[i];
-			MemoryChunkAllocator& dealloc = pair.second->DisposedAllocators[i];
+			m_compactionCursor = index;
+			break;
+		}
+	}
+	XEngine::GetInstance().AddEndMarker("ECS Compaction");
 
-			ptr = dealloc.AllocateObject();
-			// Move the component group to "to be disposed" for systems to clean up and to be deleted later
-			std::memcpy(dealloc.GetObjectMemory(ptr), alloc.GetObjectMemory(pair.first), alloc.GetPerObjectSize());
-			alloc.FreeObject(pair.first); // Delete the object from the regular component groups
+	XEngine::GetInstance().AddBeginMarker("ECS Sort");
+	for (ComponentGroupType *type : m_groupTypes)
+	{
+		if (type->SortKeyColumn >= 0 && !type->Dropping)
+			SortRows(type);
+	}
+	XEngine::GetInstance().AddEndMarker("ECS Sort");
+}
+
+void ComponentManager::AttachCell(WorldCell *cell)
+{
+	std::lock_guard lock(m_cellMutex);
+	m_pendingCells.push_back(cell);
+}
+
+void ComponentManager::DetachCell(WorldCell *cell)
+{
+	std::lock_guard lock(m_cellMutex);
+	auto iter = std::find(m_pendingCells.begin(), m_pendingCells.end(), cell);
+	if (iter != m_pendingCells.end()) // Never made it into the world
+	{
+		m_pendingCells.erase(iter);
+		return;
+	}
+	if (!cell->m_attached)
+		return;
+
+	for (auto& [components, archetype] : cell->m_archetypes) // The types own the chunks by now, nothing refers back to the cell
+		m_detachedCellTypes.push_back(archetype->Type);
+	cell->m_attached = false;
+}
+
+void ComponentManager::AdoptCell(WorldCell *cell)
+{
+	for (auto& [components, archetype] : cell->m_archetypes)
+	{
+		ComponentGroupType *liveType = GetComponentGroupType(components); // Archetypes are created here on the main thread, never by the cell's builder
+		ComponentGroupType *type = new ComponentGroupType;
+		type->ChunkSize = liveType->ChunkSize;
+		type->ComponentTypes = liveType->ComponentTypes;
+		type->ComponentIndices = liveType->ComponentIndices;
+		type->Columns = liveType->Columns;
+		type->SortKeyColumn = liveType->SortKeyColumn; // Sorted among themselves, the cell's rows never mix with other chunks
+		type->SortKeyOffset = liveType->SortKeyOffset;
+		type->Allocators = std::move(archetype->Allocators); // Chunks and the pointer lookup move over as they are
+		type->CellArena = std::move(archetype->OverflowArena);
+		type->CellPointerSpace = archetype->PointerSpace;
+		archetype->Type = type;
+
+		m_groupTypes.push_back(type);
+		m_cellGroupTypes[type->CellPointerSpace] = type; // Stands in for registering every row
+		AddToFilteringGroups(type, components);
+	}
+	cell->m_attached = true;
+}
+
+void ComponentManager::KillCellRows(ComponentGroupType *type)
+{
+	MemoryChunkAllocator& first = type->Allocators[0];
+	int32_t chunkCount = first.GetActiveChunkCount();
+	int32_t words = (m_componentChunkSize + 63) / 64;
+	type->TombstoneMasks.resize(chunkCount);
+	type->KilledMasks.resize(chunkCount);
+	for (int32_t chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		std::vector<uint64_t>& tombstones = type->TombstoneMasks[chunk];
+		std::vector<uint64_t>& killed = type->KilledMasks[chunk];
+		tombstones.resize(words, 0);
+		killed.resize(words, 0);
+		int32_t rows = first.GetAllChunks()[chunk].ObjectCount;
+		for (int32_t word = 0; word * 64 < rows; ++word)
+		{
+			uint64_t used = rows - word * 64 >= 64 ? ~0ull : (1ull << (rows - word * 64)) - 1;
+			killed[word] |= used & ~tombstones[word]; // Rows that died before were disposed of already
+			tombstones[word] |= used;
 		}
-		pair.first = ptr;
-		m_disposed.push_back(id);
 	}
-	m_moveToDisposed.clear(); // Clear "to be disposed"
+	type->Dropping = true;
+}
+
+void ComponentManager::DropCellType(ComponentGroupType *type)
+{
+	m_cellGroupTypes.erase(type->CellPointerSpace);
+	for (auto& [filtering, types] : m_internalFilteringIdToComponentGroup)
+		types.erase(std::remove(types.begin(), types.end(), type), types.end());
+
+	GetAsyncTaskManager()->CreateJob([type]() // Releasing every chunk and the pointer lookup is left to a worker
+		{
+			for (MemoryChunkAllocator& alloc : type->Allocators)
+				alloc.CleanupAllocator();
+			delete type;
+		}, WorkerPriority::Background)->Submit();
+}
+
+void ComponentManager::SetCompactionBudget(float seconds)
+{
+	m_compactionBudget = seconds;
+}
+
+void ComponentManager::SetSortKey(std::set<ComponentTypeId> components, ComponentTypeId keyComponent)
+{
+	InternalTypeInfo& info = XEngine::GetInstance().GetECSRegistrar()->GetComponentInfo(keyComponent);
+	if (info.SortKeyOffset < 0)
+	{
+		XEngine::GetInstance().LogMessage("Component \"" + info.Name + "\" does not derive from SortKeyComponent", LogMessageType::Error);
+		return;
+	}
+
+	components.insert(StaticComponentInfo<EntityIdComponent>::GetIdentifier());
+	components.insert(keyComponent);
+	ComponentGroupType *liveType = GetComponentGroupType(components);
+	for (ComponentGroupType *type : m_groupTypes) // Attached cells of the archetype too
+	{
+		if (type->ComponentTypes != liveType->ComponentTypes)
+			continue;
+		type->SortKeyColumn = type->GetColumn(info.Index);
+		type->SortKeyOffset = info.SortKeyOffset;
+		type->SortKeyChecksums.clear(); // Force a check on the next frame
+	}
 }
 
 std::vector<ComponentTypeId>& ComponentManager::GetComponentTypes(ComponentGroupId id)
 {
-	return m_componentGroups[id].second->ComponentTypes;
+	return GetComponentGroup(id).second->ComponentTypes;
+}
+
+std::pair<MemoryChunkObjectPointer, ComponentGroupType *> ComponentManager::GetComponentGroup(ComponentGroupId id)
+{
+	std::pair<MemoryChunkObjectPointer, ComponentGroupType *> pair(0, nullptr);
+	if (m_componentGroups.try_get(id, pair))
+		return pair;
+
+	MemoryChunkObjectPointer ptr = static_cast<MemoryChunkObjectPointer>(id); // Rows of attached cells are not registered one by one, their ids are their pointers
+	auto iter = m_cellGroupTypes.find(ptr & ChunkPointerSpaceMask);
+	if (iter != m_cellGroupTypes.end() && iter->second->Allocators[0].ContainsObject(ptr))
+		pair = std::make_pair(ptr, iter->second);
+	return pair;
 }
 
 void ComponentManager::AllocCompGroup(std::set<ComponentTypeId> components, bool moved, UniqueId id)
@@ -266,42 +516,312 @@ void ComponentManager::AllocCompGroup(std::set<ComponentTypeId> components, bool
 	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
 	ComponentGroupType *type = GetComponentGroupType(components);
 	MemoryChunkObjectPointer ptr;
-	for (int32_t i = 0; i < type->ComponentTypes.size(); ++i)
+	for (int32_t i = 0; i < type->ComponentIndices.size(); ++i)
 	{
 		ptr = type->Allocators[i].AllocateObject();
 		void *memory = type->Allocators[i].GetObjectMemory(ptr); // Get component memory
 
-		Component *comp = Upcast<Component>(memory, registrar->GetComponentPointerOffset(type->ComponentTypes[i]));
-		ComponentTypeId tid = type->ComponentTypes[i];
-
-		if (registrar->IsComponentBuffered(tid)) // Initialize buffer if necessary
-			Upcast<BufferedComponent>(memory, registrar->GetBufferPointerOffset(tid))->InitializeBufferStore();
+		InternalTypeInfo& info = registrar->GetComponentInfoByIndex(type->ComponentIndices[i]);
+		if (info.Buffered) // Initialize buffer if necessary
+			Upcast<BufferedComponent>(memory, info.BufferOffset)->InitializeBufferStore(&type->OverflowArena, info.BufferElementSize,
+				info.BufferInlineCapacity, info.BufferInlineOffset);
 	}
 
-	UniqueId *idPtr = reinterpret_cast<UniqueId *>(type->CompTypeToAllocator[registrar->GetComponentIdByName("EntityIdComponent")]
-		->GetObjectMemory(ptr));
+	UniqueId *idPtr = reinterpret_cast<UniqueId *>(type->Allocators[type->GetColumn(EntityIdComponentIndex)].GetObjectMemory(ptr));
 	*idPtr = id;
 
 	(moved ? m_movedComponentGroups : m_componentGroups)[id] = std::make_pair(ptr, type);
 }
 
-void BufferedComponent::InitializeBufferStore()
+void ComponentManager::ReleaseOverflowIfEmpty(ComponentGroupType *type)
+{
+	if (type->Allocators[0].GetActiveChunkCount() == 0) // No rows are left that could reference overflow memory, free it in bulk
+	{
+		type->OverflowArena.Reset();
+		type->CellArena.reset();
+	}
+}
+
+bool ComponentManager::CompactTombstones(ComponentGroupType *type, std::chrono::steady_clock::time_point deadline)
+{
+	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	while (!type->TombstonedRows.empty())
+	{
+		if ((type->TombstonedRows.size() & 31) == 0 && std::chrono::steady_clock::now() >= deadline) // Check the clock every 32 rows
+			return false;
+
+		MemoryChunkObjectPointer ptr = type->TombstonedRows.back(); // Pointers follow rows through swaps, so free order does not matter
+		type->TombstonedRows.pop_back();
+		for (int32_t i = 0; i < type->ComponentIndices.size(); ++i)
+		{
+			InternalTypeInfo& info = registrar->GetComponentInfoByIndex(type->ComponentIndices[i]);
+			if (info.Buffered)
+				Upcast<BufferedComponent>(type->Allocators[i].GetObjectMemory(ptr), info.BufferOffset)->DestroyBufferStore(); // Destroy buffer if necessary
+		}
+		FreeRow(type, ptr);
+	}
+
+	if (type->KilledRows.empty())
+		type->TombstoneMasks.clear(); // Every dead row is gone
+	ReleaseOverflowIfEmpty(type);
+	return true;
+}
+
+void ComponentManager::FreeRow(ComponentGroupType *type, MemoryChunkObjectPointer ptr)
+{
+	MemoryChunkAllocator& first = type->Allocators[0];
+	int32_t chunk, row;
+	first.GetObjectLocation(ptr, chunk, row);
+	int32_t lastChunk = first.GetAllChunks()[first.GetActiveChunkCount() - 1].Index;
+	int32_t lastRow = first.GetAllChunks()[lastChunk].ObjectCount - 1;
+
+	const uint64_t *tombstones = type->GetMask(type->TombstoneMasks, lastChunk);
+	const uint64_t *killed = type->GetMask(type->KilledMasks, lastChunk);
+	bool lastTombstoned = tombstones && (tombstones[lastRow >> 6] >> (lastRow & 63) & 1);
+	bool lastKilled = killed && (killed[lastRow >> 6] >> (lastRow & 63) & 1);
+
+	for (MemoryChunkAllocator& alloc : type->Allocators)
+		alloc.FreeObject(ptr); // The last row of the last chunk moves into the hole
+
+	if (chunk != lastChunk || row != lastRow)
+	{
+		SetMaskBit(type->TombstoneMasks, chunk, row, lastTombstoned); // Its state moves with it
+		SetMaskBit(type->KilledMasks, chunk, row, lastKilled);
+	}
+	SetMaskBit(type->TombstoneMasks, lastChunk, lastRow, false); // The vacated slot is handed out again alive
+	SetMaskBit(type->KilledMasks, lastChunk, lastRow, false);
+
+	if (first.GetActiveChunkCount() <= lastChunk) // The last chunk emptied out, drop its masks with it
+	{
+		for (std::vector<std::vector<uint64_t>> *masks : { &type->TombstoneMasks, &type->KilledMasks })
+		{
+			if (masks->size() > lastChunk)
+				masks->resize(lastChunk);
+		}
+	}
+}
+
+void ComponentManager::SetMaskBit(std::vector<std::vector<uint64_t>>& masks, int32_t chunk, int32_t row, bool value)
 {
-	m_holder = nullptr;
+	if (masks.size() <= chunk)
+	{
+		if (!value)
+			return;
+		masks.resize(chunk + 1);
+	}
+	std::vector<uint64_t>& mask = masks[chunk];
+	if (mask.empty())
+	{
+		if (!value)
+			return;
+		mask.resize((m_componentChunkSize + 63) / 64, 0);
+	}
+
+	if (value)
+		mask[row >> 6] |= 1ull << (row & 63);
+	else
+		mask[row >> 6] &= ~(1ull << (row & 63));
+}
+
+bool ComponentManager::UpdateSortKeyChecksums(ComponentGroupType *type, std::vector<char>& dirty)
+{
+	MemoryChunkAllocator& keyAlloc = type->Allocators[type->SortKeyColumn];
+	int32_t chunkCount = keyAlloc.GetActiveChunkCount();
+	int32_t stride = keyAlloc.GetPerObjectSize();
+
+	type->SortKeyChecksums.resize(chunkCount, 0);
+	dirty.assign(chunkCount, 0);
+	std::vector<int32_t> chunks(chunkCount);
+	std::iota(chunks.begin(), chunks.end(), 0);
+	std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](int32_t chunk) // Chunks hash independently
+	{
+		MemoryChunk& memChunk = keyAlloc.GetAllChunks()[chunk];
+		const char *memory = reinterpret_cast<const char *>(memChunk.Memory) + type->SortKeyOffset;
+		uint64_t checksum = memChunk.ObjectCount;
+		for (int32_t row = 0; row < memChunk.ObjectCount; ++row)
+			checksum = (checksum ^ *reinterpret_cast<const uint64_t *>(memory + row * stride)) * 1099511628211ull;
+		if (type->SortKeyChecksums[chunk] != checksum) // Only chunks whose keys or row count changed can break the order
+		{
+			type->SortKeyChecksums[chunk] = checksum;
+			dirty[chunk] = 1;
+		}
+	});
+	return std::find(dirty.begin(), dirty.end(), 1) != dirty.end();
+}
+
+void ComponentManager::RadixSortRows(std::vector<uint64_t>& keys, std::vector<int32_t>& rows)
+{
+	int32_t count = keys.size();
+	int32_t blockCount = (count + SortBlockSize - 1) / SortBlockSize;
+	std::vector<uint64_t> tempKeys(count);
+	std::vector<int32_t> tempRows(count);
+	std::vector<std::array<int32_t, 256>> offsets(blockCount);
+	std::vector<int32_t> blocks(blockCount);
+	std::iota(blocks.begin(), blocks.end(), 0);
+	for (int32_t shift = 0; shift < 64 && count > 1; shift += 8) // LSD radix sort, one byte of key per pass
+	{
+		std::for_each(std::execution::par, blocks.begin(), blocks.end(), [&](int32_t block) // Histogram every block at once
+		{
+			std::array<int32_t, 256>& histogram = offsets[block];
+			histogram.fill(0);
+			int32_t end = std::min(count, (block + 1) * SortBlockSize);
+			for (int32_t i = block * SortBlockSize; i < end; ++i)
+				++histogram[(keys[i] >> shift) & 255];
+		});
+
+		int32_t firstDigit = (keys[0] >> shift) & 255;
+		int32_t firstDigitCount = 0;
+		for (std::array<int32_t, 256>& histogram : offsets)
+			firstDigitCount += histogram[firstDigit];
+		if (firstDigitCount == count) // Every key shares this byte
+			continue;
+
+		for (int32_t digit = 0, sum = 0; digit < 256; ++digit) // Each block scatters after the same digit of every earlier block, keeping the sort stable
+		{
+			for (std::array<int32_t, 256>& histogram : offsets)
+			{
+				int32_t digitCount = histogram[digit];
+				histogram[digit] = sum;
+				sum += digitCount;
+			}
+		}
+		std::for_each(std::execution::par, blocks.begin(), blocks.end(), [&](int32_t block)
+		{
+			std::array<int32_t, 256>& histogram = offsets[block];
+			int32_t end = std::min(count, (block + 1) * SortBlockSize);
+			for (int32_t i = block * SortBlockSize; i < end; ++i)
+			{
+				int32_t dest = histogram[(keys[i] >> shift) & 255]++;
+				tempKeys[dest] = keys[i];
+				tempRows[dest] = rows[i];
+			}
+		});
+		keys.swap(tempKeys);
+		rows.swap(tempRows);
+	}
+}
+
+void ComponentManager::SortRows(ComponentGroupType *type)
+{
+	std::vector<char> dirty;
+	if (!UpdateSortKeyChecksums(type, dirty)) // No key changed since the last sort
+		return;
+
+	MemoryChunkAllocator& keyAlloc = type->Allocators[type->SortKeyColumn];
+	int32_t stride = keyAlloc.GetPerObjectSize();
+	std::vector<uint64_t> cleanKeys, dirtyKeys;
+	std::vector<int32_t> cleanRows, dirtyRows;
+	for (int32_t chunk = 0; chunk < dirty.size(); ++chunk) // Unchanged chunks still hold their rows of the last sorted order, only changed chunks need sorting
+	{
+		MemoryChunk& memChunk = keyAlloc.GetAllChunks()[chunk];
+		const char *memory = reinterpret_cast<const char *>(memChunk.Memory) + type->SortKeyOffset;
+		std::vector<uint64_t>& keys = dirty[chunk] ? dirtyKeys : cleanKeys;
+		std::vector<int32_t>& rows = dirty[chunk] ? dirtyRows : cleanRows;
+		for (int32_t row = 0; row < memChunk.ObjectCount; ++row)
+		{
+			keys.push_back(*reinterpret_cast<const uint64_t *>(memory + row * stride));
+			rows.push_back(chunk * m_componentChunkSize + row);
+		}
+	}
+	RadixSortRows(dirtyKeys, dirtyRows);
+
+	int32_t count = cleanRows.size() + dirtyRows.size();
+	std::vector<int32_t> order(count);
+	bool moved = false;
+	for (int32_t i = 0, clean = 0, changed = 0; i < count; ++i) // Merge the sorted changes into the sorted remainder
+	{
+		bool takeChanged = clean == cleanRows.size() || (changed < dirtyRows.size() && dirtyKeys[changed] < cleanKeys[clean]);
+		order[i] = takeChanged ? dirtyRows[changed++] : cleanRows[clean++];
+		moved |= order[i] != i;
+	}
+	if (!moved) // The changes kept the order
+		return;
+
+	std::for_each(std::execution::par, type->Allocators.begin(), type->Allocators.end(), // Columns are independent, permute them in parallel
+		[&order](MemoryChunkAllocator& alloc) { alloc.PermuteObjects(order); });
+
+	for (std::vector<std::vector<uint64_t>> *masks : { &type->TombstoneMasks, &type->KilledMasks }) // Dead rows keep their state through the move
+	{
+		if (masks->empty())
+			continue;
+		std::vector<std::vector<uint64_t>> oldMasks;
+		oldMasks.swap(*masks);
+		for (int32_t i = 0; i < count; ++i)
+		{
+			int32_t src = order[i];
+			int32_t srcChunk = src / m_componentChunkSize;
+			int32_t srcRow = src % m_componentChunkSize;
+			if (srcChunk < oldMasks.size() && !oldMasks[srcChunk].empty() && (oldMasks[srcChunk][srcRow >> 6] >> (srcRow & 63) & 1))
+				SetMaskBit(*masks, i / m_componentChunkSize, i % m_componentChunkSize, true);
+		}
+	}
+
+	UpdateSortKeyChecksums(type, dirty); // Chunks the permutation wrote to hash differently now
+}
+
+void BufferedComponent::InitializeBufferStore(ArenaAllocator *arena, int32_t elementSize, int32_t inlineCapacity, int32_t inlineOffset)
+{
+	m_arena = arena;
+	m_overflow = nullptr;
+	m_count = 0;
+	m_capacity = inlineCapacity;
+	m_elementSize = elementSize;
+	m_inlineOffset = inlineOffset;
 }
 
 void BufferedComponent::DestroyBufferStore()
 {
-	if (m_holder)
-		delete m_holder;
+	if (m_overflow)
+		m_arena->Free(m_overflow, m_capacity * m_elementSize);
+	m_overflow = nullptr;
+	m_count = 0;
+	m_capacity = 0;
+}
+
+void BufferedComponent::MoveBufferStore(ArenaAllocator *arena)
+{
+	if (m_arena == arena)
+		return;
+	if (m_overflow)
+	{
+		void *memory = arena->Allocate(m_capacity * m_elementSize);
+		std::memcpy(memory, m_overflow, m_count * m_elementSize);
+		m_arena->Free(m_overflow, m_capacity * m_elementSize);
+		m_overflow = memory;
+	}
+	m_arena = arena;
 }
 
 void *BufferedComponent::GetRawBufferData()
 {
-	return m_holder->GetMemory();
+	return m_overflow ? m_overflow : reinterpret_cast<char *>(this) + m_inlineOffset;
+}
+
+void BufferedComponent::SetRawBufferData(const void *data, int32_t count)
+{
+	std::memcpy(ReserveBufferStore(count), data, count * m_elementSize);
+	m_count = count;
 }
 
 int32_t BufferedComponent::GetTotalBufferSize()
 {
-	return m_holder->GetTotalSize();
+	return m_count * m_elementSize;
+}
+
+void *BufferedComponent::ReserveBufferStore(int32_t count)
+{
+	if (count > m_capacity) // Inline storage or current overflow is too small
+	{
+		int32_t capacity = std::max(count, m_capacity * 2);
+		capacity = m_arena->GetSizeClassBytes(capacity * m_elementSize) / m_elementSize; // Use the whole size class
+
+		void *memory = m_arena->Allocate(capacity * m_elementSize);
+		std::memcpy(memory, GetRawBufferData(), m_count * m_elementSize);
+		if (m_overflow)
+			m_arena->Free(m_overflow, m_capacity * m_elementSize);
+
+		m_overflow = memory;
+		m_capacity = capacity;
+	}
+	return GetRawBufferData();
 }
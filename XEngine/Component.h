@@ -6,23 +6,18 @@
 #include <unordered_map>
 #include <typeinfo>
 #include <set>
+#include <string_view>
+#include <chrono>
+#include <memory>
 
 #include "UUID.h"
 #include "ChunkAllocator.h"
+#include "ArenaAllocator.h"
+#include "FrameArena.h"
+#include "ConcurrentHashMap.h"
 
 #include <mutex>
 
-#include <concurrent_vector.h>
-#include <concurrent_unordered_map.h>
-#include <concurrent_unordered_set.h>
-
-class BufferedComponentHolder
-{
-public:
-	virtual ~BufferedComponentHolder() = 0;
-	virtual void *GetMemory() = 0;
-	virtual int32_t GetTotalSize() = 0;
-};
 
 class Component
 {
@@ -35,63 +30,104 @@ public:
 	UniqueId EntityId;
 };
 
-template<class T>
-class TypedBufferHolder : public BufferedComponentHolder
+constexpr int32_t EntityIdComponentIndex = 0; // EntityIdComponent is registered first by every ECSRegistrar
+
+class SortKeyComponent : public Component
 {
 public:
-	virtual ~TypedBufferHolder() {}
-
-	virtual void *GetMemory() override
-	{
-		return m_vec.data();
-	}
-
-	virtual int32_t GetTotalSize() override
-	{
-		return sizeof(T) * m_vec.size();
-	}
-
-	std::vector<T>& GetVector()
-	{
-		return m_vec;
-	}
-private:
-	std::vector<T> m_vec;
+	uint64_t SortKey; // Rows of archetypes sorted by this component are kept in ascending key order
 };
 
+constexpr int32_t SortBlockSize = 16384; // Rows each task histograms and scatters during a parallel radix sort pass
+
 class BufferedComponent : public Component
 {
 public:
-	void InitializeBufferStore();
+	void InitializeBufferStore(ArenaAllocator *arena, int32_t elementSize, int32_t inlineCapacity, int32_t inlineOffset);
 	void DestroyBufferStore();
+	void MoveBufferStore(ArenaAllocator *arena); // Move overflow memory into another archetype's arena
 	void *GetRawBufferData();
 	int32_t GetTotalBufferSize();
+	void SetRawBufferData(const void *data, int32_t count); // Replace the buffer contents with count elements
 protected:
-	BufferedComponentHolder *m_holder;
+	void *ReserveBufferStore(int32_t count); // Grow into the arena once the inline storage is exceeded
+
+	ArenaAllocator *m_arena;
+	void *m_overflow;
+	int32_t m_count;
+	int32_t m_capacity;
+	int32_t m_elementSize;
+	int32_t m_inlineOffset;
 };
 
-template<class T>
+template<class T, int32_t N = 8>
 class TypedBufferedComponent : public BufferedComponent
 {
 public:
-	std::vector<T>& GetVector() // Lazy initialize to prevent usage of vftable through inheritance
+	static_assert(std::is_trivially_copyable<T>::value, "Buffered component elements are moved with memcpy");
+
+	using ElementType = T;
+	static constexpr int32_t InlineCapacity = N;
+
+	T *GetData() { return reinterpret_cast<T *>(GetRawBufferData()); }
+	int32_t GetCount() { return m_count; }
+	T& operator[](int32_t index) { return GetData()[index]; }
+	T *begin() { return GetData(); }
+	T *end() { return GetData() + m_count; }
+
+	void Reserve(int32_t count) { ReserveBufferStore(count); }
+	void Resize(int32_t count) { ReserveBufferStore(count); m_count = count; }
+	void PushBack(const T& value) { reinterpret_cast<T *>(ReserveBufferStore(m_count + 1))[m_count++] = value; }
+	void PopBack() { --m_count; }
+	void Clear() { m_count = 0; }
+
+	static int32_t GetInlineStorageOffset()
 	{
-		TypedBufferHolder<T> *typed;
-		if (m_holder)
-			typed = dynamic_cast<TypedBufferHolder<T>>(m_holder);
-		else
-			m_holder = typed = new TypedBufferHolder<T>();
-		return typed->GetVector();
+		TypedBufferedComponent *derived = reinterpret_cast<TypedBufferedComponent *>(64);
+		BufferedComponent *base = static_cast<BufferedComponent *>(derived);
+		return reinterpret_cast<char *>(derived->m_inline) - reinterpret_cast<char *>(base);
 	}
+private:
+	alignas(T) char m_inline[sizeof(T) * N]; // Inline storage kept in the chunk column
 };
 
+constexpr UniqueId HashComponentName(std::string_view name) // FNV-1a, usable at compile time
+{
+	UniqueId hash = 14695981039346656037ull;
+	for (char c : name)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+template<class T>
+constexpr std::string_view GetCompileTimeTypeName()
+{
+#ifdef _MSC_VER
+	std::string_view signature = __FUNCSIG__; // "... GetCompileTimeTypeName<class Name>(void)"
+	std::string_view name = signature.substr(signature.find("GetCompileTimeTypeName<") + 23);
+	name = name.substr(0, name.rfind(">(void)"));
+#else
+	std::string_view signature = __PRETTY_FUNCTION__; // "... GetCompileTimeTypeName() [with T = Name; ...]"
+	std::string_view name = signature.substr(signature.find("T = ") + 4);
+	name = name.substr(0, name.find_first_of(";]"));
+#endif
+	if (name.substr(0, 6) == "class ")
+		name.remove_prefix(6);
+	else if (name.substr(0, 7) == "struct ")
+		name.remove_prefix(7);
+	return name;
+}
+
 template<class T>
 class StaticComponentInfo
 {
 public:
-	static constexpr const char *GetName()
+	static constexpr std::string_view GetName()
 	{
-		return typeid(T).name() + 6;
+		return GetCompileTimeTypeName<T>();
 	}
 	static constexpr int32_t GetSize()
 	{
@@ -99,7 +135,7 @@ public:
 	}
 	static constexpr UniqueId GetIdentifier()
 	{
-		return std::hash<std::string>()(GetName());
+		return HashComponentName(GetName());
 	}
 	static constexpr bool IsBuffered()
 	{
@@ -130,30 +166,87 @@ public:
 		
 		return diff1 + diff2;
 	}
+	static constexpr int32_t GetElementSize()
+	{
+		return sizeof(typename T::ElementType);
+	}
+	static constexpr int32_t GetInlineCapacity()
+	{
+		return T::InlineCapacity;
+	}
+	static int32_t GetInlineStorageOffset()
+	{
+		return T::GetInlineStorageOffset();
+	}
+};
+
+using ComponentTypeId = UniqueId;
+
+template<class T>
+class SortKeyComponentInfo
+{
+public:
+	static constexpr int32_t GetSortKeyOffset()
+	{
+		T *derived = reinterpret_cast<T *>(64);
+		SortKeyComponent *base = static_cast<SortKeyComponent *>(derived);
+		return reinterpret_cast<char *>(&base->SortKey) - reinterpret_cast<char *>(derived);
+	}
 };
 
 class ComponentGroupType
 {
 public:
 	int32_t ChunkSize;
-	std::unordered_map<UniqueId, MemoryChunkAllocator *> CompTypeToAllocator;
-	std::unordered_map<UniqueId, MemoryChunkAllocator *> CompTypeToDisposedAllocator;
 
 	std::vector<MemoryChunkAllocator> Allocators;
-	std::vector<MemoryChunkAllocator> DisposedAllocators;
+
+	std::vector<std::vector<uint64_t>> TombstoneMasks; // Per chunk, one bit per row that is no longer alive, empty if the chunk has none
+	std::vector<std::vector<uint64_t>> KilledMasks; // Per chunk, one bit per row killed last frame that systems still have to dispose of
+	std::vector<MemoryChunkObjectPointer> KilledRows; // Rows awaiting the Dispose pass
+	std::vector<MemoryChunkObjectPointer> TombstonedRows; // Disposed rows awaiting compaction
 
 	std::vector<UniqueId> ComponentTypes;
+	std::vector<int32_t> ComponentIndices; // Dense component index of each column
+	std::vector<int32_t> Columns; // Column of each dense component index, -1 if this type does not have it
+
+	ArenaAllocator OverflowArena; // Buffered component storage that does not fit inline
+	std::unique_ptr<ArenaAllocator> CellArena; // Overflow storage an attached cell was built with, its rows keep pointing into it
+
+	MemoryChunkObjectPointer CellPointerSpace = 0; // Pointers of an attached cell's rows, which are also their ids, 0 for the archetype new rows go to
+	bool Dropping = false; // The cell was detached and all its rows killed, its chunks go as a whole once systems disposed of them
+
+	int32_t SortKeyColumn = -1; // Column rows are ordered by, -1 if the rows keep allocation order
+	int32_t SortKeyOffset = 0; // Offset of the key within an object of that column
+	std::vector<uint64_t> SortKeyChecksums; // Per chunk, hash of the key column when it was last known to be sorted
+
+	inline int32_t GetColumn(int32_t componentIndex) { return componentIndex < Columns.size() ? Columns[componentIndex] : -1; }
+	inline const uint64_t *GetMask(std::vector<std::vector<uint64_t>>& masks, int32_t chunk) { return chunk < masks.size() && !masks[chunk].empty() ? masks[chunk].data() : nullptr; }
+};
+
+class ComponentRowTemplate
+{
+public:
+	std::set<ComponentTypeId> Components; // Components of the archetype, always containing EntityIdComponent
+	std::vector<int32_t> ComponentIndices; // Dense index of each column, resolved once when the columns are set
+	std::vector<char> RowImage; // Default value of every column, laid out in the column order of Components
+	std::vector<int32_t> ColumnOffsets; // Offset of each column within RowImage
+	std::vector<std::vector<char>> BufferData; // Initial elements of each buffered column, empty otherwise
 };
 
 class ComponentDataIterator
 {
 public:
-	ComponentDataIterator(std::vector<int32_t> sizes, std::vector<void *> memoryBlocks, int32_t first, int32_t count)
-		: m_sizes(sizes), m_memoryBlocks(memoryBlocks), m_first(first), m_count(count), m_curComps(sizes.size()) { }
+	ComponentDataIterator(FrameVector<int32_t> sizes, FrameVector<void *> memoryBlocks, int32_t first, int32_t count,
+		const uint64_t *tombstones = nullptr, bool disposed = false)
+		: m_sizes(std::move(sizes)), m_memoryBlocks(std::move(memoryBlocks)), m_first(first), m_count(count), m_curComps(m_sizes.size()),
+		m_tombstones(tombstones), m_disposed(disposed) { }
 
 	template<class T>
 	T *Next()
 	{
+		while (m_first + m_index < m_count && IsTombstoned(m_first + m_index) != m_disposed) // Live iterators skip killed rows, disposed iterators visit only them
+			++m_index;
 		if (m_first + m_index >= m_count)
 			return nullptr;
 		AcquireNext();
@@ -177,12 +270,19 @@ public:
 		return m_count;
 	}
 
+	bool IsTombstoned(int32_t row) // Rows accessed through GetAllMemory must be checked manually
+	{
+		return m_tombstones && (m_tombstones[row >> 6] >> (row & 63) & 1);
+	}
+
 	void *UserPointer = nullptr;
 	bool UserFlag = false;
 private:
-	std::vector<int32_t> m_sizes;
-	std::vector<void *> m_memoryBlocks;
-	std::vector<void *> m_curComps;
+	FrameVector<int32_t> m_sizes; // Iterators only live for the frame, so their arrays come from the frame arena
+	FrameVector<void *> m_memoryBlocks;
+	FrameVector<void *> m_curComps;
+	const uint64_t *m_tombstones;
+	bool m_disposed;
 	int32_t m_index = 0;
 	int32_t m_first;
 	int32_t m_count;
@@ -196,9 +296,9 @@ private:
 
 using FilteringGroupId = UniqueId;
 using ComponentGroupId = UniqueId;
-using ComponentTypeId = UniqueId;
 
 class Scene;
+class WorldCell;
 class ComponentManager
 {
 public:
@@ -208,6 +308,11 @@ public:
 	XENGINEAPI FilteringGroupId AddFilteringGroup(std::vector<ComponentTypeId> components);
 	XENGINEAPI std::vector<ComponentDataIterator> *GetFilteringGroup(FilteringGroupId filteringGroup, bool disposed);
 	XENGINEAPI ComponentGroupId AllocateComponentGroup(std::set<ComponentTypeId> components);
+	XENGINEAPI void InstantiateComponentGroups(ComponentRowTemplate& rowTemplate, int32_t count, ComponentGroupId *ids); // Allocate count rows at once, copying the template row into each
+	XENGINEAPI void StampRows(const std::vector<int32_t>& componentIndices, std::vector<MemoryChunkAllocator>& allocators, ArenaAllocator *arena,
+		ComponentRowTemplate& rowTemplate, int32_t count, ComponentGroupId *ids, MemoryChunkObjectPointer *ptrs, bool pointerIds = false); // Fill rows of allocators whose columns hold componentIndices, ids are the row pointers if asked
+	XENGINEAPI void AttachCell(WorldCell *cell); // The cell's chunks join the live world whole at the next sync point once it is ready
+	XENGINEAPI void DetachCell(WorldCell *cell); // Kill every entity still in the cell's chunks at the next sync point, then drop the chunks, the cell can be destroyed right away
 	XENGINEAPI ComponentGroupType *GetComponentGroupType(std::set<ComponentTypeId> components);
 	XENGINEAPI void DeleteComponentGroup(ComponentGroupId id);
 	XENGINEAPI void CopyComponentData(ComponentGroupId dest, ComponentGroupId src, ComponentTypeId compId);
@@ -216,7 +321,10 @@ public:
 	XENGINEAPI Component *GetComponentGroupData(ComponentGroupId componentGroup, ComponentTypeId id);
 	XENGINEAPI void RebuildComponentGroup(ComponentGroupId componentGroup, std::set<ComponentTypeId> components);
 	XENGINEAPI void ExecuteSingleThreadOps(); // Operations to be executed on one thread after no operations are done to components
+	XENGINEAPI void SetCompactionBudget(float seconds); // Time per frame spent freeing disposed rows
+	XENGINEAPI void SetSortKey(std::set<ComponentTypeId> components, ComponentTypeId keyComponent); // Keep the archetype's rows ordered by a SortKeyComponent
 	XENGINEAPI std::vector<ComponentTypeId>& GetComponentTypes(ComponentGroupId id);
+	inline int32_t GetChunkSize() { return m_componentChunkSize; }
 
 	template<class T>
 	T *Upcast(void *memory, int32_t offset)
@@ -225,24 +333,44 @@ public:
 	}
 private:
 	void AllocCompGroup(std::set<ComponentTypeId> components, bool moved, UniqueId id);
+	std::pair<MemoryChunkObjectPointer, ComponentGroupType *> GetComponentGroup(ComponentGroupId id); // Null type if the id is unknown
+	void AddToFilteringGroups(ComponentGroupType *type, const std::set<ComponentTypeId>& components);
+	void AdoptCell(WorldCell *cell); // One type per archetype of the cell, taking over its chunks without touching a row
+	void KillCellRows(ComponentGroupType *type); // Tombstone every row of a detached cell, a mask word at a time
+	void DropCellType(ComponentGroupType *type);
+	void ReleaseOverflowIfEmpty(ComponentGroupType *type);
+	bool CompactTombstones(ComponentGroupType *type, std::chrono::steady_clock::time_point deadline); // Free disposed rows until the deadline, true if all were freed
+	void FreeRow(ComponentGroupType *type, MemoryChunkObjectPointer ptr); // Free a row in every column, keeping the masks in step with the swapped row
+	void SetMaskBit(std::vector<std::vector<uint64_t>>& masks, int32_t chunk, int32_t row, bool value);
+	bool UpdateSortKeyChecksums(ComponentGroupType *type, std::vector<char>& dirty); // Flag the chunks whose keys changed since the last sort, true if any did
+	void RadixSortRows(std::vector<uint64_t>& keys, std::vector<int32_t>& rows); // Sort rows by key, histogramming and scattering blocks of rows in parallel
+	void SortRows(ComponentGroupType *type); // Merge the rows of changed chunks back into the key order of every column
 	Scene *m_scene;
 
 	int32_t m_componentChunkSize;
-	int32_t m_componentDisposedChunkSize;
+	float m_compactionBudget;
+	int32_t m_compactionCursor = 0; // Index in m_groupTypes compaction last stopped at for lack of time
 
 	std::map<std::vector<ComponentTypeId>, UniqueId> m_filteringToId; // Map from the ordered filtering groups to their ids
 	std::map<UniqueId, std::vector<ComponentTypeId>> m_idToFiltering; // Map from a filtering group id to its ordered components list
+	std::map<UniqueId, std::vector<int32_t>> m_idToFilteringIndices; // Map from a filtering group id to its ordered dense component indices
 	std::map<UniqueId, UniqueId> m_filteringIdToInternalId; // Map from an ordered filtering group id to its unordered equivalent's id
 
 	std::map<std::set<ComponentTypeId>, UniqueId> m_filteringCompsToInternalFiltering; // Map from a set of components to an unordered filtering id
 	std::map<std::set<ComponentTypeId>, ComponentGroupType *> m_componentGroupTypes; // Map from a set of components to a matching component group type
 	std::unordered_map<UniqueId, std::vector<ComponentGroupType *>> m_internalFilteringIdToComponentGroup; // Map from an unordered filtering group to a list of component group types
+	std::vector<ComponentGroupType *> m_groupTypes; // Every component group type, attached cells' included
+	std::unordered_map<MemoryChunkObjectPointer, ComponentGroupType *> m_cellGroupTypes; // Map from the pointer space of an attached cell archetype to the type holding its rows
 
 	std::mutex compGroupTypeAddMutex;
 
-	concurrency::concurrent_unordered_map<UniqueId, std::pair<MemoryChunkObjectPointer, ComponentGroupType *>> m_componentGroups; // Map from a component group id to its pointer and component group type
-	concurrency::concurrent_unordered_map<UniqueId, std::pair<MemoryChunkObjectPointer, ComponentGroupType *>> m_movedComponentGroups; // Map from a component group about to be moved id to its pointer and component group type
+	std::mutex m_cellMutex;
+	std::vector<WorldCell *> m_pendingCells; // Cells waiting for their background build to finish
+	std::vector<ComponentGroupType *> m_detachedCellTypes; // Types of detached cells whose rows are killed at the next sync point
+
+	ConcurrentHashMap<UniqueId, std::pair<MemoryChunkObjectPointer, ComponentGroupType *>> m_componentGroups; // Map from a component group id to its pointer and component group type
+	ConcurrentHashMap<UniqueId, std::pair<MemoryChunkObjectPointer, ComponentGroupType *>> m_movedComponentGroups; // Map from a component group about to be moved id to its pointer and component group type
 
-	concurrency::concurrent_unordered_set<UniqueId> m_moveToDisposed; // Components about to be disposed by systems
-	std::vector<UniqueId> m_disposed; // Components to be disposed by deallocators
+	ConcurrentHashSet<UniqueId> m_moveToDisposed; // Components about to be disposed by systems
+	std::vector<UniqueId> m_disposed; // Tombstoned component groups to be erased at the next compaction
 };
@@ -0,0 +1,168 @@
+#pragma once
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include "ConcurrentQueue.h"
+
+constexpr int32_t ConcurrentHashShardBits = 5;
+constexpr int32_t ConcurrentHashShardCount = 1 << ConcurrentHashShardBits;
+
+template<class Table>
+class alignas(CacheLineSize) ConcurrentHashShard
+{
+public:
+	std::shared_mutex Mutex; // Lookups share it, inserts and erases take it exclusively
+	Table Entries;
+};
+
+template<class Table>
+class ConcurrentHashIterator // Walks the shards in order, only valid while nothing is inserted or erased
+{
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = typename Table::value_type;
+	using difference_type = std::ptrdiff_t;
+	using pointer = typename std::iterator_traits<typename Table::iterator>::pointer;
+	using reference = typename std::iterator_traits<typename Table::iterator>::reference;
+
+	ConcurrentHashIterator(ConcurrentHashShard<Table> *shards, int32_t shard, typename Table::iterator entry) : m_shards(shards), m_shard(shard), m_entry(entry)
+	{
+		SkipEmpty();
+	}
+
+	reference operator*() const { return *m_entry; }
+	pointer operator->() const { return &*m_entry; }
+	ConcurrentHashIterator& operator++()
+	{
+		++m_entry;
+		SkipEmpty();
+		return *this;
+	}
+	bool operator==(const ConcurrentHashIterator& other) const { return m_shard == other.m_shard && m_entry == other.m_entry; }
+	bool operator!=(const ConcurrentHashIterator& other) const { return !(*this == other); }
+private:
+	void SkipEmpty()
+	{
+		while (m_entry == m_shards[m_shard].Entries.end() && m_shard + 1 < ConcurrentHashShardCount)
+			m_entry = m_shards[++m_shard].Entries.begin();
+	}
+
+	ConcurrentHashShard<Table> *m_shards;
+	int32_t m_shard;
+	typename Table::iterator m_entry;
+};
+
+template<class Key, class Table, class Hash>
+class ConcurrentHashTable // Keys are spread over independently locked shards, so threads only contend when they hit the same shard
+{
+public:
+	using iterator = ConcurrentHashIterator<Table>;
+
+	size_t erase(const Key& key) // References to the erased value must not be in use on other threads
+	{
+		ConcurrentHashShard<Table>& shard = GetShard(key);
+		std::lock_guard lock(shard.Mutex);
+		return shard.Entries.erase(key);
+	}
+	bool contains(const Key& key)
+	{
+		ConcurrentHashShard<Table>& shard = GetShard(key);
+		std::shared_lock lock(shard.Mutex);
+		return shard.Entries.find(key) != shard.Entries.end();
+	}
+	size_t size()
+	{
+		size_t count = 0;
+		for (ConcurrentHashShard<Table>& shard : m_shards)
+		{
+			std::shared_lock lock(shard.Mutex);
+			count += shard.Entries.size();
+		}
+		return count;
+	}
+	void clear()
+	{
+		for (ConcurrentHashShard<Table>& shard : m_shards)
+		{
+			std::lock_guard lock(shard.Mutex);
+			shard.Entries.clear();
+		}
+	}
+
+	iterator begin() { return iterator(m_shards, 0, m_shards[0].Entries.begin()); } // Iteration takes no locks, use it between parallel phases
+	iterator end() { return iterator(m_shards, ConcurrentHashShardCount - 1, m_shards[ConcurrentHashShardCount - 1].Entries.end()); }
+protected:
+	int32_t GetShardIndex(const Key& key)
+	{
+		uint64_t hash = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull; // Integer keys often hash to themselves, mix them before taking the top bits
+		return hash >> (64 - ConcurrentHashShardBits);
+	}
+	ConcurrentHashShard<Table>& GetShard(const Key& key)
+	{
+		return m_shards[GetShardIndex(key)];
+	}
+
+	ConcurrentHashShard<Table> m_shards[ConcurrentHashShardCount];
+};
+
+template<class Key, class Value, class Hash = std::hash<Key>>
+class ConcurrentHashMap : public ConcurrentHashTable<Key, std::unordered_map<Key, Value, Hash>, Hash>
+{
+public:
+	Value& operator[](const Key& key) // Inserts a default value if missing, the reference stays valid until the key is erased
+	{
+		auto& shard = this->GetShard(key);
+		{
+			std::shared_lock lock(shard.Mutex); // Most calls find an existing key
+			auto iter = shard.Entries.find(key);
+			if (iter != shard.Entries.end())
+				return iter->second;
+		}
+		std::lock_guard lock(shard.Mutex);
+		return shard.Entries[key];
+	}
+	bool try_get(const Key& key, Value& value) // Copies the value out under the shard lock
+	{
+		auto& shard = this->GetShard(key);
+		std::shared_lock lock(shard.Mutex);
+		auto iter = shard.Entries.find(key);
+		if (iter == shard.Entries.end())
+			return false;
+		value = iter->second;
+		return true;
+	}
+	template<class Iter, class Transform>
+	void insert_or_assign(Iter first, Iter last, Transform valueOf) // Set iter->first to valueOf(*iter) for a whole range, locking and growing each shard once
+	{
+		std::vector<Iter> shardEntries[ConcurrentHashShardCount];
+		for (Iter iter = first; iter != last; ++iter)
+			shardEntries[this->GetShardIndex(iter->first)].push_back(iter);
+		for (int32_t i = 0; i < ConcurrentHashShardCount; ++i)
+		{
+			if (shardEntries[i].empty())
+				continue;
+			auto& shard = this->m_shards[i];
+			std::lock_guard lock(shard.Mutex);
+			shard.Entries.reserve(shard.Entries.size() + shardEntries[i].size());
+			for (Iter iter : shardEntries[i])
+				shard.Entries.insert_or_assign(iter->first, valueOf(*iter));
+		}
+	}
+};
+
+template<class Key, class Hash = std::hash<Key>>
+class ConcurrentHashSet : public ConcurrentHashTable<Key, std::unordered_set<Key, Hash>, Hash>
+{
+public:
+	bool insert(const Key& key) // False if the key was already present
+	{
+		auto& shard = this->GetShard(key);
+		std::lock_guard lock(shard.Mutex);
+		return shard.Entries.insert(key).second;
+	}
+};
@@ -0,0 +1,282 @@
+#pragma once
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t CacheLineSize = 64; // Indices written by different threads are kept on separate lines
+
+template<class T>
+class ConcurrentQueueCell
+{
+public:
+	std::atomic<size_t> Sequence;
+	alignas(T) unsigned char Storage[sizeof(T)];
+
+	T *GetValue() { return std::launder(reinterpret_cast<T *>(Storage)); }
+};
+
+template<class T>
+class BoundedConcurrentQueue // Lock-free multi-producer multi-consumer ring, every cell carries the lap it may next be written or read on
+{
+public:
+	BoundedConcurrentQueue(size_t capacity) // Rounded up to a power of two
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		m_mask = size - 1;
+		m_cells.reset(new ConcurrentQueueCell<T>[size]);
+		for (size_t i = 0; i < size; ++i)
+			m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+		m_enqueuePos.store(0, std::memory_order_relaxed);
+		m_dequeuePos.store(0, std::memory_order_relaxed);
+	}
+	BoundedConcurrentQueue(const BoundedConcurrentQueue&) = delete;
+	~BoundedConcurrentQueue()
+	{
+		for (size_t pos = m_dequeuePos.load(); pos != m_enqueuePos.load(); ++pos) // Values that were never popped
+			m_cells[pos & m_mask].GetValue()->~T();
+	}
+
+	bool try_push(const T& value) { return Emplace(value); }
+	bool try_push(T&& value) { return Emplace(std::move(value)); } // False if the queue is full, value is left untouched
+	bool try_pop(T& value) // False if the queue is empty or the next value is still being written
+	{
+		ConcurrentQueueCell<T> *cell;
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &m_cells[pos & m_mask];
+			intptr_t diff = static_cast<intptr_t>(cell->Sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0)
+			{
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false;
+			else // Another consumer took this cell, retry from the new position
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+		}
+
+		T *stored = cell->GetValue();
+		value = std::move(*stored);
+		stored->~T();
+		cell->Sequence.store(pos + m_mask + 1, std::memory_order_release); // Free for the producer one lap ahead
+		return true;
+	}
+
+	size_t GetCapacity() { return m_mask + 1; }
+	size_t unsafe_size() // Only a hint while other threads are pushing or popping
+	{
+		size_t enqueued = m_enqueuePos.load(std::memory_order_relaxed);
+		size_t dequeued = m_dequeuePos.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+private:
+	template<class U>
+	bool Emplace(U&& value)
+	{
+		ConcurrentQueueCell<T> *cell;
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &m_cells[pos & m_mask];
+			intptr_t diff = static_cast<intptr_t>(cell->Sequence.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos);
+			if (diff == 0)
+			{
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0) // The cell still holds a value from the previous lap
+				return false;
+			else
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+
+		new (cell->Storage) T(std::forward<U>(value));
+		cell->Sequence.store(pos + 1, std::memory_order_release); // Publish to consumers
+		return true;
+	}
+
+	std::unique_ptr<ConcurrentQueueCell<T>[]> m_cells;
+	size_t m_mask;
+
+	alignas(CacheLineSize) std::atomic<size_t> m_enqueuePos;
+	alignas(CacheLineSize) std::atomic<size_t> m_dequeuePos;
+};
+
+template<class T>
+class ConcurrentQueueSegment // Cells are written at most once, so a segment only ever fills up and drains
+{
+public:
+	ConcurrentQueueSegment(size_t size) : Size(size), Cells(new ConcurrentQueueCell<T>[size])
+	{
+		for (size_t i = 0; i < size; ++i)
+			Cells[i].Sequence.store(0, std::memory_order_relaxed);
+	}
+
+	size_t Size;
+	std::unique_ptr<ConcurrentQueueCell<T>[]> Cells; // Sequence is 1 once the value is written
+	std::atomic<ConcurrentQueueSegment *> Next = nullptr;
+	ConcurrentQueueSegment *NextRetired = nullptr;
+
+	alignas(CacheLineSize) std::atomic<size_t> EnqueuePos = 0;
+	alignas(CacheLineSize) std::atomic<size_t> DequeuePos = 0;
+};
+
+template<class T>
+class ConcurrentQueue // Unbounded lock-free multi-producer multi-consumer queue, values are FIFO per producer
+{
+public:
+	ConcurrentQueue(size_t segmentSize = 1024) : m_segmentSize(segmentSize)
+	{
+		ConcurrentQueueSegment<T> *segment = new ConcurrentQueueSegment<T>(segmentSize);
+		m_head.store(segment);
+		m_tail.store(segment);
+	}
+	ConcurrentQueue(const ConcurrentQueue&) = delete;
+	~ConcurrentQueue()
+	{
+		FreeSegments(m_retired.exchange(nullptr));
+		ConcurrentQueueSegment<T> *segment = m_head.load();
+		while (segment)
+		{
+			size_t end = std::min(segment->EnqueuePos.load(), segment->Size);
+			for (size_t pos = segment->DequeuePos.load(); pos < end; ++pos) // Values that were never popped
+				segment->Cells[pos].GetValue()->~T();
+
+			ConcurrentQueueSegment<T> *next = segment->Next.load();
+			delete segment;
+			segment = next;
+		}
+	}
+
+	void push(const T& value) { Emplace(value); }
+	void push(T&& value) { Emplace(std::move(value)); }
+	size_t unsafe_size() // Only a hint while other threads are pushing or popping
+	{
+		Enter();
+		size_t size = 0;
+		for (ConcurrentQueueSegment<T> *segment = m_head.load(); segment; segment = segment->Next.load())
+		{
+			size_t enqueued = std::min(segment->EnqueuePos.load(std::memory_order_relaxed), segment->Size);
+			size_t dequeued = segment->DequeuePos.load(std::memory_order_relaxed);
+			size += enqueued > dequeued ? enqueued - dequeued : 0;
+		}
+		Leave();
+		return size;
+	}
+	bool try_pop(T& value) // False if the queue is empty or the next value is still being written
+	{
+		Enter();
+		bool popped = false;
+		ConcurrentQueueSegment<T> *segment = m_head.load();
+		while (true)
+		{
+			size_t pos = segment->DequeuePos.load(std::memory_order_relaxed);
+			if (pos >= segment->Size) // Drained, move on if producers have started the next one
+			{
+				ConcurrentQueueSegment<T> *next = segment->Next.load();
+				if (!next)
+					break;
+				if (m_head.compare_exchange_strong(segment, next))
+				{
+					ConcurrentQueueSegment<T> *tail = segment; // A producer may not have moved the tail along yet
+					m_tail.compare_exchange_strong(tail, next);
+					Retire(segment);
+					segment = next;
+				}
+				continue;
+			}
+
+			ConcurrentQueueCell<T>& cell = segment->Cells[pos];
+			if (cell.Sequence.load(std::memory_order_acquire) == 0) // Empty, or the producer that claimed it has not finished writing
+				break;
+			if (segment->DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				T *stored = cell.GetValue();
+				value = std::move(*stored);
+				stored->~T();
+				popped = true;
+				break;
+			}
+		}
+		Leave();
+		return popped;
+	}
+private:
+	template<class U>
+	void Emplace(U&& value)
+	{
+		Enter();
+		ConcurrentQueueSegment<T> *segment = m_tail.load();
+		while (true)
+		{
+			size_t pos = segment->EnqueuePos.fetch_add(1, std::memory_order_relaxed);
+			if (pos < segment->Size)
+			{
+				ConcurrentQueueCell<T>& cell = segment->Cells[pos];
+				new (cell.Storage) T(std::forward<U>(value));
+				cell.Sequence.store(1, std::memory_order_release);
+				break;
+			}
+
+			ConcurrentQueueSegment<T> *next = segment->Next.load();
+			if (!next) // Full, link a new segment unless another producer got there first
+			{
+				ConcurrentQueueSegment<T> *fresh = new ConcurrentQueueSegment<T>(m_segmentSize);
+				if (segment->Next.compare_exchange_strong(next, fresh))
+					next = fresh;
+				else
+					delete fresh;
+			}
+			m_tail.compare_exchange_strong(segment, next);
+			segment = m_tail.load();
+		}
+		Leave();
+	}
+
+	void Enter() { m_accessors.fetch_add(1); }
+	void Leave() // Drained segments are freed by the last thread out, nobody else can still hold them
+	{
+		if (m_retired.load() && m_accessors.load() == 1)
+		{
+			ConcurrentQueueSegment<T> *retired = m_retired.exchange(nullptr);
+			if (m_accessors.load() == 1)
+				FreeSegments(retired);
+			else
+				while (retired)
+				{
+					ConcurrentQueueSegment<T> *next = retired->NextRetired;
+					Retire(retired);
+					retired = next;
+				}
+		}
+		m_accessors.fetch_sub(1);
+	}
+	void Retire(ConcurrentQueueSegment<T> *segment) // Only called once the segment is unreachable from the head and the tail
+	{
+		segment->NextRetired = m_retired.load();
+		while (!m_retired.compare_exchange_weak(segment->NextRetired, segment));
+	}
+	void FreeSegments(ConcurrentQueueSegment<T> *segment)
+	{
+		while (segment)
+		{
+			ConcurrentQueueSegment<T> *next = segment->NextRetired;
+			delete segment;
+			segment = next;
+		}
+	}
+
+	size_t m_segmentSize;
+	alignas(CacheLineSize) std::atomic<ConcurrentQueueSegment<T> *> m_head;
+	alignas(CacheLineSize) std::atomic<ConcurrentQueueSegment<T> *> m_tail;
+	alignas(CacheLineSize) std::atomic<int32_t> m_accessors = 0; // Threads inside push or try_pop
+	std::atomic<ConcurrentQueueSegment<T> *> m_retired = nullptr;
+};
@@ -38,32 +38,51 @@ UniqueId ECSRegistrar::GetEventId(std::string name)
 
 UniqueId ECSRegistrar::GetComponentIdByName(std::string name)
 {
-	return m_componentsByName[name];
+	auto iter = m_componentsByName.find(name);
+	return iter == m_componentsByName.end() ? 0 : m_componentInfos[iter->second].Identifier;
 }
 
 std::string ECSRegistrar::GetComponentName(UniqueId id)
 {
-	return m_components[id].Name;
+	return GetComponentInfo(id).Name;
 }
 
 int32_t ECSRegistrar::GetComponentSize(UniqueId id)
 {
-	return m_components[id].Size;
+	return GetComponentInfo(id).Size;
 }
 
 int32_t ECSRegistrar::GetComponentPointerOffset(UniqueId id)
 {
-	return m_components[id].ComponentOffset;
+	return GetComponentInfo(id).ComponentOffset;
 }
 
 int32_t ECSRegistrar::GetBufferPointerOffset(UniqueId id)
 {
-	return m_components[id].BufferOffset;
+	return GetComponentInfo(id).BufferOffset;
 }
 
 bool ECSRegistrar::IsComponentBuffered(UniqueId id)
 {
-	return m_components[id].Buffered;
+	return GetComponentInfo(id).Buffered;
+}
+
+int32_t ECSRegistrar::GetComponentIndex(UniqueId id)
+{
+	return m_componentIndices.at(id);
+}
+
+int32_t ECSRegistrar::AddComponentInfo(InternalTypeInfo& info)
+{
+	auto iter = m_componentIndices.find(info.Identifier);
+	if (iter != m_componentIndices.end()) // Already registered, keep the old index so existing archetypes stay valid
+		return iter->second;
+
+	info.Index = m_componentInfos.size();
+	m_componentInfos.push_back(info);
+	m_componentIndices[info.Identifier] = info.Index;
+	m_componentsByName[info.Name] = info.Index;
+	return info.Index;
 }
 
 void ECSRegistrar::InitSystems()
@@ -2,12 +2,14 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <typeinfo>
 #include <set>
 
 #include "System.h"
 #include "Component.h"
 #include "Entity.h"
+#include "WorldCell.h"
 
 #include "ChunkAllocator.h"
 #include "UUID.h"
@@ -20,6 +22,11 @@ public:
 	UniqueId Identifier;
 	int32_t ComponentOffset;
 	int32_t BufferOffset;
+	int32_t BufferElementSize;
+	int32_t BufferInlineCapacity;
+	int32_t BufferInlineOffset;
+	int32_t SortKeyOffset; // Offset of SortKeyComponent::SortKey, -1 if the component has no sort key
+	int32_t Index; // Dense index assigned at registration
 	bool Buffered;
 };
 
@@ -27,7 +34,7 @@ class ECSRegistrar
 {
 public:
 	ECSRegistrar() {
-		RegisterComponent<EntityIdComponent>();
+		RegisterComponent<EntityIdComponent>(); // Always receives EntityIdComponentIndex
 	}
 	XENGINEAPI ~ECSRegistrar();
 	XENGINEAPI void AddSystem(ISystem *system);
@@ -35,7 +42,7 @@ public:
 	XENGINEAPI ISystem *GetSystem(std::string name);
 	XENGINEAPI UniqueId GetEventId(std::string name);
 	template<class T>
-	void RegisterComponent()
+	int32_t RegisterComponent()
 	{
 		InternalTypeInfo info;
 		info.Name = StaticComponentInfo<T>::GetName();
@@ -43,13 +50,20 @@ public:
 		info.Identifier = StaticComponentInfo<T>::GetIdentifier();
 		info.Buffered = StaticComponentInfo<T>::IsBuffered(); // Has a buffer
 		info.ComponentOffset = StaticComponentInfo<T>::GetComponentPointerOffset();
-		if (info.Buffered)
+		if constexpr (StaticComponentInfo<T>::IsBuffered())
+		{
 			info.BufferOffset = BufferedComponentInfo<T>::GetBufferPointerOffset();
-		m_components[info.Identifier] = info;
-		m_componentsByName[info.Name] = info.Identifier;
+			info.BufferElementSize = BufferedComponentInfo<T>::GetElementSize();
+			info.BufferInlineCapacity = BufferedComponentInfo<T>::GetInlineCapacity();
+			info.BufferInlineOffset = BufferedComponentInfo<T>::GetInlineStorageOffset();
+		}
+		info.SortKeyOffset = -1;
+		if constexpr (std::is_base_of<SortKeyComponent, T>())
+			info.SortKeyOffset = SortKeyComponentInfo<T>::GetSortKeyOffset();
+		return AddComponentInfo(info);
 	}
-	template<class T, class ...TArgs>
-	void RegisterComponents() { RegisterComponent<T>(); RegisterComponents<TArgs>(); }
+	template<class ...TArgs>
+	void RegisterComponents() { (RegisterComponent<TArgs>(), ...); }
 
 	XENGINEAPI UniqueId GetComponentIdByName(std::string name);
 	XENGINEAPI std::string GetComponentName(UniqueId id);
@@ -57,12 +71,19 @@ public:
 	XENGINEAPI int32_t GetComponentPointerOffset(UniqueId id);
 	XENGINEAPI int32_t GetBufferPointerOffset(UniqueId id);
 	XENGINEAPI bool IsComponentBuffered(UniqueId id);
+	XENGINEAPI int32_t GetComponentIndex(UniqueId id);
 	XENGINEAPI void InitSystems();
-	inline std::map<UniqueId, InternalTypeInfo>& GetComponentMap() { return m_components; }
+	inline InternalTypeInfo& GetComponentInfo(UniqueId id) { return m_componentInfos[GetComponentIndex(id)]; } // Hashes the id, resolve the index once where it is used repeatedly
+	inline InternalTypeInfo& GetComponentInfoByIndex(int32_t index) { return m_componentInfos[index]; }
+	inline int32_t GetComponentCount() { return m_componentInfos.size(); }
+	inline std::vector<InternalTypeInfo>& GetComponentInfos() { return m_componentInfos; }
 private:
+	XENGINEAPI int32_t AddComponentInfo(InternalTypeInfo& info);
+
 	std::map<std::string, UniqueId> m_events;
-	std::map<UniqueId, InternalTypeInfo> m_components;
-	std::map<std::string, UniqueId> m_componentsByName;
+	std::vector<InternalTypeInfo> m_componentInfos; // Per-type metadata indexed by the dense component index
+	std::unordered_map<UniqueId, int32_t> m_componentIndices; // Map from a component type id to its dense index
+	std::unordered_map<std::string, int32_t> m_componentsByName; // Map from a component name to its dense index
 	std::map<std::string, ISystem *> m_systems;
 };
 
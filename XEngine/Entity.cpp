@@ -46,6 +46,18 @@ Entity EntityManager::CreateEntity(std::set<ComponentTypeId> components)
 	return Entity(m_scene->GetComponentManager()->AllocateComponentGroup(components), this);
 }
 
+std::vector<Entity> EntityManager::CreateEntities(ComponentRowTemplate& rowTemplate, int32_t count)
+{
+	std::vector<ComponentGroupId> ids(count);
+	m_scene->GetComponentManager()->InstantiateComponentGroups(rowTemplate, count, ids.data());
+
+	std::vector<Entity> ents;
+	ents.reserve(count);
+	for (ComponentGroupId id : ids)
+		ents.push_back(Entity(id, this));
+	return ents;
+}
+
 void EntityManager::DestroyEntity(EntityId id)
 {
 	m_scene->GetComponentManager()->DeleteComponentGroup(id);
@@ -92,7 +104,7 @@ std::vector<Entity> EntityManager::GetEntitiesByComponent(ComponentTypeId compon
 	};
 
 	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
-	UniqueId group = m_scene->GetComponentManager()->AddFilteringGroup({ registrar->GetComponentIdByName("EntityIdComponent"), componentId });
+	UniqueId group = m_scene->GetComponentManager()->AddFilteringGroup({ StaticComponentInfo<EntityIdComponent>::GetIdentifier(), componentId });
 	int32_t pointerOffset = registrar->GetComponentPointerOffset(componentId); // Get polymorphic pointer conversion offset
 	std::vector<Entity> ents;
 	std::vector<ComponentDataIterator> *compIterators = m_scene->GetComponentManager()->GetFilteringGroup(group, false); // Get all iterators of the filtering group containing only that component type
@@ -104,6 +116,7 @@ std::vector<Entity> EntityManager::GetEntitiesByComponent(ComponentTypeId compon
 			ents.push_back(Entity(q->EntityId->EntityId, this));
 		}
 	}
-	
+	delete compIterators;
+
 	return ents;
 }
\ No newline at end of file
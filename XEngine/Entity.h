@@ -5,7 +5,6 @@
 #include <map>
 #include <typeinfo>
 #include <set>
-#include <concurrent_unordered_map.h>
 
 using EntityId = UniqueId;
 class EntityManager;
@@ -51,6 +50,7 @@ public:
 	XENGINEAPI EntityManager(Scene *scene);
 	XENGINEAPI Entity CreateEntity(std::vector<std::string> components);
 	XENGINEAPI Entity CreateEntity(std::set<ComponentTypeId> components);
+	XENGINEAPI std::vector<Entity> CreateEntities(ComponentRowTemplate& rowTemplate, int32_t count); // Create count entities initialized from a baked row
 	XENGINEAPI void DestroyEntity(EntityId id);
 	XENGINEAPI void AddComponentToEntity(EntityId id, ComponentTypeId componentId);
 	XENGINEAPI void RemoveComponentFromEntity(EntityId id, ComponentTypeId componentId);
@@ -0,0 +1,149 @@
+#include "pch.h"
+#include "FrameArena.h"
+
+std::atomic<uint64_t> frameArenaFrame = 0;
+std::mutex frameArenaRegistryMutex;
+std::vector<FrameArena *> frameArenaRegistry;
+
+FrameArena::FrameArena(size_t blockSize, bool threadArena) : m_blockSize(blockSize), m_threadArena(threadArena), m_frame(frameArenaFrame),
+	m_threadId(std::this_thread::get_id()), m_publishedStats { m_threadId, 0, 0, 0 }
+{
+	if (m_threadArena)
+	{
+		std::lock_guard lock(frameArenaRegistryMutex);
+		frameArenaRegistry.push_back(this);
+	}
+}
+
+FrameArena::~FrameArena()
+{
+	if (m_threadArena)
+	{
+		std::lock_guard lock(frameArenaRegistryMutex);
+		frameArenaRegistry.erase(std::find(frameArenaRegistry.begin(), frameArenaRegistry.end(), this));
+	}
+	for (FrameArenaBlock& block : m_blocks)
+		std::free(block.Memory);
+}
+
+void *FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	while (true)
+	{
+		char *memory = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(m_current) + alignment - 1) & ~(alignment - 1));
+		if (m_current && memory + bytes <= m_end)
+		{
+			m_usedBytes += memory + bytes - m_current;
+			m_current = memory + bytes;
+			return memory;
+		}
+
+		if (m_block + 1 >= m_blocks.size() || m_blocks[m_block + 1].Size < bytes + alignment) // No following block can hold it, add one after the current
+		{
+			size_t size = std::max(m_blockSize, bytes + alignment);
+			m_blocks.insert(m_blocks.begin() + (m_block + 1), FrameArenaBlock { reinterpret_cast<char *>(std::malloc(size)), size });
+			m_reservedBytes += size;
+			if (m_threadArena) // Rare, so growth shows up before the next sync point
+				PublishStats();
+		}
+
+		FrameArenaBlock& block = m_blocks[++m_block];
+		m_current = block.Memory;
+		m_end = block.Memory + block.Size;
+	}
+}
+
+void FrameArena::Reset()
+{
+	m_highWaterBytes = std::max(m_highWaterBytes, m_usedBytes);
+
+	if (m_blocks.size() > 1) // The last round spilled over, merge into one block that fits all of it
+	{
+		size_t size = 0;
+		for (FrameArenaBlock& block : m_blocks)
+		{
+			size += block.Size;
+			std::free(block.Memory);
+		}
+		m_blocks.assign(1, FrameArenaBlock { reinterpret_cast<char *>(std::malloc(size)), size });
+		m_reservedBytes = size;
+	}
+
+	m_block = m_blocks.empty() ? -1 : 0;
+	m_current = m_blocks.empty() ? nullptr : m_blocks[0].Memory;
+	m_end = m_blocks.empty() ? nullptr : m_blocks[0].Memory + m_blocks[0].Size;
+	m_usedBytes = 0;
+}
+
+FrameArenaStats FrameArena::GetStats()
+{
+	FrameArenaStats stats;
+	stats.ThreadId = m_threadId;
+	stats.UsedBytes = m_usedBytes;
+	stats.HighWaterBytes = std::max(m_usedBytes, m_highWaterBytes);
+	stats.ReservedBytes = m_reservedBytes;
+	return stats;
+}
+
+void FrameArena::PublishStats()
+{
+	FrameArenaStats stats = GetStats();
+	std::lock_guard lock(frameArenaRegistryMutex);
+	m_publishedStats = stats;
+}
+
+FrameArena& FrameArena::GetThreadArena()
+{
+	static thread_local FrameArena arena(262144, true);
+	return arena;
+}
+
+void FrameArena::EndFrame()
+{
+	++frameArenaFrame;
+}
+
+void FrameArena::SyncThread()
+{
+	FrameArena& arena = GetThreadArena();
+	uint64_t frame = frameArenaFrame;
+	if (arena.m_frame == frame || arena.m_holds > 0) // Holds are only taken on this thread, so none can appear before the rewind
+		return;
+
+	arena.PublishStats(); // Before the rewind, so the frame's usage is what shows
+	arena.Reset();
+	arena.m_frame = frame;
+}
+
+std::vector<FrameArenaStats> FrameArena::GetThreadArenaStats()
+{
+	std::lock_guard lock(frameArenaRegistryMutex);
+
+	std::vector<FrameArenaStats> stats;
+	stats.reserve(frameArenaRegistry.size());
+	for (FrameArena *arena : frameArenaRegistry)
+		stats.push_back(arena->m_publishedStats);
+	return stats;
+}
+
+FrameArenaHold::FrameArenaHold() : m_arena(&FrameArena::GetThreadArena())
+{
+	++m_arena->m_holds;
+}
+
+FrameArenaHold::FrameArenaHold(FrameArenaHold&& other) : m_arena(other.m_arena)
+{
+	other.m_arena = nullptr;
+}
+
+FrameArenaHold::~FrameArenaHold()
+{
+	Release();
+}
+
+void FrameArenaHold::Release()
+{
+	if (m_arena)
+		--m_arena->m_holds;
+	m_arena = nullptr;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+
+#include "exports.h"
+
+class FrameArenaStats
+{
+public:
+	std::thread::id ThreadId;
+	uint64_t UsedBytes; // Bytes handed out since the arena last rewound
+	uint64_t HighWaterBytes; // Most bytes used within a single frame
+	uint64_t ReservedBytes; // Bytes held in blocks
+};
+
+class FrameArenaBlock
+{
+public:
+	char *Memory;
+	size_t Size;
+};
+
+class FrameArena
+{
+public:
+	XENGINEAPI FrameArena(size_t blockSize = 262144, bool threadArena = false);
+	XENGINEAPI ~FrameArena();
+	XENGINEAPI void *Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)); // Bump from the current block, nothing is freed individually
+	XENGINEAPI void Reset(); // Rewind to the start, keeping the blocks for the next round
+	XENGINEAPI FrameArenaStats GetStats();
+
+	XENGINEAPI static FrameArena& GetThreadArena(); // Arena of the calling thread, rewound at its sync points once a frame has ended
+	XENGINEAPI static void EndFrame();
+	XENGINEAPI static void SyncThread(); // Call where the calling thread holds no frame memory, its arena rewinds if a frame ended since and nothing holds it
+	XENGINEAPI static std::vector<FrameArenaStats> GetThreadArenaStats(); // As last published by each thread at its sync points
+private:
+	friend class FrameArenaHold;
+
+	void PublishStats(); // Thread arenas only, frameArenaRegistryMutex must not be held
+
+	std::vector<FrameArenaBlock> m_blocks;
+	int32_t m_block = -1;
+	char *m_current = nullptr;
+	char *m_end = nullptr;
+
+	size_t m_blockSize;
+	bool m_threadArena;
+	uint64_t m_frame;
+	std::thread::id m_threadId;
+
+	std::atomic<int32_t> m_holds = 0; // Taken on the owning thread, may be released from any
+
+	uint64_t m_usedBytes = 0;
+	uint64_t m_highWaterBytes = 0;
+	uint64_t m_reservedBytes = 0;
+	FrameArenaStats m_publishedStats; // Copy other threads read, under frameArenaRegistryMutex
+};
+
+class FrameArenaHold // Keeps the calling thread's arena from rewinding, for work that keeps frame memory past its thread's next sync point
+{
+public:
+	XENGINEAPI FrameArenaHold();
+	XENGINEAPI FrameArenaHold(FrameArenaHold&& other);
+	XENGINEAPI ~FrameArenaHold(); // Can run on any thread, as long as the one that took the hold is still alive
+	FrameArenaHold(const FrameArenaHold&) = delete;
+	FrameArenaHold& operator=(const FrameArenaHold&) = delete;
+	XENGINEAPI void Release();
+private:
+	FrameArena *m_arena;
+};
+
+template<class T>
+class FrameAllocator // Standard allocator over the thread's frame arena, memory is only valid until the end of the frame
+{
+public:
+	using value_type = T;
+
+	FrameAllocator() = default;
+	template<class U>
+	FrameAllocator(const FrameAllocator<U>&) { }
+
+	T *allocate(size_t count)
+	{
+		return reinterpret_cast<T *>(FrameArena::GetThreadArena().Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *memory, size_t count) // Reclaimed all at once when the arena rewinds
+	{
+	}
+
+	template<class U>
+	bool operator==(const FrameAllocator<U>&) const { return true; }
+	template<class U>
+	bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template<class T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,31 @@
+#include "pch.h"
+#include "FrameStats.h"
+
+FrameStatsRing::FrameStatsRing(int32_t capacity)
+{
+	m_frames.resize(capacity);
+}
+
+void FrameStatsRing::Push(EngineFrameStats stats)
+{
+	std::lock_guard lock(m_mutex);
+	stats.Frame = m_nextFrame++;
+	m_frames[stats.Frame % m_frames.size()] = std::move(stats);
+}
+
+std::vector<EngineFrameStats> FrameStatsRing::GetSince(uint64_t frame)
+{
+	std::lock_guard lock(m_mutex);
+
+	uint64_t oldest = m_nextFrame > m_frames.size() ? m_nextFrame - m_frames.size() : 1; // Anything older has been overwritten
+	std::vector<EngineFrameStats> frames;
+	for (uint64_t i = std::max(frame + 1, oldest); i < m_nextFrame; ++i)
+		frames.push_back(m_frames[i % m_frames.size()]);
+	return frames;
+}
+
+uint64_t FrameStatsRing::GetLatestFrame()
+{
+	std::lock_guard lock(m_mutex);
+	return m_nextFrame - 1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <mutex>
+
+#include "WorkerManager.h"
+#include "System.h"
+#include "ListAllocator.h"
+
+class EngineFrameStats
+{
+public:
+	uint64_t Frame; // Increases by one every tick
+	float FrameTime; // Seconds spent in the tick
+	WorkerPoolStats Workers;
+	std::vector<SystemFrameStats> Systems;
+	std::vector<ListAllocatorStats> Allocators; // Only filled in while allocator stats are enabled on the engine
+};
+
+class FrameStatsRing // Keeps the most recent frames for overlays and log sinks, which poll with the last frame they have seen
+{
+public:
+	XENGINEAPI FrameStatsRing(int32_t capacity = 240);
+	XENGINEAPI void Push(EngineFrameStats stats); // Frame is assigned here
+	XENGINEAPI std::vector<EngineFrameStats> GetSince(uint64_t frame); // Buffered frames newer than frame, oldest first
+	XENGINEAPI uint64_t GetLatestFrame(); // 0 before the first push
+private:
+	std::mutex m_mutex;
+	std::vector<EngineFrameStats> m_frames;
+	uint64_t m_nextFrame = 1;
+};
@@ -16,16 +16,12 @@ std::map<ComparisonMode, GLenum> compModeB =
 	{ ComparisonMode::GreaterOrEqual, GL_GEQUAL }, { ComparisonMode::Always, GL_ALWAYS }
 };
 
-GLCmdBuffer::GLCmdBuffer(GraphicsContext *context, bool pooled) : m_context(context), m_pooled(pooled)
+GLCmdBuffer::GLCmdBuffer(GraphicsContext *context, bool pooled) : m_context(context), m_pooled(pooled), m_heldMemory(4096)
 {
 }
 
 GLCmdBuffer::~GLCmdBuffer()
 {
-	for (void *buffer : m_buffersHeld)
-	{
-		std::free(buffer);
-	}
 }
 
 void GLCmdBuffer::BindRenderPipeline(GraphicsRenderPipeline *pipeline)
@@ -152,7 +148,7 @@ void GLCmdBuffer::PushShaderConstants(GraphicsShaderDataSet *set, int32_t consta
 	GLShaderDataSet *sds = dynamic_cast<GLShaderDataSet *>(set);
 	GraphicsShaderConstantData& sdata = sds->GetConstantData()[constantIndex];
 
-	std::vector<GLuint> progs;
+	FrameVector<GLuint> progs;
 	progs.reserve(4);
 	if (sdata.Stages & ShaderStageBit::Compute)
 		progs.push_back(m_lastComputePipe->GetComputeProgram());
@@ -167,9 +163,8 @@ void GLCmdBuffer::PushShaderConstants(GraphicsShaderDataSet *set, int32_t consta
 	if (sdata.Stages & ShaderStageBit::Vertex)
 		progs.push_back(m_lastRenderPipe->GetStage(ShaderStageBit::Vertex));
 
-	void *cmdBufStore = std::malloc(4 * sdata.ElementCount);
+	void *cmdBufStore = m_heldMemory.Allocate(4 * sdata.ElementCount);
 	std::memcpy(cmdBufStore, data, 4 * sdata.ElementCount);
-	m_buffersHeld.push_back(cmdBufStore);
 
 	if (sdata.Float)
 	{
@@ -216,7 +211,7 @@ void GLCmdBuffer::BindRenderShaderResourceInstance(GraphicsShaderDataSet *set, G
 
 	GraphicsShaderResourceViewData& data = ds->GetResourceViews()[viewIndex];
 
-	std::vector<GLuint> progs;
+	FrameVector<GLuint> progs;
 	progs.reserve(4);
 	if (data.Stages & ShaderStageBit::Compute)
 		progs.push_back(m_lastComputePipe->GetComputeProgram());
@@ -558,9 +553,8 @@ void GLCmdBuffer::ClearAttachmentsDepthStencil(int32_t index, float depth, char
 
 void GLCmdBuffer::UpdateBufferData(GraphicsMemoryBuffer *buffer, int32_t offset, int32_t size, void *data)
 {
-	void *copied = std::malloc(size);
+	void *copied = m_heldMemory.Allocate(size);
 	std::memcpy(copied, data, size);
-	m_buffersHeld.push_back(copied);
 
 	m_commands.push_back([buffer, offset, size, copied]()
 		{
@@ -677,11 +671,7 @@ void GLCmdBuffer::CopyBufferToBuffer(GraphicsMemoryBuffer *src, GraphicsMemoryBu
 
 void GLCmdBuffer::BeginRecording()
 {
-	for (void *buffer : m_buffersHeld)
-	{
-		std::free(buffer);
-	}
-	m_buffersHeld.clear();
+	m_heldMemory.Reset();
 	m_commands.clear();
 }
 
@@ -3,6 +3,7 @@
 #include "GraphicsDefs.h"
 #include "GLPipeline.h"
 #include "GLImage.h"
+#include "FrameArena.h"
 
 class GLCmdBuffer : public GraphicsCommandBuffer 
 {
@@ -63,7 +64,7 @@ public:
 	void Execute();
 private:
 	GraphicsContext *m_context;
-	std::vector<void *> m_buffersHeld;
+	FrameArena m_heldMemory; // Data copied while recording, kept until the buffer is recorded again since it can be executed over several frames
 	std::vector<std::function<void()>> m_commands;
 	GLPipeline *m_lastRenderPipe;
 	GLComputePipeline *m_lastComputePipe;
@@ -247,6 +247,8 @@ MessageCallback(GLenum source,
 
 void GLContext::RunContextThread()
 {
+	TagCurrentThread(ThreadTag::GraphicsSubmission, 0, XEngineInstance->GetThreadLayout().GetCore(ThreadTag::GraphicsSubmission));
+
 	m_context = SDL_GL_CreateContext(m_window);
 	SDL_GL_MakeCurrent(m_window, m_context);
 
@@ -277,6 +279,7 @@ void GLContext::RunContextThread()
 
 	while (m_running)
 	{
+		FrameArena::SyncThread();
 		m_syncWithRenderThread = false;
 
 		glm::ivec2 frameWindowSize = GetScreenSize();
@@ -4,10 +4,10 @@
 #include "GLCmdBuffer.h"
 #include "GLInitable.h"
 #include "GLBuffer.h"
+#include "ConcurrentQueue.h"
 
 #include <SDL_video.h>
 
-#include <concurrent_queue.h>
 #include <thread>
 
 class GLSpecific : public GraphicsSpecificStructure
@@ -76,13 +76,13 @@ private:
 	SDL_Window *m_window; 
 	SDL_GLContext m_context;
 
-	concurrency::concurrent_queue<GLCmdBuffer *> m_cmdPool;
+	ConcurrentQueue<GLCmdBuffer *> m_cmdPool;
 
-	concurrency::concurrent_queue<GLInitable *> m_queuedInitializers;
-	concurrency::concurrent_queue<GLCmdBuffer *> m_queuedBuffers;
-	concurrency::concurrent_queue<std::function<void()>> m_queuedDeleters;
-	concurrency::concurrent_queue<GraphicsSyncObject *> m_queuedSyncs;
-	concurrency::concurrent_queue<GLBuffer *> m_queuedMaps;
+	ConcurrentQueue<GLInitable *> m_queuedInitializers;
+	ConcurrentQueue<GLCmdBuffer *> m_queuedBuffers;
+	ConcurrentQueue<std::function<void()>> m_queuedDeleters;
+	ConcurrentQueue<GraphicsSyncObject *> m_queuedSyncs;
+	ConcurrentQueue<GLBuffer *> m_queuedMaps;
 
 	std::thread *m_glSubmissionThread;
 
@@ -53,6 +53,32 @@ bool GLSync::GetCurrentStatus()
 	return m_signaled;
 }
 
+void GLSync::Signal(bool val)
+{
+	std::vector<std::function<void()>> callbacks;
+	{
+		std::lock_guard lock(m_callbackMutex);
+		m_signalVal = val;
+		m_signaled = true;
+		callbacks.swap(m_signalCallbacks);
+	}
+	for (std::function<void()>& callback : callbacks) // Called on the context thread, callbacks only hand work off
+		callback();
+}
+
+void GLSync::AddSignalCallback(std::function<void()> callback)
+{
+	{
+		std::lock_guard lock(m_callbackMutex);
+		if (!m_signaled)
+		{
+			m_signalCallbacks.push_back(callback);
+			return;
+		}
+	}
+	callback();
+}
+
 void GLSync::Reset()
 {
 	ResetSignaled();
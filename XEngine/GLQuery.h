@@ -3,6 +3,7 @@
 #include "GraphicsDefs.h"
 #include <GL/glew.h>
 #include <atomic>
+#include <mutex>
 
 class GLQuery : public GraphicsQuery, public GLInitable
 {
@@ -25,7 +26,7 @@ public:
 	void SetSync(GLsync sync);
 	GLsync GetSync() { return m_sync; }
 
-	void Signal(bool val) { m_signaled = true; m_signalVal = val; }
+	void Signal(bool val);
 	void ResetSignaled() { m_signaled = false; }
 	uint64_t GetWaitTime() { return m_curWaitTime; }
 	bool IsWaiting() { return m_waiting; }
@@ -33,7 +34,11 @@ public:
 
 	virtual bool Wait(uint64_t nanoSecTimeout) override;
 	virtual bool GetCurrentStatus() override;
+	virtual void AddSignalCallback(std::function<void()> callback) override;
 private:
+	std::mutex m_callbackMutex;
+	std::vector<std::function<void()>> m_signalCallbacks;
+
 	std::atomic_bool m_signalVal;
 	std::atomic_bool m_signaled = false;
 	bool m_waiting;
@@ -1,122 +1,226 @@
 #include "pch.h"
 #include "GPUMemoryAllocator.h"
 
-GPUMemoryAllocator::GPUMemoryAllocator(uint64_t size, int32_t maxAllocs, bool resizable)
-	: m_allocator(size, maxAllocs), m_resizable(resizable), m_size(size), m_temp(nullptr), m_tempSize(-1)
+GPUMemoryAllocator::GPUMemoryAllocator(uint64_t pageSize, int32_t maxAllocs, bool resizable)
+	: GPUMemoryAllocator(XEngineInstance->GetInterface<DisplayInterface>(HardwareInterfaceType::Display)->GetGraphicsContext(), pageSize, maxAllocs, resizable)
 {
-	m_context = XEngineInstance->GetInterface<DisplayInterface>(HardwareInterfaceType::Display)->GetGraphicsContext();
-
-	m_memory = m_context->CreateBuffer(size, BufferUsageBit::TransferSource | BufferUsageBit::TransferDest,
-		GraphicsMemoryTypeBit::DeviceResident | GraphicsMemoryTypeBit::DynamicAccess);
+}
 
-	m_allocator.SetMoveCallback(std::bind(&GPUMemoryAllocator::MoveMemory, this, std::placeholders::_1));
-	m_allocator.SetDefragBeginCallback(std::bind(&GPUMemoryAllocator::DefragBegin, this));
-	m_allocator.SetDefragEndCallback(std::bind(&GPUMemoryAllocator::DefragEnd, this));
+GPUMemoryAllocator::GPUMemoryAllocator(GraphicsContext *context, uint64_t pageSize, int32_t maxAllocs, bool resizable)
+	: m_context(context), m_pageSize(pageSize), m_maxAllocs(maxAllocs), m_resizable(resizable)
+{
+	AddPage(pageSize);
 }
 
 GPUMemoryAllocator::~GPUMemoryAllocator()
 {
-	delete m_memory;
-	if (m_temp)
-		delete m_temp;
+	for (std::unique_ptr<GPUMemoryPage>& page : m_pages)
+	{
+		delete page->Buffer;
+		if (page->Staging)
+			delete page->Staging;
+	}
 }
 
 bool GPUMemoryAllocator::WillFit(int32_t size)
 {
-	return m_allocator.GetFreeSpace() >= size;
+	std::shared_lock lock(m_pageMutex);
+	for (std::unique_ptr<GPUMemoryPage>& page : m_pages)
+	{
+		if (page->Allocator.GetFreeSpace() >= size)
+			return true;
+	}
+	return false;
 }
 
 PinnedGPUMemory GPUMemoryAllocator::GetMemory(ListMemoryPointer *ptr)
 {
-	return PinnedGPUMemory(m_allocator.PinMemory(ptr), m_memory, m_allocator.GetAllocationSize(ptr));
+	GPUMemoryPage *page = GetPage(ptr);
+	return PinnedGPUMemory(page->Allocator.PinMemory(ptr), page->Buffer, page->Allocator.GetAllocationSize(ptr));
 }
 
 ListMemoryPointer *GPUMemoryAllocator::RequestSpace(int32_t bytes, int32_t alignment)
 {
-	m_resizeMutex.lock_shared();
-	if (!WillFit(bytes + alignment - 1))
-		alignment = 1;
-
-	if (!WillFit(bytes) && m_resizable)
+	int32_t seenPages;
 	{
-		m_resizeMutex.unlock_shared();
-		m_resizeMutex.lock();
+		std::shared_lock lock(m_pageMutex);
+		seenPages = m_pages.size();
+		int32_t first = m_lastPage.load(std::memory_order_relaxed);
+		for (int32_t i = 0; i < seenPages; ++i)
+		{
+			int32_t index = (first + i) % seenPages;
+			if (ListMemoryPointer *ptr = m_pages[index]->Allocator.TryAllocateMemory(bytes, alignment))
+			{
+				m_lastPage.store(index, std::memory_order_relaxed);
+				return ptr;
+			}
+		}
 
-		uint64_t oldSize = m_size;
-		uint64_t newSize = std::exp2l(std::floorl(std::log2l(oldSize)) + 1);
+		if (!m_resizable)
+			return m_pages[0]->Allocator.AllocateMemory(bytes, alignment); // Compacts as a last resort
+	}
 
-		GraphicsMemoryBuffer *newBuf = m_context->CreateBuffer(newSize, BufferUsageBit::TransferSource | BufferUsageBit::TransferDest,
-			GraphicsMemoryTypeBit::DeviceResident | GraphicsMemoryTypeBit::DynamicAccess);
+	std::lock_guard lock(m_pageMutex);
+	for (int32_t index = seenPages; index < m_pages.size(); ++index) // Another thread may have added a page in the meantime
+	{
+		if (ListMemoryPointer *ptr = m_pages[index]->Allocator.TryAllocateMemory(bytes, alignment))
+		{
+			m_lastPage.store(index, std::memory_order_relaxed);
+			return ptr;
+		}
+	}
 
-		GraphicsSyncObject *sync = m_context->CreateSync(false);
+	uint64_t needed = static_cast<uint64_t>(bytes) + alignment - 1;
+	uint64_t size = (needed + m_pageSize - 1) / m_pageSize * m_pageSize; // Anything bigger than a page gets a page of its own
+	GPUMemoryPage *page = AddPage(std::max(size, m_pageSize));
+	m_lastPage.store(m_pages.size() - 1, std::memory_order_relaxed);
+	return page->Allocator.TryAllocateMemory(bytes, alignment);
+}
 
-		GraphicsCommandBuffer *buf = m_context->GetTransferBufferFromPool();
-		buf->BeginRecording();
-		buf->CopyBufferToBuffer(m_memory, newBuf, 0, 0, oldSize);
-		buf->SignalFence(sync);
-		buf->StopRecording();
+void GPUMemoryAllocator::FreeSpace(ListMemoryPointer *ptr)
+{
+	GetPage(ptr)->Allocator.DeallocateMemory(ptr);
+}
 
-		m_context->SubmitCommands(buf, GraphicsQueueType::Transfer);
+int32_t GPUMemoryAllocator::GetPageCount()
+{
+	std::shared_lock lock(m_pageMutex);
+	return m_pages.size();
+}
 
-		sync->Wait(1e32);
-		delete sync;
+GraphicsMemoryBuffer *GPUMemoryAllocator::GetPageBuffer(int32_t page)
+{
+	std::shared_lock lock(m_pageMutex);
+	return m_pages[page]->Buffer;
+}
 
-		delete m_memory;
-		m_memory = newBuf;
-		m_size = newSize;
-		m_allocator.SetSize(newSize);
+void GPUMemoryAllocator::SetDefragBudget(uint64_t bytesPerFrame, int32_t movesPerFrame)
+{
+	std::lock_guard lock(m_pageMutex);
+	m_defragBytes = bytesPerFrame;
+	m_defragMoves = movesPerFrame;
+	for (std::unique_ptr<GPUMemoryPage>& page : m_pages)
+		page->Allocator.SetDefragBudget(bytesPerFrame, movesPerFrame);
+}
 
-		m_resizeMutex.unlock();
-		m_resizeMutex.lock_shared();
-	}
+void GPUMemoryAllocator::SetName(std::string name)
+{
+	std::lock_guard lock(m_pageMutex);
+	m_name = name;
+	for (int32_t index = 0; index < m_pages.size(); ++index)
+		m_pages[index]->Allocator.SetName(name + ", page " + std::to_string(index));
+}
 
-	m_resizeMutex.unlock_shared();
-	return m_allocator.AllocateMemory(bytes, alignment);
+std::vector<ListAllocatorStats> GPUMemoryAllocator::GetStats()
+{
+	std::shared_lock lock(m_pageMutex);
+	std::vector<ListAllocatorStats> stats;
+	stats.reserve(m_pages.size());
+	for (std::unique_ptr<GPUMemoryPage>& page : m_pages)
+		stats.push_back(page->Allocator.GetStats());
+	return stats;
 }
 
-GraphicsMemoryBuffer *GPUMemoryAllocator::GetMemoryBuffer()
+GPUMemoryPage *GPUMemoryAllocator::AddPage(uint64_t size)
 {
-	return m_memory;
+	int32_t index = m_pages.size();
+	GPUMemoryPage *page = m_pages.emplace_back(std::make_unique<GPUMemoryPage>(size, m_maxAllocs)).get();
+
+	page->Buffer = m_context->CreateBuffer(size, BufferUsageBit::TransferSource | BufferUsageBit::TransferDest,
+		GraphicsMemoryTypeBit::DeviceResident | GraphicsMemoryTypeBit::DynamicAccess);
+
+	page->Allocator.SetPage(index);
+	page->Allocator.SetName(m_name + ", page " + std::to_string(index));
+	page->Allocator.SetDefragBudget(m_defragBytes, m_defragMoves);
+	page->Allocator.SetMoveCallback(std::bind(&GPUMemoryAllocator::MoveMemory, this, page, std::placeholders::_1));
+	page->Allocator.SetDefragBeginCallback(std::bind(&GPUMemoryAllocator::DefragBegin, this, page));
+	page->Allocator.SetDefragEndCallback(std::bind(&GPUMemoryAllocator::DefragEnd, this, page));
+	return page;
 }
 
-void GPUMemoryAllocator::FreeSpace(ListMemoryPointer *ptr)
+GPUMemoryPage *GPUMemoryAllocator::GetPage(ListMemoryPointer *ptr)
 {
-	m_allocator.DeallocateMemory(ptr);
+	std::shared_lock lock(m_pageMutex); // Only the vector can change, the page itself stays put
+	return m_pages[ptr->Page].get();
 }
 
-void GPUMemoryAllocator::DefragBegin()
+void GPUMemoryAllocator::DefragBegin(GPUMemoryPage *page)
 {
-	thisBuf = XEngineInstance->GetInterface<DisplayInterface>(HardwareInterfaceType::Display)
-		->GetGraphicsContext()->GetTransferBufferFromPool();
-	thisBuf->BeginRecording();
+	page->Moves.clear();
 }
 
-void GPUMemoryAllocator::DefragEnd()
+void GPUMemoryAllocator::DefragEnd(GPUMemoryPage *page)
 {
-	thisBuf->StopRecording();
+	if (page->Moves.empty())
+		return;
+
+	std::vector<GPUBufferCopy> copies = PlanMoves(page->Moves);
+	page->Moves.clear();
 
-	XEngineInstance->GetInterface<DisplayInterface>(HardwareInterfaceType::Display)
-		->GetGraphicsContext()->SubmitCommands(thisBuf, GraphicsQueueType::Transfer);
+	GraphicsCommandBuffer *cmds = m_context->GetTransferBufferFromPool();
+	cmds->BeginRecording();
+	for (GPUBufferCopy& copy : copies)
+	{
+		if (!page->Staging && (copy.Source == GPUCopyBuffer::Staging || copy.Dest == GPUCopyBuffer::Staging))
+			page->Staging = m_context->CreateBuffer(GPUDefragStagingSize, BufferUsageBit::TransferSource | BufferUsageBit::TransferDest,
+				GraphicsMemoryTypeBit::DeviceResident);
+
+		cmds->CopyBufferToBuffer(copy.Source == GPUCopyBuffer::Staging ? page->Staging : page->Buffer,
+			copy.Dest == GPUCopyBuffer::Staging ? page->Staging : page->Buffer, copy.SourceOffset, copy.DestOffset, copy.Size);
+	}
+	cmds->StopRecording();
+	m_context->SubmitCommands(cmds, GraphicsQueueType::Transfer);
 }
 
-void GPUMemoryAllocator::MoveMemory(MoveData& data)
+void GPUMemoryAllocator::MoveMemory(GPUMemoryPage *page, MoveData& data)
 {
-	if (data.DestIndex + data.Size > data.SrcIndex)
+	page->Moves.push_back(data);
+}
+
+std::vector<GPUBufferCopy> GPUMemoryAllocator::PlanMoves(std::vector<MoveData>& moves)
+{
+	std::vector<GPUBufferCopy> copies;
+	int32_t stagingChunks = 0;
+
+	uint64_t runSrc = 0, runDest = 0, runSize = 0;
+	for (MoveData& move : moves)
 	{
-		int32_t diffSize = data.DestIndex + data.Size - data.SrcIndex;
-		if (m_tempSize < diffSize)
+		if (runSize > 0 && runSrc + runSize == move.SrcIndex && runDest + runSize == move.DestIndex) // Neighbours moving by the same amount copy as one
 		{
-			if (m_temp)
-				delete m_temp;
-			m_temp = m_context->CreateBuffer(diffSize, BufferUsageBit::TransferSource | BufferUsageBit::TransferDest,
-				GraphicsMemoryTypeBit::DeviceResident | GraphicsMemoryTypeBit::DynamicAccess);
+			runSize += move.Size;
+			continue;
 		}
-		thisBuf->CopyBufferToBuffer(m_memory, m_temp, data.SrcIndex, 0, diffSize);
-		thisBuf->CopyBufferToBuffer(m_temp, m_memory, 0, data.DestIndex, diffSize);
-		thisBuf->CopyBufferToBuffer(m_memory, m_memory, data.SrcIndex + diffSize, data.DestIndex + diffSize, data.Size - diffSize);
+		PlanRun(copies, runSrc, runDest, runSize, stagingChunks);
+		runSrc = move.SrcIndex;
+		runDest = move.DestIndex;
+		runSize = move.Size;
 	}
-	else
+	PlanRun(copies, runSrc, runDest, runSize, stagingChunks);
+
+	return copies;
+}
+
+void GPUMemoryAllocator::PlanRun(std::vector<GPUBufferCopy>& copies, uint64_t src, uint64_t dest, uint64_t size, int32_t& stagingChunks)
+{
+	if (src == dest || size == 0)
+		return;
+
+	uint64_t shift = src > dest ? src - dest : dest - src;
+	uint64_t half = GPUDefragStagingSize / 2;
+	bool staged = shift < size && (size + shift - 1) / shift > 2 * ((size + half - 1) / half); // Direct copies can be at most as long as the shift
+	uint64_t chunk = staged ? half : std::min(std::min(shift, size), GPUMaxCopySize);
+
+	for (uint64_t done = 0; done < size; done += chunk)
 	{
-		thisBuf->CopyBufferToBuffer(m_memory, m_memory, data.SrcIndex, data.DestIndex, data.Size);
+		uint64_t length = std::min(chunk, size - done);
+		uint64_t offset = src > dest ? done : size - done - length; // Work away from the end being written, so no source is overwritten before it is read
+		if (staged)
+		{
+			uint64_t stagingOffset = (stagingChunks++ % 2) * half; // The next chunk goes in the other half, it does not have to wait for this one to be read
+			copies.push_back({ GPUCopyBuffer::Page, GPUCopyBuffer::Staging, src + offset, stagingOffset, static_cast<int32_t>(length) });
+			copies.push_back({ GPUCopyBuffer::Staging, GPUCopyBuffer::Page, stagingOffset, dest + offset, static_cast<int32_t>(length) });
+		}
+		else
+			copies.push_back({ GPUCopyBuffer::Page, GPUCopyBuffer::Page, src + offset, dest + offset, static_cast<int32_t>(length) });
 	}
 }
@@ -5,50 +5,95 @@
 #include "ListAllocator.h"
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+constexpr uint64_t GPUDefragStagingSize = 1 << 20; // Two halves that overlapping defrag moves alternate between
+constexpr uint64_t GPUMaxCopySize = 1 << 30; // Copy sizes are 32-bit
+
+enum class GPUCopyBuffer
+{
+	Page, Staging
+};
+
+class GPUBufferCopy
+{
+public:
+	GPUCopyBuffer Source;
+	GPUCopyBuffer Dest;
+	uint64_t SourceOffset;
+	uint64_t DestOffset;
+	int32_t Size;
+};
 
 class PinnedGPUMemory
 {
 public:
 	PinnedGPUMemory() {}
-	PinnedGPUMemory(std::shared_ptr<PinnedListMemory> mem, GraphicsMemoryBuffer *buffer, int32_t size) 
-		: m_buffer(buffer), m_mem(mem), m_size(size) {}
-	GraphicsMemoryBuffer *GetBuffer() { return m_buffer; }
-	ListMemoryPointer *GetPointer() { return m_mem->GetPointer(); }
+	PinnedGPUMemory(PinnedListMemory&& mem, GraphicsMemoryBuffer *buffer, int32_t size) 
+		: m_buffer(buffer), m_mem(std::move(mem)), m_size(size) {}
+	GraphicsMemoryBuffer *GetBuffer() { return m_buffer; } // The page's buffer, pointers are relative to it
+	ListMemoryPointer *GetPointer() { return m_mem.GetPointer(); }
+	int32_t GetPage() { return m_mem.GetPointer()->Page; } // Draws on the same page can share one buffer binding
 	int32_t GetSize() { return m_size; }
-	void Unpin() { m_mem->Unpin(); }
+	void Unpin() { m_mem.Unpin(); }
 private:
 	GraphicsMemoryBuffer *m_buffer;
 	int32_t m_size;
-	std::shared_ptr<PinnedListMemory> m_mem;
+	PinnedListMemory m_mem; // Move-only, the pin goes with it
 };
 
-class GPUMemoryAllocator
+class GPUMemoryPage
 {
 public:
-	XENGINEAPI GPUMemoryAllocator(uint64_t size, int32_t maxAllocs, bool resizable);
+	GPUMemoryPage(uint64_t size, int32_t maxAllocs) : Allocator(size, maxAllocs) {}
+
+	GraphicsMemoryBuffer *Buffer;
+	GraphicsMemoryBuffer *Staging = nullptr; // Created the first time a move overlaps itself
+	std::vector<MoveData> Moves; // Recorded during a defrag pass, copied once it ends
+	ListAllocator Allocator;
+};
+
+class GPUMemoryAllocator // Fixed-size pages with an allocator each, growing adds a page and never moves what is already placed
+{
+public:
+	XENGINEAPI GPUMemoryAllocator(uint64_t pageSize, int32_t maxAllocs, bool resizable); // Stays at one page if not resizable
+	XENGINEAPI GPUMemoryAllocator(GraphicsContext *context, uint64_t pageSize, int32_t maxAllocs, bool resizable); // On a context other than the display's, such as a headless one in tests
 	XENGINEAPI ~GPUMemoryAllocator();
 	XENGINEAPI bool WillFit(int32_t size);
 	XENGINEAPI PinnedGPUMemory GetMemory(ListMemoryPointer *ptr);
 	XENGINEAPI ListMemoryPointer *RequestSpace(int32_t bytes, int32_t alignment = 1);
-	XENGINEAPI GraphicsMemoryBuffer *GetMemoryBuffer();
 	XENGINEAPI void FreeSpace(ListMemoryPointer *ptr);
+	XENGINEAPI int32_t GetPageCount();
+	XENGINEAPI GraphicsMemoryBuffer *GetPageBuffer(int32_t page);
+	XENGINEAPI void SetDefragBudget(uint64_t bytesPerFrame, int32_t movesPerFrame); // Per page
+	XENGINEAPI void SetName(std::string name);
+	XENGINEAPI std::vector<ListAllocatorStats> GetStats(); // One per page
+
+	XENGINEAPI static std::vector<GPUBufferCopy> PlanMoves(std::vector<MoveData>& moves); // Copies in the order they must run, moves are given in the order the allocator made them
 private:
-	void DefragBegin();
-	void DefragEnd();
-	void MoveMemory(MoveData& data);
+	GPUMemoryPage *AddPage(uint64_t size); // Under an exclusive m_pageMutex
+	GPUMemoryPage *GetPage(ListMemoryPointer *ptr);
+	void DefragBegin(GPUMemoryPage *page);
+	void DefragEnd(GPUMemoryPage *page);
+	void MoveMemory(GPUMemoryPage *page, MoveData& data);
+	static void PlanRun(std::vector<GPUBufferCopy>& copies, uint64_t src, uint64_t dest, uint64_t size, int32_t& stagingChunks);
 	
-	std::shared_mutex m_resizeMutex;
+	std::shared_mutex m_pageMutex; // Exclusive only while a page is added
 
 	GraphicsContext *m_context;
 
-	GraphicsCommandBuffer *thisBuf;
-
-	GraphicsMemoryBuffer *m_memory;
-	GraphicsMemoryBuffer *m_temp;
-	uint64_t m_size;
-	int32_t m_tempSize;
-	ListAllocator m_allocator;
+	std::vector<std::unique_ptr<GPUMemoryPage>> m_pages; // Never removed, a page stays at its index
+	std::atomic_int32_t m_lastPage = 0; // Where the last allocation fit, tried first
+	uint64_t m_pageSize;
+	int32_t m_maxAllocs;
 	bool m_resizable;
+
+	std::string m_name = "GPU memory";
+	uint64_t m_defragBytes = 0;
+	int32_t m_defragMoves = 0;
 };
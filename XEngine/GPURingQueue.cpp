@@ -1,15 +1,35 @@
 #include "pch.h"
 #include "GPURingQueue.h"
+#include <bit>
 
-GPUUploadRingQueue::GPUUploadRingQueue(int32_t mipSize) : m_allocator(mipSize), m_size(mipSize)
+GPUUploadRingQueue::GPUUploadRingQueue(int32_t mipSize) : m_ring(mipSize)
 {
 	m_context = XEngineInstance->GetInterface<DisplayInterface>(HardwareInterfaceType::Display)->GetGraphicsContext();
 	m_mappedRingBuffer = m_context->CreateBuffer(mipSize, BufferUsageBit::TransferSource, GraphicsMemoryTypeBit::Coherent | GraphicsMemoryTypeBit::HostVisible);
-	m_mappedRingBuffer->MapBuffer(0, m_size, true, true);
+	m_mappedRingBuffer->MapBuffer(0, mipSize, true, true);
+	m_mapped = reinterpret_cast<char *>(m_mappedRingBuffer->GetMappedPointer());
 }
 
 GPUUploadRingQueue::~GPUUploadRingQueue()
 {
+	StagingRegion staging;
+	while (m_submitted.try_pop(staging))
+	{
+		if (staging.Dedicated)
+			m_dedicatedInFlight.push_back(staging);
+		else
+			m_inFlight[staging.Begin] = staging;
+	}
+	for (auto& pair : m_inFlight) // The GPU may still be reading from them
+		pair.second.Sync->Wait(1e12);
+	for (StagingRegion& dedicated : m_dedicatedInFlight)
+	{
+		dedicated.Sync->Wait(1e12);
+		DeleteDedicated(dedicated);
+	}
+	for (StagingRegion& pooled : m_dedicatedPool)
+		DeleteDedicated(pooled);
+
 	m_mappedRingBuffer->UnmapBuffer();
 	delete m_mappedRingBuffer;
 }
@@ -109,32 +129,123 @@ void GPUUploadRingQueue::CopyFromTo(ImageType type, void *dest, void *src, int32
 	}
 }
 
-int32_t GPUUploadRingQueue::PopUntilEmptyOrEnoughSize(int32_t mipSize)
+StagingRegion GPUUploadRingQueue::ReserveStaging(uint64_t size)
 {
-	int32_t loc = m_allocator.AllocateMemory(mipSize, 1, false);
-	while (loc < 0 && !m_tasks.empty())
+	RetireCompleted(false);
+
+	StagingRegion staging;
+	staging.Dedicated = size > m_ring.GetSize();
+	if (staging.Dedicated) // A buffer of its own instead of the ring being resized under everyone, pooled since large mips come in runs
 	{
-		GPUTransferTaskWithSync& task = m_tasks.front();
-		task.Sync->Wait(1e12);
-		m_allocator.Remove(task.Size, 1);
-		m_tasks.pop();
-		loc = m_allocator.AllocateMemory(mipSize, 1, false);
+		staging.Begin = staging.End = 0;
+		staging.Offset = 0;
+		staging.Capacity = std::bit_ceil(size);
+		{
+			std::lock_guard lock(m_dedicatedLock);
+			auto best = m_dedicatedPool.end();
+			for (auto iter = m_dedicatedPool.begin(); iter != m_dedicatedPool.end(); ++iter)
+			{
+				if (iter->Capacity >= staging.Capacity && (best == m_dedicatedPool.end() || iter->Capacity < best->Capacity))
+					best = iter;
+			}
+			if (best != m_dedicatedPool.end())
+			{
+				staging.Capacity = best->Capacity;
+				staging.Buffer = best->Buffer;
+				staging.Mapped = best->Mapped;
+				m_dedicatedPool.erase(best);
+				return staging;
+			}
+		}
+		staging.Buffer = m_context->CreateBuffer(staging.Capacity, BufferUsageBit::TransferSource, GraphicsMemoryTypeBit::Coherent | GraphicsMemoryTypeBit::HostVisible);
+		staging.Buffer->MapBuffer(0, staging.Capacity, true, true);
+		staging.Mapped = reinterpret_cast<char *>(staging.Buffer->GetMappedPointer());
+		return staging;
 	}
 
-	if (m_size <= mipSize)
+	RingReservation reservation = m_ring.Reserve(size, StagingAlignment);
+	while (reservation.Offset < 0)
 	{
-		m_size = mipSize;
-		m_allocator = RingAllocator(mipSize + 1);
-		m_mappedRingBuffer->UnmapBuffer();
-		delete m_mappedRingBuffer;
-		m_mappedRingBuffer = m_context->CreateBuffer(mipSize, BufferUsageBit::TransferSource, GraphicsMemoryTypeBit::Coherent | 
-			GraphicsMemoryTypeBit::HostVisible);
-		m_mappedRingBuffer->MapBuffer(0, m_size, true, true);
+		if (!RetireCompleted(true))
+			std::this_thread::yield(); // Another thread is retiring, or the oldest region is still being filled
+		reservation = m_ring.Reserve(size, StagingAlignment);
+	}
 
-		loc = m_allocator.AllocateMemory(mipSize, 1, false);
+	staging.Begin = reservation.Begin;
+	staging.End = reservation.End;
+	staging.Offset = reservation.Offset;
+	staging.Buffer = m_mappedRingBuffer;
+	staging.Mapped = m_mapped + reservation.Offset;
+	return staging;
+}
+
+std::shared_ptr<GraphicsSyncObject> GPUUploadRingQueue::SubmitStaging(GraphicsCommandBuffer *cmdBuffer, StagingRegion& staging)
+{
+	staging.Sync = std::shared_ptr<GraphicsSyncObject>(m_context->CreateSync(false));
+	cmdBuffer->SignalFence(staging.Sync.get());
+	m_submitted.push(staging);
+	return staging.Sync;
+}
+
+bool GPUUploadRingQueue::RetireCompleted(bool wait)
+{
+	std::unique_lock lock(m_retireLock, std::try_to_lock);
+	if (!lock.owns_lock())
+		return false;
+
+	StagingRegion staging;
+	while (m_submitted.try_pop(staging))
+	{
+		if (staging.Dedicated)
+			m_dedicatedInFlight.push_back(staging);
+		else
+			m_inFlight[staging.Begin] = staging;
 	}
 
-	return loc;
+	for (int32_t i = static_cast<int32_t>(m_dedicatedInFlight.size()) - 1; i >= 0; --i)
+	{
+		if (m_dedicatedInFlight[i].Sync->GetCurrentStatus())
+		{
+			RecycleDedicated(m_dedicatedInFlight[i]);
+			m_dedicatedInFlight.erase(m_dedicatedInFlight.begin() + i);
+		}
+	}
+
+	uint64_t tail = m_ring.GetTail();
+	bool released = false;
+	auto iter = m_inFlight.begin();
+	while (iter != m_inFlight.end() && iter->first == tail) // Regions tile the ring in order, a gap is one that is still being filled
+	{
+		GraphicsSyncObject *sync = iter->second.Sync.get();
+		if (!sync->GetCurrentStatus() && !(wait && sync->Wait(StagingWaitNanoseconds)))
+			break;
+		wait = false; // Waiting for the oldest is enough, later ones are only polled
+		tail = iter->second.End;
+		iter = m_inFlight.erase(iter);
+		released = true;
+	}
+
+	if (released)
+		m_ring.Release(tail);
+	return released;
+}
+
+void GPUUploadRingQueue::RecycleDedicated(StagingRegion& staging)
+{
+	std::lock_guard lock(m_dedicatedLock);
+	m_dedicatedPool.push_back(staging);
+	m_dedicatedPool.back().Sync.reset();
+	if (m_dedicatedPool.size() > DedicatedStagingPoolCount)
+	{
+		DeleteDedicated(m_dedicatedPool.front());
+		m_dedicatedPool.erase(m_dedicatedPool.begin());
+	}
+}
+
+void GPUUploadRingQueue::DeleteDedicated(StagingRegion& staging)
+{
+	staging.Buffer->UnmapBuffer();
+	delete staging.Buffer;
 }
 
 GPUDownloadRingQueue::GPUDownloadRingQueue(int32_t mipSize) : m_allocator(mipSize), m_size(mipSize)
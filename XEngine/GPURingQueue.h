@@ -6,87 +6,91 @@
 #include "GPUMemoryAllocator.h"
 #include "RingAllocator.h"
 #include "LocalMemoryAllocator.h"
+#include "ConcurrentQueue.h"
 
 #include <atomic>
 #include <mutex>
 #include <queue>
+#include <map>
+
+constexpr uint64_t StagingAlignment = 16; // Keeps buffer to image copies on texel boundaries
+constexpr uint64_t StagingWaitNanoseconds = 1000000; // A full ring waits this long per try, the oldest upload may not be submitted yet
+constexpr int32_t DedicatedStagingPoolCount = 4; // Retired buffers for uploads larger than the ring kept mapped for the next ones
 
 class GPUUploadRingQueue;
 
-class GPUTransferTaskWithSync
+class GPUDownloadTaskWithSync
 {
 public:
-	GPUTransferTaskWithSync(std::shared_ptr<GraphicsSyncObject> sync, int32_t size) : Sync(sync), Size(size) {}
+	GPUDownloadTaskWithSync(std::shared_ptr<GraphicsSyncObject> sync, void *dest, int32_t loc, int32_t size) : Sync(sync), Loc(loc), Size(size), Dest(dest) {}
 	std::shared_ptr<GraphicsSyncObject> Sync;
+	int32_t Loc;
+	void *Dest;
 	int32_t Size;
 };
 
-class GPUDownloadTaskWithSync
+class StagingRegion
 {
 public:
-	GPUDownloadTaskWithSync(std::shared_ptr<GraphicsSyncObject> sync, void *dest, int32_t loc, int32_t size) : Sync(sync), Loc(loc), Size(size), Dest(dest) {}
+	uint64_t Begin; // Ring positions, see RingReservation
+	uint64_t End;
+	int64_t Offset; // Into Buffer
+	char *Mapped; // Where the producer writes
+	GraphicsMemoryBuffer *Buffer;
+	bool Dedicated; // Too big for the ring, Buffer is taken from the dedicated pool and goes back to it once the upload retires
+	uint64_t Capacity; // Size of a dedicated Buffer, a power of two so buffers get reused by uploads of similar size
 	std::shared_ptr<GraphicsSyncObject> Sync;
-	int32_t Loc;
-	void *Dest;
-	int32_t Size;
 };
 
-class GPUUploadRingQueue
+class GPUUploadRingQueue // Uploaders reserve and fill staging space in parallel, finished regions are retired in ring order
 {
 public:
 	XENGINEAPI GPUUploadRingQueue(int32_t size);
 	XENGINEAPI ~GPUUploadRingQueue();
 	template<class T>
-	std::shared_ptr<GraphicsSyncObject> Upload(GraphicsCommandBuffer *cmdBuffer, T *src, PinnedGPUMemory dest,
+	std::shared_ptr<GraphicsSyncObject> Upload(GraphicsCommandBuffer *cmdBuffer, T *src, PinnedGPUMemory& dest,
 		int32_t srcOffset, int32_t destOffset, int32_t size)
 	{
-		std::lock_guard lock(m_ringMutex);
-
-		int32_t loc = PopUntilEmptyOrEnoughSize(size * sizeof(T));
+		StagingRegion staging = ReserveStaging(size * sizeof(T));
 
-		std::memcpy(reinterpret_cast<char *>(m_mappedRingBuffer->GetMappedPointer()) + loc, src + srcOffset, size * sizeof(T));
-		cmdBuffer->CopyBufferToBuffer(m_mappedRingBuffer, dest.GetBuffer(), loc, dest.GetPointer()->Pointer + destOffset, size * sizeof(T));
-		std::shared_ptr<GraphicsSyncObject> obj = std::shared_ptr<GraphicsSyncObject>(m_context->CreateSync(false));
-		cmdBuffer->SignalFence(obj.get());
-
-		m_tasks.push(GPUTransferTaskWithSync(obj, size * sizeof(T)));
-		return obj;
+		std::memcpy(staging.Mapped, src + srcOffset, size * sizeof(T)); // No lock held, other uploaders copy at the same time
+		cmdBuffer->CopyBufferToBuffer(staging.Buffer, dest.GetBuffer(), staging.Offset, dest.GetPointer()->Pointer + destOffset, size * sizeof(T));
+		return SubmitStaging(cmdBuffer, staging);
 	}
 
 	template<class T>
 	std::shared_ptr<GraphicsSyncObject> Upload(GraphicsCommandBuffer *cmdBuffer, T *src, ImageType type, GraphicsImageObject *dest,
 		GraphicsBufferImageCopyRegion region, int32_t size, VectorDataFormat format)
 	{
-		std::lock_guard lock(m_ringMutex);
-
-		int32_t loc = PopUntilEmptyOrEnoughSize(size * sizeof(T));
+		StagingRegion staging = ReserveStaging(size * sizeof(T));
 		
 		int32_t bpp = size / (region.Size.x * region.Size.y * region.Size.z);
-		CopyFromTo(type, reinterpret_cast<char *>(m_mappedRingBuffer->GetMappedPointer()) + loc, src + region.BufferOffset, size * sizeof(T),
-			bpp, region.Size);
-		region.BufferOffset = loc;
-		cmdBuffer->CopyBufferToImageWithConversion(m_mappedRingBuffer, format, dest, { region });
-		std::shared_ptr<GraphicsSyncObject> obj = std::shared_ptr<GraphicsSyncObject>(m_context->CreateSync(false));
-		cmdBuffer->SignalFence(obj.get());
-
-		m_tasks.push(GPUTransferTaskWithSync(obj, size * sizeof(T)));
-
-		return obj;
+		CopyFromTo(type, staging.Mapped, src + region.BufferOffset, size * sizeof(T), bpp, region.Size);
+		region.BufferOffset = staging.Offset;
+		cmdBuffer->CopyBufferToImageWithConversion(staging.Buffer, format, dest, { region });
+		return SubmitStaging(cmdBuffer, staging);
 	}
 
 	void CopyFromTo(ImageType type, void *dest, void *src, int32_t dataSize, int32_t bytesPerPixel, glm::ivec3 mipSize);
 private:
-	GraphicsContext *m_context;
+	XENGINEAPI StagingRegion ReserveStaging(uint64_t size); // Only waits if the ring is full
+	XENGINEAPI std::shared_ptr<GraphicsSyncObject> SubmitStaging(GraphicsCommandBuffer *cmdBuffer, StagingRegion& staging); // Fences the copies recorded so far and hands the region to the retiring thread
+	bool RetireCompleted(bool wait); // True if space was released, does nothing while another thread is retiring
+	void RecycleDedicated(StagingRegion& staging);
+	void DeleteDedicated(StagingRegion& staging);
 
-	XENGINEAPI int32_t PopUntilEmptyOrEnoughSize(int32_t size);
-	std::mutex m_ringMutex;
+	GraphicsContext *m_context;
 
-	RingAllocator m_allocator;
+	ConcurrentRingAllocator m_ring;
 	GraphicsMemoryBuffer *m_mappedRingBuffer;
-
-	std::queue<GPUTransferTaskWithSync> m_tasks;
-
-	int32_t m_size;
+	char *m_mapped;
+
+	ConcurrentQueue<StagingRegion> m_submitted;
+	std::mutex m_retireLock; // Only ever try-locked
+	std::map<uint64_t, StagingRegion> m_inFlight; // By ring position, only touched under m_retireLock
+	std::vector<StagingRegion> m_dedicatedInFlight;
+	std::mutex m_dedicatedLock;
+	std::vector<StagingRegion> m_dedicatedPool; // Oldest first, the oldest is deleted when a retired buffer would overfill it
 };
 
 class GPUDownloadRingQueue
@@ -96,7 +100,7 @@ public:
 	XENGINEAPI ~GPUDownloadRingQueue();
 
 	template<class T>
-	std::shared_ptr<GraphicsSyncObject> Download(GraphicsCommandBuffer *cmdBuffer, PinnedGPUMemory src, int32_t srcByteOffset,
+	std::shared_ptr<GraphicsSyncObject> Download(GraphicsCommandBuffer *cmdBuffer, PinnedGPUMemory& src, int32_t srcByteOffset,
 		T *dest, int32_t destOffset, int32_t size)
 	{
 		std::lock_guard lock(m_ringMutex);
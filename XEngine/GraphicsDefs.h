@@ -3,6 +3,7 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include <string>
+#include <functional>
 
 class DisposableHandle
 {
@@ -45,6 +46,7 @@ public:
 	virtual bool Wait(uint64_t nanoSecTimeout) = 0;
 	virtual void Reset() = 0;
 	virtual bool GetCurrentStatus() = 0;
+	virtual void AddSignalCallback(std::function<void()> callback) = 0; // Called once when signaled, right away if it already is
 };
 
 class GraphicsImageObject
@@ -1,92 +1,119 @@
 #include "pch.h"
 #include "ListAllocator.h"
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+std::mutex listAllocatorRegistryMutex;
+std::vector<ListAllocator *> listAllocatorRegistry; // Every live allocator, for stats and the per-frame defrag pass
 
 ListAllocator::ListAllocator(uint64_t size, int32_t maxAllocs)
 {
 	m_maxSize = size;
-	m_pointer = 0;
 	m_maxHeaders = maxAllocs;
-	m_freeSpace = size;
+	m_freeSpace = 0;
+
+	m_headerLimit = static_cast<size_t>(maxAllocs) * 2 + 1; // Free blocks never touch, so there is at most one more of them than allocations
 
-	m_headerLinks.resize(maxAllocs);
-	for (int32_t i = 0; i < maxAllocs; ++i)
-		m_freeList.push(i);
+	Resize(size);
+
+	std::lock_guard lock(listAllocatorRegistryMutex);
+	listAllocatorRegistry.push_back(this);
 }
 
 ListAllocator::~ListAllocator()
 {
+	{
+		std::lock_guard lock(listAllocatorRegistryMutex);
+		listAllocatorRegistry.erase(std::find(listAllocatorRegistry.begin(), listAllocatorRegistry.end(), this));
+	}
+	std::lock_guard defragLock(m_defragLock); // A budgeted step that got hold of this allocator while it was registered finishes first
 }
 
 ListMemoryPointer *ListAllocator::AllocateMemory(int32_t size, int32_t alignment)
 {
-	std::lock_guard lock0(m_allocLock);
-	//std::shared_lock lock1(m_defragLock);
+	if (ListMemoryPointer *ptr = TryAllocateMemory(size, alignment))
+		return ptr;
 
-	int32_t alignmentPad = m_pointer % alignment;
-	uint64_t thisPtr = m_pointer + alignmentPad;
-	uint64_t newPtr = thisPtr + size;
+	Defragment(); // The free space is too scattered, or there is not enough of it
+	if (ListMemoryPointer *ptr = TryAllocateMemory(size, alignment))
+		return ptr;
 
-	if (newPtr >= m_maxSize)
+	int32_t failures = ++m_failedAllocations;
+	if ((failures & (failures - 1)) == 0) // Backs off, a full arena tends to fail every frame
 	{
-		Defragment();
-		alignmentPad = m_pointer % alignment;
-		thisPtr = m_pointer + alignmentPad;
-		newPtr = thisPtr + size;
-		if (newPtr >= m_maxSize)
-			return nullptr;
+		ListAllocatorStats stats = GetStats();
+		XEngine::LogAnywhere("ListAllocator " + stats.Name + ": allocating " + std::to_string(size) + " bytes failed (" + std::to_string(failures) + " failures), " +
+			std::to_string(stats.Allocations) + " of " + std::to_string(stats.MaxAllocations) + " headers used, " + std::to_string(stats.FreeBytes) + " bytes free, largest free block " +
+			std::to_string(stats.LargestFreeBlock), LogMessageType::Warning);
 	}
+	return nullptr;
+}
 
-	int32_t index = 0;
-	if (!m_freeList.try_pop(index))
+ListMemoryPointer *ListAllocator::TryAllocateMemory(int32_t size, int32_t alignment)
+{
+	std::lock_guard lock(m_allocLock);
+	if (m_allocations >= m_maxHeaders)
 		return nullptr;
+	ListEntryHeader *h = AllocateBlock(size, alignment);
+	if (h && m_trace) // Header indices are reused only after a free, so they identify the allocation within the trace
+		*m_trace << "a " << h->Index << ' ' << size << ' ' << alignment << '\n';
+	return h;
+}
 
-	m_freeSpace -= alignmentPad + size;
+ListEntryHeader *ListAllocator::AllocateBlock(int32_t size, int32_t alignment)
+{
+	uint64_t needed = std::max<uint64_t>(static_cast<uint64_t>(size) + alignment - 1, 1); // Enough for the worst case padding
+	ListEntryHeader *h = FindFreeBlock(needed);
+	if (!h)
+		return nullptr;
+	RemoveFreeBlock(h);
 
-	if (!m_first)
+	uint64_t start = h->Pointer;
+	uint64_t aligned = (start + alignment - 1) / alignment * alignment;
+	if (aligned + size > m_backedSize && (m_backedSize = m_back(aligned + size)) < aligned + size)
 	{
-		m_first = m_last = &m_headerLinks[index];
-		m_first->Pointer = thisPtr;
-		m_first->Alignment = alignment;
-		m_first->Prev = nullptr;
-		m_first->Next = nullptr;
-		m_first->Size = size;
-		m_first->Index = index;
-		m_first->Padding = alignmentPad;
-		m_first->Pinned = false;
-	}
-	else
-	{
-		ListEntryHeader *h = &m_headerLinks[index];
-		h->Pointer = thisPtr;
-		h->Alignment = alignment;
-		h->Prev = m_last;
-		h->Next = nullptr;
-		h->Size = size;
-		h->Index = index;
-		h->Padding = alignmentPad;
-		h->Pinned = false;
-		m_last->Next = h;
-		m_last = h;
+		InsertFreeBlock(h); // The backing could not grow
+		return nullptr;
 	}
 
-	m_pointer = newPtr;
-
-	return dynamic_cast<ListMemoryPointer *>(m_last);
+	h->Padding = aligned - start;
+	h->Pointer = aligned;
+	h->Size = size;
+	h->Alignment = alignment;
+	h->Page = m_page;
+	h->PinCount.store(0, std::memory_order_relaxed);
+	h->Free = false;
+	SplitBlock(h, h->Padding + h->Size);
+
+	m_freeSpace -= h->BlockSize;
+	++m_allocations;
+	++m_sizeHistogram[GetHistogramBucket(size)];
+	m_highWaterBytes = std::max(m_highWaterBytes, m_maxSize - m_freeSpace);
+	return h;
 }
 
 void ListAllocator::DeallocateMemory(ListMemoryPointer *ptr)
 {
-	UnpinMemoryUnmanaged(ptr);
-
-	m_defragLock.lock_shared();
 	ListEntryHeader *h = static_cast<ListEntryHeader *>(ptr);
-	if (h->Prev)
-		h->Prev->Next = h->Next;
-	if (h->Next)
-		h->Next->Prev = h->Prev;
-	m_freeList.push(h->Index);
-	m_freeSpace += h->Size + h->Padding;
-	m_defragLock.unlock_shared();
+	ClaimEntry(h); // Not while the entry is being moved, pins still held are dropped
+
+	std::lock_guard lock(m_allocLock);
+	if (m_trace)
+		*m_trace << "f " << h->Index << '\n';
+	m_freeSpace += h->BlockSize;
+	--m_allocations;
+	--m_sizeHistogram[GetHistogramBucket(h->Size)];
+
+	h->Pointer -= h->Padding;
+	h->Padding = 0;
+	h->Size = 0;
+	h->Free = true;
+	h = MergeFreeNeighbours(h);
+	InsertFreeBlock(h); // The hole is reused by the next allocation that fits
+	if (h == m_last)
+		TrimBacking();
 }
 
 int32_t ListAllocator::GetAllocationSize(ListMemoryPointer *ptr)
@@ -97,40 +124,65 @@ int32_t ListAllocator::GetAllocationSize(ListMemoryPointer *ptr)
 
 void ListAllocator::ShrinkToFit(int32_t extraMemory)
 {
-	m_maxSize = m_pointer + static_cast<uint64_t>(extraMemory) + 1;
+	std::lock_guard lock(m_allocLock);
+	Resize(GetUsedEnd() + extraMemory);
 }
 
 void ListAllocator::SetSize(uint64_t maxSize)
 {
-	m_maxSize = maxSize;
+	std::lock_guard lock(m_allocLock);
+	Resize(maxSize);
 }
 
-std::shared_ptr<PinnedListMemory> ListAllocator::PinMemory(ListMemoryPointer *ptr)
+PinnedListMemory ListAllocator::PinMemory(ListMemoryPointer *ptr)
 {
 	PinMemoryUnmanaged(ptr);
-	return std::make_shared<PinnedListMemory>(this, ptr);
+	return PinnedListMemory(this, ptr);
 }
 
 void ListAllocator::PinMemoryUnmanaged(ListMemoryPointer *ptr)
 {
-	m_defragLock.lock_shared();
 	ListEntryHeader *h = static_cast<ListEntryHeader *>(ptr);
-	h->Pinned = true;
-	m_defragLock.unlock_shared();
+	int32_t count = h->PinCount.load(std::memory_order_relaxed);
+	while (true)
+	{
+		if (count < 0) // Being moved, which takes at most one defragment step
+		{
+			std::this_thread::yield();
+			count = h->PinCount.load(std::memory_order_relaxed);
+		}
+		else if (h->PinCount.compare_exchange_weak(count, count + 1, std::memory_order_acquire)) // Sees the data and Pointer a move left behind
+			break;
+	}
 }
 
 void ListAllocator::UnpinMemoryUnmanaged(ListMemoryPointer *ptr)
 {
 	ListEntryHeader *h = static_cast<ListEntryHeader *>(ptr);
-	h->Pinned = false;
+	h->PinCount.fetch_sub(1, std::memory_order_release); // Writes made while pinned happen before any later move
+}
+
+void ListAllocator::ClaimEntry(ListEntryHeader *h)
+{
+	int32_t count = h->PinCount.load(std::memory_order_relaxed);
+	while (true)
+	{
+		if (count < 0)
+		{
+			std::this_thread::yield();
+			count = h->PinCount.load(std::memory_order_relaxed);
+		}
+		else if (h->PinCount.compare_exchange_weak(count, -1, std::memory_order_acquire))
+			break;
+	}
 }
 
-int32_t ListAllocator::GetMaxSize()
+uint64_t ListAllocator::GetMaxSize()
 {
 	return m_maxSize;
 }
 
-int32_t ListAllocator::GetFreeSpace()
+uint64_t ListAllocator::GetFreeSpace()
 {
 	return m_freeSpace;
 }
@@ -150,61 +202,570 @@ void ListAllocator::SetDefragEndCallback(std::function<void()> end)
 	m_defragEnd = end;
 }
 
+void ListAllocator::SetBackingCallback(std::function<uint64_t(uint64_t)> back)
+{
+	std::lock_guard lock(m_allocLock);
+	m_back = back;
+	m_backedSize = m_back(GetUsedEnd());
+}
+
+bool ListAllocator::DefragmentStep(uint64_t maxBytes, int32_t maxMoves)
+{
+	std::lock_guard defragLock(m_defragLock);
+	return StepLocked(maxBytes, maxMoves);
+}
+
+bool ListAllocator::StepLocked(uint64_t maxBytes, int32_t maxMoves)
+{
+	auto stepStart = std::chrono::steady_clock::now();
+
+	bool begun = false;
+	uint64_t bytes = 0;
+	uint64_t freed = 0;
+	std::vector<ListEntryHeader *> moved; // Stay claimed until the copies are submitted, a pin would see the new Pointer before the data
+	std::vector<ListEntryHeader *> vacated; // Stay reserved until the copies are submitted, an allocation would overwrite data not copied yet
+	ListEntryHeader *hole = nullptr; // Reserved, the next allocation behind it moves in if it can
+	ListEntryHeader *from = nullptr; // Where the search for the next hole goes on, an entry that stays claimed
+	for (int32_t moves = 0; moves < maxMoves; ++moves)
+	{
+		ListEntryHeader *h;
+		{
+			std::lock_guard lock(m_allocLock);
+			if (!hole || !CanMoveInto(hole, maxBytes - bytes, true))
+			{
+				if (hole)
+					vacated.push_back(hole);
+				hole = FindDefragHole(hole ? hole : from ? from : m_first, maxBytes - bytes, true);
+				if (!hole)
+					break;
+				RemoveFreeBlock(hole);
+				ReserveBlock(hole);
+			}
+			h = hole->Next;
+		}
+
+		uint64_t start = hole->Pointer;
+		uint64_t aligned = (start + h->Alignment - 1) / h->Alignment * h->Alignment;
+		MoveData mv;
+		mv.SrcIndex = h->Pointer;
+		mv.DestIndex = aligned;
+		mv.Size = h->Size;
+		if (!begun)
+		{
+			m_defragBegin();
+			begun = true;
+		}
+		m_move(mv); // Nothing else can reach the entry, pins and frees wait for the claim on it
+		bytes += h->Size;
+		moved.push_back(h);
+
+		std::lock_guard lock(m_allocLock);
+		uint64_t end = h->Pointer - h->Padding + h->BlockSize;
+		uint64_t oldSize = h->BlockSize;
+		h->Padding = aligned - start;
+		h->Pointer = aligned;
+		h->BlockSize = h->Padding + h->Size;
+		freed += oldSize - h->BlockSize;
+
+		RemoveBlock(hole); // The hole moves up behind the entry
+		if (end == start + h->BlockSize)
+		{
+			hole = nullptr;
+			from = h;
+			continue;
+		}
+		hole = AddBlock(h, start + h->BlockSize, end - (start + h->BlockSize));
+		ReserveBlock(hole);
+		if (hole->Next && hole->Next->Free) // Free space behind it joins the hole, it is not in use anyway
+		{
+			ListEntryHeader *next = hole->Next;
+			RemoveFreeBlock(next);
+			hole->BlockSize += next->BlockSize;
+			RemoveBlock(next);
+		}
+	}
+	if (hole)
+		vacated.push_back(hole);
+
+	if (begun)
+		m_defragEnd();
+
+	bool more;
+	{
+		std::lock_guard lock(m_allocLock);
+		for (ListEntryHeader *h : moved)
+			h->PinCount.store(0, std::memory_order_release);
+		for (ListEntryHeader *h : vacated)
+		{
+			h->Free = true;
+			h->PinCount.store(0, std::memory_order_relaxed);
+			InsertFreeBlock(MergeFreeNeighbours(h));
+		}
+		m_freeSpace += freed;
+		more = FindDefragHole(m_first, maxBytes, false) != nullptr;
+		TrimBacking();
+	}
+	if (begun)
+	{
+		++m_defragmentSteps;
+		m_bytesMoved += bytes;
+		m_defragmentNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stepStart).count();
+	}
+	return more;
+}
+
+void ListAllocator::SetDefragBudget(uint64_t bytesPerFrame, int32_t movesPerFrame)
+{
+	std::lock_guard lock(listAllocatorRegistryMutex);
+	m_defragBytes = bytesPerFrame;
+	m_defragMoves = movesPerFrame;
+}
+
+void ListAllocator::RunDefragBudgets()
+{
+	std::vector<ListAllocator *> allocators;
+	{
+		std::lock_guard lock(listAllocatorRegistryMutex); // Not held while stepping, creating and destroying allocators does not wait for the whole pass
+		allocators = listAllocatorRegistry;
+	}
+
+	for (ListAllocator *allocator : allocators)
+	{
+		uint64_t bytes;
+		int32_t moves;
+		{
+			std::lock_guard lock(listAllocatorRegistryMutex);
+			if (std::find(listAllocatorRegistry.begin(), listAllocatorRegistry.end(), allocator) == listAllocatorRegistry.end()) // Destroyed since the copy
+				continue;
+			bytes = allocator->m_defragBytes;
+			moves = allocator->m_defragMoves;
+			if (bytes == 0 || moves == 0 || !allocator->m_defragLock.try_lock()) // Busy with a pass of its own, it gets a step next frame
+				continue;
+		}
+		std::lock_guard defragLock(allocator->m_defragLock, std::adopt_lock); // Held before unregistering could go through, so the destructor waits for it
+		allocator->StepLocked(bytes, moves);
+	}
+}
+
+void ListAllocator::SetName(std::string name)
+{
+	std::lock_guard lock(m_allocLock);
+	m_name = name;
+}
+
+void ListAllocator::SetPage(int32_t page)
+{
+	std::lock_guard lock(m_allocLock);
+	m_page = page;
+}
+
+void ListAllocator::RecordTrace(std::string path)
+{
+	std::lock_guard lock(m_allocLock);
+	m_trace.reset();
+	if (path.empty())
+		return;
+	m_trace = std::make_unique<std::ofstream>(path, std::ios::out | std::ios::trunc);
+	*m_trace << "s " << m_maxSize << ' ' << m_maxHeaders << '\n'; // Allocations already live are not in the trace, record from creation to replay exactly
+}
+
+ListAllocatorStats ListAllocator::GetStats()
+{
+	std::lock_guard lock(m_allocLock);
+
+	ListAllocatorStats stats;
+	stats.Name = m_name;
+	stats.Size = m_maxSize;
+	stats.BackedBytes = std::min(m_backedSize, m_maxSize);
+	stats.FreeBytes = m_freeSpace;
+	stats.LiveBytes = m_maxSize - stats.FreeBytes;
+	stats.HighWaterBytes = m_highWaterBytes;
+	stats.LargestFreeBlock = GetLargestFreeBlock();
+	stats.Fragmentation = stats.FreeBytes > 0 ? 1.f - static_cast<float>(stats.LargestFreeBlock) / stats.FreeBytes : 0.f;
+	stats.Allocations = m_allocations;
+	stats.MaxAllocations = m_maxHeaders;
+	stats.FailedAllocations = m_failedAllocations;
+	stats.Defragments = m_defragments;
+	stats.DefragmentSteps = m_defragmentSteps;
+	stats.BytesMoved = m_bytesMoved;
+	stats.DefragmentTime = m_defragmentNanoseconds * 1e-9;
+	std::copy(std::begin(m_sizeHistogram), std::end(m_sizeHistogram), stats.SizeHistogram);
+	return stats;
+}
+
+std::vector<ListAllocatorStats> ListAllocator::GetAllStats()
+{
+	std::lock_guard lock(listAllocatorRegistryMutex);
+
+	std::vector<ListAllocatorStats> stats;
+	stats.reserve(listAllocatorRegistry.size());
+	for (ListAllocator *allocator : listAllocatorRegistry)
+		stats.push_back(allocator->GetStats());
+	return stats;
+}
+
+uint64_t ListAllocator::GetLargestFreeBlock()
+{
+	if (!m_firstLevelMap)
+		return 0;
+
+	int32_t first = std::bit_width(m_firstLevelMap) - 1; // The largest block is somewhere in the highest non-empty class
+	int32_t second = std::bit_width(m_secondLevelMaps[first]) - 1;
+	uint64_t largest = 0;
+	for (ListEntryHeader *h = m_freeBlocks[first][second]; h; h = h->NextFree)
+		largest = std::max(largest, h->BlockSize);
+	return largest;
+}
+
+int32_t ListAllocator::GetHistogramBucket(uint64_t size)
+{
+	return std::min<int32_t>(std::bit_width(std::max<uint64_t>(size, 1) - 1), ListHistogramBuckets - 1);
+}
+
+ListEntryHeader *ListAllocator::FindDefragHole(ListEntryHeader *from, uint64_t maxBytes, bool claim)
+{
+	for (ListEntryHeader *h = from; h; h = h->Next)
+	{
+		if (h->Free && CanMoveInto(h, maxBytes, claim))
+			return h;
+	}
+	return nullptr;
+}
+
+bool ListAllocator::CanMoveInto(ListEntryHeader *hole, uint64_t maxBytes, bool claim)
+{
+	ListEntryHeader *next = hole->Next;
+	if (!next || next->Free || next->Size > maxBytes) // Allocations over the budget wait for a full defragment
+		return false;
+	uint64_t aligned = (hole->Pointer + next->Alignment - 1) / next->Alignment * next->Alignment;
+	if (aligned >= next->Pointer)
+		return false;
+
+	int32_t unpinned = 0; // Reserved blocks hold -1 as well, so they are never taken for an allocation
+	return claim ? next->PinCount.compare_exchange_strong(unpinned, -1, std::memory_order_acquire) : next->PinCount.load(std::memory_order_relaxed) == 0;
+}
+
+void ListAllocator::ReserveBlock(ListEntryHeader *h)
+{
+	h->Free = false;
+	h->PinCount.store(-1, std::memory_order_relaxed);
+}
+
+uint64_t ListAllocator::GetUsedEnd()
+{
+	return m_last && m_last->Free ? m_last->Pointer : m_maxSize;
+}
+
+void ListAllocator::TrimBacking()
+{
+	if (m_back && GetUsedEnd() < m_backedSize)
+		m_backedSize = m_back(GetUsedEnd());
+}
+
 void ListAllocator::Defragment()
 {
 	m_defragLock.lock();
+	auto defragStart = std::chrono::steady_clock::now();
 	m_defragBegin();
+	std::unique_lock lock(m_allocLock);
 
+	ClearFreeLists();
 	uint64_t pointer = 0;
+	uint64_t freeSpace = 0; // Slack that allocations carried is handed back as well
+	uint64_t bytesMoved = 0;
+	std::vector<ListEntryHeader *> moved; // Claimed until the copies are submitted
 
 	MoveData mv;
-	for (ListEntryHeader *h = m_first; h->Next != nullptr; h = h->Next)
+	ListEntryHeader *h = m_first;
+	while (h)
 	{
-		if (h->Pinned)
+		ListEntryHeader *next = h->Next;
+		if (h->Free) // Rebuilt from the gaps afterwards
 		{
-			pointer = h->Pointer + h->Size;
+			RemoveBlock(h);
+			h = next;
 			continue;
 		}
-		mv.SrcIndex = h->Pointer;
-		mv.Size = h->Size;
 
-		int32_t alignmentPad = pointer % h->Alignment;
-		uint64_t thisPtr = pointer + alignmentPad;
-		uint64_t newPtr = thisPtr + h->Size;
+		uint64_t start = h->Pointer - h->Padding;
+		int32_t unpinned = 0;
+		if (!h->PinCount.compare_exchange_strong(unpinned, -1, std::memory_order_acquire)) // Pinned or being freed, stays in place and allocations behind it still move down to it
+		{
+			if (pointer < start)
+			{
+				InsertFreeBlock(AddBlock(h->Prev, pointer, start - pointer));
+				freeSpace += start - pointer;
+			}
+			pointer = start + h->BlockSize;
+			h = next;
+			continue;
+		}
 
-		h->Pointer = thisPtr;
-		h->Padding = alignmentPad;
+		uint64_t aligned = (pointer + h->Alignment - 1) / h->Alignment * h->Alignment;
+		mv.SrcIndex = h->Pointer;
+		mv.DestIndex = aligned;
+		mv.Size = h->Size;
 
-		mv.DestIndex = h->Pointer = thisPtr;
-		pointer = newPtr;
+		h->Padding = aligned - pointer;
+		h->Pointer = aligned;
+		h->BlockSize = h->Padding + h->Size;
+		pointer += h->BlockSize;
 
 		if (mv.SrcIndex != mv.DestIndex)
+		{
 			m_move(mv);
+			bytesMoved += mv.Size;
+		}
+		moved.push_back(h);
+		h = next;
 	}
-	m_pointer = pointer;
-
-	m_defragEnd();
+	if (pointer < m_maxSize)
+	{
+		InsertFreeBlock(AddBlock(m_last, pointer, m_maxSize - pointer));
+		freeSpace += m_maxSize - pointer;
+	}
+	m_freeSpace = freeSpace;
+	TrimBacking();
+
+	m_defragEnd(); // Still under m_allocLock, nothing may be allocated over data that is not copied yet
+	for (ListEntryHeader *entry : moved)
+		entry->PinCount.store(0, std::memory_order_release);
+	lock.unlock();
+	++m_defragments;
+	m_bytesMoved += bytesMoved;
+	m_defragmentNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - defragStart).count();
 	m_defragLock.unlock();
 }
 
-PinnedListMemory::PinnedListMemory(ListAllocator *allocator, ListMemoryPointer *ptr) : m_allocator(allocator), m_ptr(ptr), m_unpinned(false)
+void ListAllocator::Resize(uint64_t maxSize)
+{
+	if (m_last && m_last->Free) // Grow or shrink the trailing free block
+	{
+		ListEntryHeader *tail = m_last;
+		RemoveFreeBlock(tail);
+		m_freeSpace -= tail->BlockSize;
+		if (maxSize > tail->Pointer)
+		{
+			tail->BlockSize = maxSize - tail->Pointer;
+			m_freeSpace += tail->BlockSize;
+			InsertFreeBlock(tail);
+		}
+		else
+		{
+			maxSize = tail->Pointer; // Allocations are never cut off
+			RemoveBlock(tail);
+		}
+	}
+	else
+	{
+		uint64_t end = m_last ? m_last->Pointer - m_last->Padding + m_last->BlockSize : 0;
+		if (maxSize > end)
+		{
+			ListEntryHeader *tail = AddBlock(m_last, end, maxSize - end);
+			m_freeSpace += tail->BlockSize;
+			InsertFreeBlock(tail);
+		}
+		else
+			maxSize = end;
+	}
+	m_maxSize = maxSize;
+}
+
+void ListAllocator::MapSize(uint64_t size, int32_t& first, int32_t& second)
 {
+	if (size < ListSecondLevelCount) // Small sizes get a class each
+	{
+		first = 0;
+		second = size;
+		return;
+	}
+	int32_t bit = std::bit_width(size) - 1;
+	first = bit - ListSecondLevelBits + 1;
+	second = (size >> (bit - ListSecondLevelBits)) - ListSecondLevelCount; // The bits right below the top one
 }
 
-PinnedListMemory::~PinnedListMemory()
+ListEntryHeader *ListAllocator::FindFreeBlock(uint64_t size)
 {
-	if (!m_unpinned)
+	int32_t first, second;
+	MapSize(size, first, second);
+	int32_t ownFirst = first, ownSecond = second;
+
+	uint64_t larger = size + (size >= ListSecondLevelCount ? 1ull << (std::bit_width(size) - 1 - ListSecondLevelBits) : 1); // Every block from the next class on fits
+	MapSize(larger, first, second);
+
+	uint32_t secondMap = first < ListFirstLevelCount ? m_secondLevelMaps[first] & (~0u << second) : 0;
+	if (!secondMap)
 	{
-		m_unpinned = true;
-		m_allocator->UnpinMemoryUnmanaged(m_ptr);
+		uint64_t firstMap = first + 1 < ListFirstLevelCount ? m_firstLevelMap & (~0ull << (first + 1)) : 0;
+		if (firstMap)
+		{
+			first = std::countr_zero(firstMap);
+			secondMap = m_secondLevelMaps[first];
+		}
 	}
+	if (secondMap)
+		return m_freeBlocks[first][std::countr_zero(secondMap)];
+
+	for (ListEntryHeader *fit = m_freeBlocks[ownFirst][ownSecond]; fit; fit = fit->NextFree) // Blocks of the request's own class may still be large enough
+		if (fit->BlockSize >= size)
+			return fit;
+	return nullptr;
+}
+
+void ListAllocator::InsertFreeBlock(ListEntryHeader *h)
+{
+	int32_t first, second;
+	MapSize(h->BlockSize, first, second);
+
+	h->PrevFree = nullptr;
+	h->NextFree = m_freeBlocks[first][second];
+	if (h->NextFree)
+		h->NextFree->PrevFree = h;
+	m_freeBlocks[first][second] = h;
+	m_secondLevelMaps[first] |= 1u << second;
+	m_firstLevelMap |= 1ull << first;
+}
+
+void ListAllocator::RemoveFreeBlock(ListEntryHeader *h)
+{
+	int32_t first, second;
+	MapSize(h->BlockSize, first, second);
+
+	if (h->PrevFree)
+		h->PrevFree->NextFree = h->NextFree;
+	else
+		m_freeBlocks[first][second] = h->NextFree;
+	if (h->NextFree)
+		h->NextFree->PrevFree = h->PrevFree;
+
+	if (!m_freeBlocks[first][second])
+	{
+		m_secondLevelMaps[first] &= ~(1u << second);
+		if (!m_secondLevelMaps[first])
+			m_firstLevelMap &= ~(1ull << first);
+	}
+}
+
+void ListAllocator::SplitBlock(ListEntryHeader *h, uint64_t used)
+{
+	if (h->BlockSize - used < ListMinBlockSize || (m_freeHeaders.empty() && m_headerLinks.size() >= m_headerLimit))
+		return;
+
+	uint64_t start = h->Pointer - h->Padding;
+	ListEntryHeader *rest = AddBlock(h, start + used, h->BlockSize - used);
+	h->BlockSize = used;
+	InsertFreeBlock(MergeFreeNeighbours(rest));
+}
+
+ListEntryHeader *ListAllocator::MergeFreeNeighbours(ListEntryHeader *h)
+{
+	if (h->Next && h->Next->Free)
+	{
+		ListEntryHeader *next = h->Next;
+		RemoveFreeBlock(next);
+		h->BlockSize += next->BlockSize;
+		RemoveBlock(next);
+	}
+	if (h->Prev && h->Prev->Free)
+	{
+		ListEntryHeader *prev = h->Prev;
+		RemoveFreeBlock(prev);
+		prev->BlockSize += h->BlockSize;
+		RemoveBlock(h);
+		h = prev;
+	}
+	return h;
+}
+
+ListEntryHeader *ListAllocator::AddBlock(ListEntryHeader *after, uint64_t start, uint64_t size)
+{
+	int32_t index;
+	if (m_freeHeaders.empty())
+	{
+		index = m_headerLinks.size();
+		m_headerLinks.emplace_back();
+	}
+	else
+	{
+		index = m_freeHeaders.back();
+		m_freeHeaders.pop_back();
+	}
+
+	ListEntryHeader *h = &m_headerLinks[index];
+	h->Index = index;
+	h->Pointer = start;
+	h->Padding = 0;
+	h->Size = 0;
+	h->BlockSize = size;
+	h->Alignment = 1;
+	h->PinCount.store(0, std::memory_order_relaxed);
+	h->Free = true;
+
+	h->Prev = after;
+	h->Next = after ? after->Next : m_first;
+	if (h->Prev)
+		h->Prev->Next = h;
+	else
+		m_first = h;
+	if (h->Next)
+		h->Next->Prev = h;
+	else
+		m_last = h;
+	return h;
+}
+
+void ListAllocator::RemoveBlock(ListEntryHeader *h)
+{
+	if (h->Prev)
+		h->Prev->Next = h->Next;
+	else
+		m_first = h->Next;
+	if (h->Next)
+		h->Next->Prev = h->Prev;
+	else
+		m_last = h->Prev;
+	m_freeHeaders.push_back(h->Index);
+}
+
+void ListAllocator::ClearFreeLists()
+{
+	m_firstLevelMap = 0;
+	std::fill(std::begin(m_secondLevelMaps), std::end(m_secondLevelMaps), 0);
+	for (auto& classes : m_freeBlocks)
+		std::fill(std::begin(classes), std::end(classes), nullptr);
+}
+
+PinnedListMemory::PinnedListMemory(ListAllocator *allocator, ListMemoryPointer *ptr) : m_allocator(allocator), m_ptr(ptr)
+{
+}
+
+PinnedListMemory::PinnedListMemory(PinnedListMemory&& other) : m_allocator(other.m_allocator), m_ptr(other.m_ptr)
+{
+	other.m_allocator = nullptr;
+}
+
+PinnedListMemory& PinnedListMemory::operator=(PinnedListMemory&& other)
+{
+	if (this != &other)
+	{
+		Unpin();
+		m_allocator = other.m_allocator;
+		m_ptr = other.m_ptr;
+		other.m_allocator = nullptr;
+	}
+	return *this;
+}
+
+PinnedListMemory::~PinnedListMemory()
+{
+	Unpin();
 }
 
 void PinnedListMemory::Unpin()
 {
-	if (!m_unpinned)
+	if (m_allocator)
 	{
-		m_unpinned = true;
 		m_allocator->UnpinMemoryUnmanaged(m_ptr);
+		m_allocator = nullptr;
 	}
 }
@@ -1,30 +1,67 @@
 #pragma once
 #include <functional>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <shared_mutex>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <iosfwd>
 
 #include "exports.h"
 
 using ListPointer = uint64_t;
 
+constexpr int32_t ListSecondLevelBits = 4; // Every power of two is split into this many size classes
+constexpr int32_t ListSecondLevelCount = 1 << ListSecondLevelBits;
+constexpr int32_t ListFirstLevelCount = 64;
+constexpr uint64_t ListMinBlockSize = 16; // Smaller remainders stay with the allocation instead of becoming a free block
+constexpr int32_t ListHistogramBuckets = 32; // Bucket i counts allocations of up to 2^i bytes, the last one also everything larger
+
 class ListMemoryPointer
 {
 public:
 	ListPointer Pointer;
+	int32_t Page = 0; // Set by the allocator, tells an owner with several allocators which one this came from
 };
 
 class ListEntryHeader : public ListMemoryPointer
 {
 public:
-	ListEntryHeader *Prev;
+	ListEntryHeader *Prev; // Neighbouring blocks in address order, free or not
 	ListEntryHeader *Next;
+	ListEntryHeader *PrevFree; // Neighbours in the size class list while the block is free
+	ListEntryHeader *NextFree;
 	int32_t Index;
-	int32_t Padding;
-	uint64_t Size;
+	int32_t Padding; // Bytes between the block start and Pointer
+	uint64_t Size; // Bytes requested, 0 for free blocks
+	uint64_t BlockSize; // Bytes from the block start to the next block
 	uint64_t Alignment;
-	bool Pinned;
+	std::atomic_int32_t PinCount; // Pins held, -1 while the allocator moves or frees the entry
+	bool Free;
+};
+
+class ListAllocatorStats
+{
+public:
+	std::string Name;
+	uint64_t Size; // Bytes managed
+	uint64_t BackedBytes; // Memory committed behind the range, all of it unless the owner backs it on demand
+	uint64_t LiveBytes; // Bytes held by allocations, padding included
+	uint64_t HighWaterBytes;
+	uint64_t FreeBytes;
+	uint64_t LargestFreeBlock;
+	float Fragmentation; // 1 - largest free block / free bytes, 0 while the free space is in one piece
+	int32_t Allocations;
+	int32_t MaxAllocations;
+	int32_t FailedAllocations; // Out of headers or space, since creation
+	int32_t Defragments; // Full compactions
+	int32_t DefragmentSteps; // Budgeted steps that moved anything
+	uint64_t BytesMoved;
+	double DefragmentTime; // Seconds spent in both kinds
+	int32_t SizeHistogram[ListHistogramBuckets]; // Live allocations
 };
 
 class MoveData
@@ -36,17 +73,20 @@ public:
 };
 
 class ListAllocator;
-class PinnedListMemory
+class PinnedListMemory // Holds one pin until it is destroyed or unpinned, kept by value so pinning never touches the heap
 {
 public:
-	XENGINEAPI PinnedListMemory(ListAllocator *allocator, ListMemoryPointer *ptr);
+	PinnedListMemory() : m_allocator(nullptr), m_ptr(nullptr) {}
+	XENGINEAPI PinnedListMemory(ListAllocator *allocator, ListMemoryPointer *ptr); // Takes over a pin that is already held
+	PinnedListMemory(const PinnedListMemory&) = delete;
+	XENGINEAPI PinnedListMemory(PinnedListMemory&& other);
+	XENGINEAPI PinnedListMemory& operator=(PinnedListMemory&& other);
 	XENGINEAPI ~PinnedListMemory();
 	ListMemoryPointer *GetPointer() { return m_ptr; }
 	XENGINEAPI void Unpin();
 private:
-	ListAllocator *m_allocator;
+	ListAllocator *m_allocator; // Null once unpinned
 	ListMemoryPointer *m_ptr;
-	bool m_unpinned;
 };
 
 class ListAllocator
@@ -56,6 +96,7 @@ public:
 	XENGINEAPI ~ListAllocator();
 
 	XENGINEAPI ListMemoryPointer *AllocateMemory(int32_t size, int32_t alignment);
+	XENGINEAPI ListMemoryPointer *TryAllocateMemory(int32_t size, int32_t alignment); // Null instead of compacting when nothing fits
 	XENGINEAPI void DeallocateMemory(ListMemoryPointer *ptr);
 
 	XENGINEAPI int32_t GetAllocationSize(ListMemoryPointer *ptr);
@@ -63,35 +104,88 @@ public:
 	XENGINEAPI void ShrinkToFit(int32_t extraMemory);
 	XENGINEAPI void SetSize(uint64_t maxSize);
 
-	XENGINEAPI std::shared_ptr<PinnedListMemory> PinMemory(ListMemoryPointer *ptr);
-	XENGINEAPI void PinMemoryUnmanaged(ListMemoryPointer *ptr);
+	XENGINEAPI PinnedListMemory PinMemory(ListMemoryPointer *ptr);
+	XENGINEAPI void PinMemoryUnmanaged(ListMemoryPointer *ptr); // Pins nest, each needs its own unpin
 	XENGINEAPI void UnpinMemoryUnmanaged(ListMemoryPointer *ptr);
 
-	XENGINEAPI int32_t GetMaxSize();
-	XENGINEAPI int32_t GetFreeSpace();
+	XENGINEAPI uint64_t GetMaxSize();
+	XENGINEAPI uint64_t GetFreeSpace();
 
 	XENGINEAPI void SetMoveCallback(std::function<void(MoveData&)> move);
 	XENGINEAPI void SetDefragBeginCallback(std::function<void()> begin);
 	XENGINEAPI void SetDefragEndCallback(std::function<void()> end);
-private:
-	void Defragment();
+	XENGINEAPI void SetBackingCallback(std::function<uint64_t(uint64_t)> back); // Given the end of the used range, back memory up to it and return how far it is backed
 
-	std::shared_mutex m_defragLock;
-	std::mutex m_allocLock;
+	XENGINEAPI bool DefragmentStep(uint64_t maxBytes, int32_t maxMoves); // Slide a few allocations down into the holes before them, true if there is more to do
+	XENGINEAPI void SetDefragBudget(uint64_t bytesPerFrame, int32_t movesPerFrame); // A zero budget takes the allocator out of the per-frame pass
+	XENGINEAPI static void RunDefragBudgets(); // One step within budget for every allocator that has one, meant for a background job
+
+	XENGINEAPI void SetName(std::string name); // Shown in stats and allocation failure warnings
+	XENGINEAPI void SetPage(int32_t page); // Stamped on every allocation made from now on
+	XENGINEAPI void RecordTrace(std::string path); // Write every allocation and free to a file the trace benchmark can replay, an empty path stops
+	XENGINEAPI ListAllocatorStats GetStats();
+	XENGINEAPI static std::vector<ListAllocatorStats> GetAllStats(); // Every live allocator
+private:
+	void Defragment(); // Compact everything at once, only when an allocation cannot be placed otherwise
+	bool StepLocked(uint64_t maxBytes, int32_t maxMoves); // DefragmentStep under an m_defragLock already held
+	ListEntryHeader *AllocateBlock(int32_t size, int32_t alignment);
+	ListEntryHeader *FindDefragHole(ListEntryHeader *from, uint64_t maxBytes, bool claim); // First free block from here on followed by an unpinned allocation that can move into it
+	bool CanMoveInto(ListEntryHeader *hole, uint64_t maxBytes, bool claim); // The allocation behind the hole is unpinned and would move down, claimed if asked to
+	static void ReserveBlock(ListEntryHeader *h); // Out of the free lists, kept from allocations and merges until the defragment pass ends
+	static void ClaimEntry(ListEntryHeader *h); // Wait out a move of the entry, then keep it from being pinned or moved
+	uint64_t GetUsedEnd();
+	uint64_t GetLargestFreeBlock();
+	static int32_t GetHistogramBucket(uint64_t size);
+	void TrimBacking(); // Let the backing shrink after the tail freed up
+	void Resize(uint64_t maxSize);
+
+	static void MapSize(uint64_t size, int32_t& first, int32_t& second);
+	ListEntryHeader *FindFreeBlock(uint64_t size);
+	void InsertFreeBlock(ListEntryHeader *h);
+	void RemoveFreeBlock(ListEntryHeader *h);
+	void SplitBlock(ListEntryHeader *h, uint64_t used); // Give the rest of the block back as a free block if it is big enough
+	ListEntryHeader *MergeFreeNeighbours(ListEntryHeader *h);
+	ListEntryHeader *AddBlock(ListEntryHeader *after, uint64_t start, uint64_t size); // New free block, not yet in a size class list
+	void RemoveBlock(ListEntryHeader *h);
+	void ClearFreeLists();
+
+	std::mutex m_defragLock; // One defragment pass at a time, pins and frees only wait for the entry they touch
+	std::mutex m_allocLock; // Guards the blocks and free lists, always taken after m_defragLock
 	
-	std::vector<ListEntryHeader> m_headerLinks;
-	concurrency::concurrent_queue<int32_t> m_freeList;
+	std::deque<ListEntryHeader> m_headerLinks; // Grown on demand, a deque keeps existing headers in place
+	std::vector<int32_t> m_freeHeaders;
+	size_t m_headerLimit; // Every allocation and the free blocks between them
+	int32_t m_allocations = 0;
 
-	ListEntryHeader *m_first = nullptr;
+	ListEntryHeader *m_first = nullptr; // Blocks cover [0, m_maxSize) in address order
 	ListEntryHeader *m_last = nullptr;
 
-	uint64_t m_pointer;
+	uint64_t m_firstLevelMap = 0; // Bit per first level with any free block
+	uint32_t m_secondLevelMaps[ListFirstLevelCount] = { }; // Bit per non-empty size class
+	ListEntryHeader *m_freeBlocks[ListFirstLevelCount][ListSecondLevelCount] = { };
+
 	std::atomic<uint64_t> m_freeSpace;
 
+	std::string m_name = "Unnamed";
+	uint64_t m_highWaterBytes = 0; // Stats below the atomics are guarded by m_allocLock
+	int32_t m_sizeHistogram[ListHistogramBuckets] = { };
+	std::atomic_int m_failedAllocations = 0;
+	std::atomic_int m_defragments = 0;
+	std::atomic_int m_defragmentSteps = 0;
+	std::atomic<uint64_t> m_bytesMoved = 0;
+	std::atomic<int64_t> m_defragmentNanoseconds = 0;
+
+	uint64_t m_defragBytes = 0; // Per-frame budget
+	int32_t m_defragMoves = 0;
+
 	uint64_t m_maxSize;
 	int32_t m_maxHeaders;
 
 	std::function<void(MoveData&)> m_move;
 	std::function<void()> m_defragBegin = []() {};
 	std::function<void()> m_defragEnd = []() {};
+	std::function<uint64_t(uint64_t)> m_back; // Called under m_allocLock, so moves always stay within backed memory
+	uint64_t m_backedSize = UINT64_MAX;
+	int32_t m_page = 0;
+	std::unique_ptr<std::ofstream> m_trace; // Guarded by m_allocLock
 };
\ No newline at end of file
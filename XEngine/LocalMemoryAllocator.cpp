@@ -3,41 +3,77 @@
 #include "LocalMemoryAllocator.h"
 #include "ListAllocator.h"
 
-LocalMemoryAllocator::LocalMemoryAllocator(uint64_t size, int32_t maxAllocs, bool resizable)
-	: m_allocator(size, maxAllocs), m_resizable(resizable), m_size(size)
+LocalMemoryAllocator::LocalMemoryAllocator(uint64_t softLimit, int32_t maxAllocs, bool resizable, bool hugePages)
+	: m_softLimit(softLimit), m_resizable(resizable), m_range(resizable ? softLimit * LocalMemoryReserveFactor : softLimit, hugePages), m_allocator(softLimit, maxAllocs)
 {
-	m_memory = std::malloc(size);
+	m_memory = m_range.GetBase(); // Nothing is resident until allocations reach it
 	m_allocator.SetMoveCallback(std::bind(&LocalMemoryAllocator::MoveMemory, this, std::placeholders::_1));
+	m_allocator.SetBackingCallback(std::bind(&LocalMemoryAllocator::BackMemory, this, std::placeholders::_1));
 }
 
 LocalMemoryAllocator::~LocalMemoryAllocator()
 {
-	std::free(m_memory);
 }
 
 bool LocalMemoryAllocator::WillFit(int32_t size)
 {
-	return m_allocator.GetFreeSpace() >= size;
+	return m_allocator.GetFreeSpace() >= static_cast<uint64_t>(size);
 }
 
 ListMemoryPointer *LocalMemoryAllocator::RequestSpace(int32_t bytes, int32_t alignment)
 {
-	if (!WillFit(bytes + alignment - 1))
-		alignment = 1;
+	if (bytes <= m_slabLimit && alignment <= SlabAlignment)
+		return SlabAllocator::Allocate(bytes);
 
-	if (!WillFit(bytes) && m_resizable)
-	{
-	}
+	ListMemoryPointer *ptr = m_allocator.TryAllocateMemory(bytes, alignment);
+	if (!ptr && m_resizable && Grow(static_cast<uint64_t>(bytes) + alignment))
+		ptr = m_allocator.TryAllocateMemory(bytes, alignment);
+	if (ptr)
+		return ptr;
 
-	return m_allocator.AllocateMemory(bytes, alignment);
+	if (!WillFit(bytes + alignment - 1))
+		alignment = 1;
+	return m_allocator.AllocateMemory(bytes, alignment); // Compacting is the last resort
 }
 
 void LocalMemoryAllocator::FreeSpace(ListMemoryPointer *ptr)
 {
-	m_allocator.DeallocateMemory(ptr);
+	if (SlabAllocator::Owns(ptr))
+		SlabAllocator::Free(ptr);
+	else
+		m_allocator.DeallocateMemory(ptr);
 }
 
 void LocalMemoryAllocator::MoveMemory(MoveData& data)
 {
 	std::memmove(reinterpret_cast<char *>(m_memory) + data.DestIndex, reinterpret_cast<char *>(m_memory) + data.SrcIndex, data.Size);
-}
\ No newline at end of file
+}
+
+uint64_t LocalMemoryAllocator::BackMemory(uint64_t usedEnd)
+{
+	uint64_t committed = m_committed;
+	if (usedEnd > committed)
+	{
+		uint64_t end = std::min((usedEnd + LocalMemoryCommitStep - 1) / LocalMemoryCommitStep * LocalMemoryCommitStep, m_range.GetReservedSize());
+		if (m_range.Commit(committed, end - committed))
+			m_committed = end;
+	}
+	else if (committed - usedEnd > LocalMemoryDecommitSlack) // Keep half the slack so a free and an allocation around one boundary do not thrash
+	{
+		uint64_t end = (usedEnd + LocalMemoryDecommitSlack / 2 + LocalMemoryCommitStep - 1) / LocalMemoryCommitStep * LocalMemoryCommitStep;
+		m_range.Decommit(end, committed - end);
+		m_committed = end;
+	}
+	return m_committed;
+}
+
+bool LocalMemoryAllocator::Grow(uint64_t bytes)
+{
+	std::lock_guard lock(m_growLock);
+	uint64_t size = m_allocator.GetMaxSize();
+	uint64_t grown = std::min(size + std::max(bytes, m_softLimit / 4), m_range.GetReservedSize()); // Only address space, pages are still committed on use
+	if (grown <= size)
+		return false;
+	m_allocator.SetSize(grown);
+	return true;
+}
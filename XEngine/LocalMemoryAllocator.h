@@ -1,21 +1,30 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+
 #include "exports.h"
 #include "ListAllocator.h"
+#include "SlabAllocator.h"
+#include "VirtualMemory.h"
+
+constexpr uint64_t LocalMemoryCommitStep = 1 << 21; // Pages are committed and decommitted in 2 MB steps
+constexpr uint64_t LocalMemoryDecommitSlack = 1 << 25; // Committed memory past the last allocation that is kept before giving it back
+constexpr uint64_t LocalMemoryReserveFactor = 4; // Resizable arenas reserve this multiple of their soft limit
 
 template<class T>
 class PinnedLocalMemory
 {
 public:
 	PinnedLocalMemory() {}
-	PinnedLocalMemory(std::shared_ptr<PinnedListMemory> mem, T *data, int32_t size) : m_mem(mem), m_data(data), m_size(size) {}
+	PinnedLocalMemory(PinnedListMemory&& mem, T *data, int32_t size) : m_mem(std::move(mem)), m_data(data), m_size(size) {}
 	T *GetData() { return m_data; }
 	int32_t GetSize() { return m_size; }
 	T *operator->() { return m_data; }
 	T& operator* (){ return *m_data; }
-	void Unpin() { m_mem->Unpin(); }
+	void Unpin() { m_mem.Unpin(); }
 private:
-	std::shared_ptr<PinnedListMemory> m_mem;
+	PinnedListMemory m_mem; // Move-only, the pin goes with it
 	T *m_data;
 	int32_t m_size;
 };
@@ -23,21 +32,41 @@ private:
 class LocalMemoryAllocator
 {
 public:
-	XENGINEAPI LocalMemoryAllocator(uint64_t size, int32_t maxAllocs, bool resizable);
+	XENGINEAPI LocalMemoryAllocator(uint64_t softLimit, int32_t maxAllocs, bool resizable, bool hugePages = false); // Resizable arenas grow past the soft limit instead of failing
 	XENGINEAPI ~LocalMemoryAllocator();
 	XENGINEAPI bool WillFit(int32_t size);
 	template<class T>
 	PinnedLocalMemory<T> GetMemory(ListMemoryPointer *ptr)
 	{
-		return PinnedLocalMemory<T>(m_allocator.PinMemory(ptr),
+		if (SlabAllocator::Owns(ptr)) // Slab entries never move, there is nothing to pin
+			return PinnedLocalMemory<T>(PinnedListMemory(), reinterpret_cast<T *>(SlabAllocator::GetData(ptr)), SlabAllocator::GetSize(ptr) / sizeof(T));
+		PinnedListMemory pin = m_allocator.PinMemory(ptr); // Pointer only holds still once pinned, so read it afterwards
+		return PinnedLocalMemory<T>(std::move(pin),
 			reinterpret_cast<T *>(reinterpret_cast<char *>(m_memory) + ptr->Pointer), m_allocator.GetAllocationSize(ptr) / sizeof(T));
 	}
 	XENGINEAPI ListMemoryPointer *RequestSpace(int32_t bytes, int32_t alignment = 1);
 	XENGINEAPI void FreeSpace(ListMemoryPointer *ptr);
+	inline void SetDefragBudget(uint64_t bytesPerFrame, int32_t movesPerFrame) { m_allocator.SetDefragBudget(bytesPerFrame, movesPerFrame); }
+	inline void SetName(std::string name) { m_allocator.SetName(name); }
+	inline ListAllocatorStats GetStats() { return m_allocator.GetStats(); }
+	inline void SetSlabLimit(int32_t bytes) { m_slabLimit = std::min(bytes, SlabMaxSize); } // Requests up to this size come from the shared slabs and leave the arena's headers alone
+
+	uint64_t GetSoftLimit() { return m_softLimit; }
+	uint64_t GetUsedSize() { return m_allocator.GetMaxSize() - m_allocator.GetFreeSpace(); }
+	uint64_t GetCommittedSize() { return m_committed; } // Resident at most this much
+	bool IsOverSoftLimit() { return GetUsedSize() > m_softLimit; }
+	bool HasHugePages() { return m_range.HasHugePages(); }
 private:
 	void MoveMemory(MoveData& data);
-	uint64_t m_size;
+	uint64_t BackMemory(uint64_t usedEnd);
+	bool Grow(uint64_t bytes);
+
+	uint64_t m_softLimit;
+	int32_t m_slabLimit = 0;
+	bool m_resizable;
+	VirtualMemoryRange m_range;
 	void *m_memory;
+	std::atomic<uint64_t> m_committed = 0; // Always a prefix of the range, only changed under the list allocator's lock
+	std::mutex m_growLock;
 	ListAllocator m_allocator;
-	bool m_resizable;
 };
\ No newline at end of file
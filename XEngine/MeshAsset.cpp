@@ -25,7 +25,8 @@ std::string& MeshAsset::GetTypeName()
 
 void MeshAsset::AddRef()
 {
-	++m_refCounter;
+	if (++m_refCounter == 1)
+		XEngineInstance->GetAssetManager()->GetBudgets().Retain(this);
 }
 
 void MeshAsset::RemoveRef()
@@ -33,7 +34,7 @@ void MeshAsset::RemoveRef()
 	int32_t newVal = --m_refCounter;
 	if (newVal == 0)
 	{
-		m_loader->Unload(this);
+		XEngineInstance->GetAssetManager()->GetBudgets().Release(m_loader, this); // Unloaded once the mesh budget needs the room
 	}
 }
 
@@ -255,6 +256,19 @@ void MeshAsset::LoadFullMesh()
 	XEngineInstance->GetAssetManager()->PushLoadRequest(m_loader, this, nullptr);
 }
 
+AsyncTask<> MeshAsset::LoadFullMeshAsync()
+{
+	m_loadingState = MeshAssetLoadingState::LoadingFull;
+	co_await XEngineInstance->GetAssetManager()->LoadAsync(m_loader, this, nullptr);
+
+	std::shared_ptr<GraphicsSyncObject> verticesSync = m_uploadFullVerticesSync; // Set by the loader through SetMeshData
+	std::shared_ptr<GraphicsSyncObject> indicesSync = m_uploadFullIndicesSync;
+	if (verticesSync)
+		co_await WaitForSync(verticesSync);
+	if (indicesSync)
+		co_await WaitForSync(indicesSync);
+}
+
 void MeshAsset::SetMeshDataInternal(void *vertices, int32_t tSize, int32_t vCount, int32_t *indices, int32_t iCount)
 {
 	LocalMemoryAllocator& assetMem = XEngineInstance->GetAssetManager()->GetAssetMemory();
@@ -268,6 +282,9 @@ void MeshAsset::SetMeshDataInternal(void *vertices, int32_t tSize, int32_t vCoun
 	m_fullLodElementsCPU = assetMem.RequestSpace(m_loader->GetMeshMemory(m_vertexTypeId).BytesPerVertex * vCount);
 	m_fullLodIndicesCPU = assetMem.RequestSpace(sizeof(int32_t) * iCount);
 
+	uint64_t bytes = static_cast<uint64_t>(m_loader->GetMeshMemory(m_vertexTypeId).BytesPerVertex) * vCount + sizeof(int32_t) * iCount;
+	XEngineInstance->GetAssetManager()->GetBudgets().SetResidency(this, bytes, bytes); // Kept on both sides
+
 	if (!vertices || !indices)
 		return;
 
@@ -296,6 +313,8 @@ MeshAssetLoader::MeshAssetLoader(int32_t minVertexCount, int32_t minIndexCount)
 	m_indexAllocator(minIndexCount, 16384, true)
 {
 	m_context = XEngineInstance->GetInterface<DisplayInterface>(HardwareInterfaceType::Display)->GetGraphicsContext();
+	m_indexAllocator.SetName("Mesh indices");
+	m_indexAllocator.SetDefragBudget(1 << 21, 32); // Keeps each frame's transfer buffer of defrag copies small
 	
 	m_meshSpec.Add<MeshAssetHeader>("meshHeader");
 	m_meshSpec.AddArray<VectorDataFormat>("vectorDataFormat");
@@ -330,6 +349,8 @@ UniqueId MeshAssetLoader::GetVertexType(std::vector<VectorDataFormat> descs)
 			alloc.BytesPerVertex += alloc.BytesVertexSizes.back();
 		}
 		alloc.MemoryAllocator = new GPUMemoryAllocator(m_minVertexCount * alloc.BytesPerVertex, 8192, true);
+		alloc.MemoryAllocator->SetName("Mesh vertices, " + std::to_string(alloc.BytesPerVertex) + " bytes each");
+		alloc.MemoryAllocator->SetDefragBudget(1 << 21, 32);
 
 		m_vertexTypeMutex.unlock();
 		return id;
@@ -448,11 +469,13 @@ void MeshAsset::Invalidate()
 	if (m_fullLodElementsGPU)
 		alloc.MemoryAllocator->FreeSpace(m_fullLodElementsGPU);
 	if (m_fullLodIndicesGPU)
-		alloc.MemoryAllocator->FreeSpace(m_fullLodIndicesGPU);
+		m_loader->GetIndexBuffer().FreeSpace(m_fullLodIndicesGPU); // Indices have their own heap, its page numbers mean nothing to the vertex one
 
 	m_uploadFullVerticesSync = m_uploadFullIndicesSync = nullptr;
 	m_fullLodElementsCPU = m_fullLodIndicesCPU = nullptr;
 	m_fullLodElementsGPU = m_fullLodIndicesGPU = nullptr;
+
+	XEngineInstance->GetAssetManager()->GetBudgets().SetResidency(this, 0, 0);
 }
 
 void MeshAsset::OptimizeCacheAndBuildClusters()
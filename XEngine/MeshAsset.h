@@ -106,6 +106,7 @@ public:
 
 	XENGINEAPI bool IsFullMeshAvailable();
 	XENGINEAPI void LoadFullMesh();
+	XENGINEAPI AsyncTask<> LoadFullMeshAsync(); // Completes once the full mesh is resident on the GPU
 private:
 	std::atomic<MeshAssetLoadingState> m_loadingState = MeshAssetLoadingState::NotLoaded;
 	friend class MeshAssetLoader;
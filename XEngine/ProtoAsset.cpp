@@ -1,2 +1,228 @@
 #include "pch.h"
 #include "ProtoAsset.h"
+
+std::string protoAssetTypeName = "Proto";
+
+ProtoAsset::ProtoAsset(ProtoAssetLoader *loader, UniqueId id) : m_loader(loader), m_id(id), m_refCounter(0)
+{
+	SetComponents({});
+}
+
+UniqueId ProtoAsset::GetId()
+{
+	return m_id;
+}
+
+std::string& ProtoAsset::GetTypeName()
+{
+	return protoAssetTypeName;
+}
+
+void ProtoAsset::AddRef()
+{
+	++m_refCounter;
+}
+
+void ProtoAsset::RemoveRef()
+{
+	--m_refCounter;
+	if (m_refCounter == 0)
+	{
+		XEngineInstance->GetAssetManager()->PushUnloadRequest(m_loader, this);
+	}
+}
+
+void ProtoAsset::SetComponents(std::set<ComponentTypeId> components)
+{
+	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	components.insert(StaticComponentInfo<EntityIdComponent>::GetIdentifier());
+
+	m_template.Components = components;
+	m_template.ComponentIndices.clear();
+	m_template.ColumnOffsets.clear();
+	m_template.BufferData.assign(components.size(), std::vector<char>());
+
+	int32_t size = 0;
+	for (ComponentTypeId id : components) // Columns follow the set order, same as the archetype's allocators
+	{
+		int32_t index = registrar->GetComponentIndex(id);
+		m_template.ComponentIndices.push_back(index);
+		m_template.ColumnOffsets.push_back(size);
+		size += registrar->GetComponentInfoByIndex(index).Size;
+	}
+	m_template.RowImage.assign(size, 0);
+}
+
+void *ProtoAsset::GetDefaultComponent(ComponentTypeId id)
+{
+	int32_t column = GetColumn(id);
+	if (column < 0)
+		return nullptr;
+	return m_template.RowImage.data() + m_template.ColumnOffsets[column];
+}
+
+void ProtoAsset::SetDefaultBuffer(ComponentTypeId id, const void *elements, int32_t count)
+{
+	int32_t column = GetColumn(id);
+	if (column < 0)
+		return;
+
+	int32_t bytes = XEngine::GetInstance().GetECSRegistrar()->GetComponentInfoByIndex(m_template.ComponentIndices[column]).BufferElementSize * count;
+	m_template.BufferData[column].assign(reinterpret_cast<const char *>(elements), reinterpret_cast<const char *>(elements) + bytes);
+}
+
+std::vector<Entity> ProtoAsset::Instantiate(Scene *scene, int32_t count)
+{
+	return scene->GetEntityManager()->CreateEntities(m_template, count);
+}
+
+int32_t ProtoAsset::GetColumn(ComponentTypeId id)
+{
+	auto iter = m_template.Components.find(id);
+	if (iter == m_template.Components.end())
+		return -1;
+	return std::distance(m_template.Components.begin(), iter);
+}
+
+ProtoAssetLoader::ProtoAssetLoader()
+{
+	m_spec.AddStringArray("components");
+	m_spec.AddArray<int32_t>("componentSizes");
+	m_spec.AddArray<char>("rowImage");
+	m_spec.AddArray<int32_t>("bufferSizes");
+	m_spec.AddArray<char>("bufferData");
+}
+
+void ProtoAssetLoader::CleanupUnusedMemory()
+{
+}
+
+std::string& ProtoAssetLoader::GetAssetType()
+{
+	return protoAssetTypeName;
+}
+
+IAsset *ProtoAssetLoader::CreateEmpty(UniqueId id)
+{
+	return new ProtoAsset(this, id);
+}
+
+void ProtoAssetLoader::Preload(IAsset *asset, LoadMemoryPointer header)
+{
+	ProtoAsset *proto = static_cast<ProtoAsset *>(asset);
+	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	FileSpecImporter importer(m_spec, header);
+
+	std::vector<std::string> components;
+	std::vector<int32_t> componentSizes;
+	std::vector<int32_t> bufferSizes;
+
+	importer.GetStringArray("components", components);
+	importer.CopyArray("componentSizes", componentSizes);
+	importer.CopyArray("bufferSizes", bufferSizes);
+
+	std::vector<ComponentTypeId> ids(components.size());
+	std::set<ComponentTypeId> idSet;
+	for (int32_t i = 0; i < components.size(); ++i) // Components are stored by name so the row survives registration order changes
+	{
+		ids[i] = registrar->GetComponentIdByName(components[i].c_str());
+		if (ids[i])
+			idSet.insert(ids[i]);
+	}
+	proto->SetComponents(idSet);
+
+	char *rowImage = importer.GetArray<char>("rowImage");
+	char *bufferData = importer.GetArray<char>("bufferData");
+	ComponentRowTemplate& rowTemplate = proto->m_template;
+	for (int32_t i = 0; i < ids.size(); ++i)
+	{
+		int32_t column = ids[i] ? proto->GetColumn(ids[i]) : -1;
+		InternalTypeInfo *info = column >= 0 ? &registrar->GetComponentInfoByIndex(rowTemplate.ComponentIndices[column]) : nullptr;
+		if (info && info->Size == componentSizes[i]) // Layout changed since export, keep zeroed defaults
+		{
+			std::memcpy(rowTemplate.RowImage.data() + rowTemplate.ColumnOffsets[column], rowImage, componentSizes[i]);
+			if (bufferSizes[i] > 0)
+				rowTemplate.BufferData[column].assign(bufferData, bufferData + bufferSizes[i] / info->BufferElementSize * info->BufferElementSize);
+		}
+		rowImage += componentSizes[i];
+		bufferData += bufferSizes[i];
+	}
+}
+
+bool ProtoAssetLoader::CanLoad(IAsset *asset, LoadMemoryPointer loadData)
+{
+	return true;
+}
+
+std::vector<AssetLoadRange> ProtoAssetLoader::Load(IAsset *asset, LoadMemoryPointer loadData)
+{
+	return {};
+}
+
+void ProtoAssetLoader::FinishLoad(IAsset *asset, std::vector<AssetLoadRange>& ranges, std::vector<LoadMemoryPointer>& content, LoadMemoryPointer loadData)
+{
+}
+
+void ProtoAssetLoader::Copy(IAsset *src, IAsset *dest)
+{
+	static_cast<ProtoAsset *>(dest)->m_template = static_cast<ProtoAsset *>(src)->m_template;
+}
+
+void ProtoAssetLoader::Unload(IAsset *asset)
+{
+}
+
+void ProtoAssetLoader::Dispose(IAsset *asset)
+{
+	ProtoAsset *proto = static_cast<ProtoAsset *>(asset);
+
+	proto->m_template = ComponentRowTemplate();
+}
+
+void ProtoAssetLoader::Export(IAsset *asset, AssetDescriptorPreHeader& preHeader, LoadMemoryPointer& header, LoadMemoryPointer& content,
+	std::vector<AssetLoadRange>& ranges)
+{
+	ProtoAsset *proto = static_cast<ProtoAsset *>(asset);
+	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+	LocalMemoryAllocator& alloc = XEngineInstance->GetAssetManager()->GetAssetMemory();
+	ComponentRowTemplate& rowTemplate = proto->m_template;
+
+	FileSpecExporter exporter(m_spec);
+
+	std::vector<std::string> components;
+	std::vector<int32_t> componentSizes;
+	std::vector<int32_t> bufferSizes;
+	std::vector<char> bufferData;
+
+	for (int32_t column = 0; column < rowTemplate.ComponentIndices.size(); ++column)
+	{
+		InternalTypeInfo& info = registrar->GetComponentInfoByIndex(rowTemplate.ComponentIndices[column]);
+		std::vector<char>& elements = rowTemplate.BufferData[column];
+
+		components.push_back(info.Name);
+		componentSizes.push_back(info.Size);
+		bufferSizes.push_back(elements.size());
+		bufferData.insert(bufferData.end(), elements.begin(), elements.end());
+	}
+
+	exporter.SetStringArraySize("components", components.data(), components.size());
+	exporter.SetArraySize("componentSizes", componentSizes.size());
+	exporter.SetArraySize("rowImage", rowTemplate.RowImage.size());
+	exporter.SetArraySize("bufferSizes", bufferSizes.size());
+	exporter.SetArraySize("bufferData", bufferData.size());
+
+	header = exporter.AllocateSpace();
+
+	exporter.SetStringArray("components", components.data());
+	exporter.SetArrayData("componentSizes", componentSizes.data());
+	exporter.SetArrayData("rowImage", rowTemplate.RowImage.data());
+	exporter.SetArrayData("bufferSizes", bufferSizes.data());
+	exporter.SetArrayData("bufferData", bufferData.data());
+
+	preHeader.Id = proto->GetId();
+	strcpy_s(preHeader.AssetType, 64, protoAssetTypeName.c_str());
+	preHeader.HeaderSize = exporter.GetTotalByteSize();
+	preHeader.AssetSize = 0;
+
+	content = alloc.RequestSpace(0);
+}
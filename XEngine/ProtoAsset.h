@@ -1,5 +1,63 @@
 #pragma once
-class ProtoAsset
+
+#include "AssetManager.h"
+#include "FileSpecBuilder.h"
+#include "ECS.h"
+
+#include <atomic>
+
+class ProtoAssetLoader;
+
+class ProtoAsset : public IAsset
 {
+public:
+	ProtoAsset(ProtoAssetLoader *loader, UniqueId id);
+
+	virtual UniqueId GetId() override;
+	virtual std::string& GetTypeName() override;
+	virtual void AddRef() override;
+	virtual void RemoveRef() override;
+
+	void SetComponents(std::set<ComponentTypeId> components); // Rebuild the row image with zeroed defaults for these components
+	void *GetDefaultComponent(ComponentTypeId id); // Default value inside the row image
+	void SetDefaultBuffer(ComponentTypeId id, const void *elements, int32_t count);
+
+	template<class T>
+	T *GetDefaultComponent() { return reinterpret_cast<T *>(GetDefaultComponent(StaticComponentInfo<T>::GetIdentifier())); }
+	template<class T>
+	void SetDefaultBuffer(std::vector<typename T::ElementType>& elements) { SetDefaultBuffer(StaticComponentInfo<T>::GetIdentifier(), elements.data(), elements.size()); }
+
+	std::vector<Entity> Instantiate(Scene *scene, int32_t count); // Create count entities from the row image in one pass
+	inline ComponentRowTemplate& GetRowTemplate() { return m_template; } // For building entities elsewhere, such as in a WorldCell
+private:
+	friend ProtoAssetLoader;
+
+	int32_t GetColumn(ComponentTypeId id);
+
+	std::atomic_int m_refCounter;
+
+	ProtoAssetLoader *m_loader;
+	UniqueId m_id;
+
+	ComponentRowTemplate m_template;
 };
 
+class ProtoAssetLoader : public IAssetLoader
+{
+public:
+	ProtoAssetLoader();
+	virtual void CleanupUnusedMemory() override;
+	virtual std::string& GetAssetType() override;
+	virtual IAsset *CreateEmpty(UniqueId id) override;
+	virtual void Preload(IAsset *asset, LoadMemoryPointer header) override;
+	virtual bool CanLoad(IAsset *asset, LoadMemoryPointer loadData) override;
+	virtual std::vector<AssetLoadRange> Load(IAsset *asset, LoadMemoryPointer loadData) override;
+	virtual void FinishLoad(IAsset *asset, std::vector<AssetLoadRange>& ranges, std::vector<LoadMemoryPointer>& content, LoadMemoryPointer loadData) override;
+	virtual void Copy(IAsset *src, IAsset *dest) override;
+	virtual void Unload(IAsset *asset) override;
+	virtual void Dispose(IAsset *asset) override;
+	virtual void Export(IAsset *asset, AssetDescriptorPreHeader& preHeader, LoadMemoryPointer& header, LoadMemoryPointer& content,
+		std::vector<AssetLoadRange>& ranges) override;
+private:
+	FileSpec m_spec;
+};
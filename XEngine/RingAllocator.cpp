@@ -42,3 +42,42 @@ void RingAllocator::Remove(int32_t size, int32_t alignment)
 	else
 		m_validRangeBegin = newRangeEnd;
 }
+
+ConcurrentRingAllocator::ConcurrentRingAllocator(uint64_t size) : m_size(size), m_head(0), m_tail(0)
+{
+}
+
+RingReservation ConcurrentRingAllocator::Reserve(uint64_t size, uint64_t alignment)
+{
+	RingReservation reservation;
+	reservation.Offset = -1;
+	if (size > m_size)
+		return reservation;
+
+	uint64_t head = m_head.load(std::memory_order_relaxed);
+	while (true)
+	{
+		uint64_t lap = head - head % m_size;
+		uint64_t offset = (head % m_size + alignment - 1) / alignment * alignment;
+		uint64_t start = offset + size > m_size ? lap + m_size : lap + offset; // Skip to the next lap rather than split the region
+		uint64_t end = start + size;
+		uint64_t tail = m_tail.load(std::memory_order_acquire);
+		if (tail == head) // Nothing in flight, the padding skipped at the end of the lap holds nothing back
+			tail = start;
+		if (end - tail > m_size) // Full until the consumer releases more
+			return reservation;
+
+		if (m_head.compare_exchange_weak(head, end, std::memory_order_relaxed))
+		{
+			reservation.Begin = head;
+			reservation.End = end;
+			reservation.Offset = start % m_size;
+			return reservation;
+		}
+	}
+}
+
+void ConcurrentRingAllocator::Release(uint64_t end)
+{
+	m_tail.store(end, std::memory_order_release);
+}
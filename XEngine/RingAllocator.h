@@ -1,6 +1,10 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+
+#include "exports.h"
+#include "ConcurrentQueue.h"
 
 class RingAllocator
 {
@@ -14,3 +18,24 @@ private:
 	int32_t m_validRangeEnd;
 };
 
+class RingReservation
+{
+public:
+	uint64_t Begin; // Ring position before the reservation, padding skipped at the end of a lap belongs to it
+	uint64_t End;
+	int64_t Offset; // Into the buffer, -1 if there was no room
+};
+
+class ConcurrentRingAllocator // Any thread reserves, one thread at a time releases, always in reservation order
+{
+public:
+	XENGINEAPI ConcurrentRingAllocator(uint64_t size);
+	XENGINEAPI RingReservation Reserve(uint64_t size, uint64_t alignment); // Lock-free, a reservation never wraps around the end of the buffer
+	XENGINEAPI void Release(uint64_t end); // Everything reserved before end can be reused
+	uint64_t GetTail() { return m_tail.load(std::memory_order_relaxed); }
+	uint64_t GetSize() { return m_size; }
+private:
+	uint64_t m_size;
+	alignas(CacheLineSize) std::atomic<uint64_t> m_head; // Positions only grow, the offset is the position modulo the size
+	alignas(CacheLineSize) std::atomic<uint64_t> m_tail;
+};
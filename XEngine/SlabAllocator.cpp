@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "SlabAllocator.h"
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class SlabThreadCache
+{
+public:
+	~SlabThreadCache(); // Hands everything back to the shared lists when the thread exits
+	void Refill(int32_t sizeClass);
+	void Drain(int32_t sizeClass, int32_t count);
+
+	SlabEntry *Free[SlabClassCount] = { };
+	int32_t Count[SlabClassCount] = { };
+};
+
+std::mutex slabSharedMutex; // Only taken when a thread's cache runs empty or overflows
+SlabEntry *slabSharedFree[SlabClassCount] = { };
+std::vector<std::unique_ptr<char[]>> slabChunks;
+std::atomic<uint64_t> slabReservedBytes = 0;
+thread_local SlabThreadCache slabThreadCache;
+
+ListMemoryPointer *SlabAllocator::Allocate(int32_t bytes)
+{
+	int32_t sizeClass = std::bit_width(static_cast<uint32_t>(std::max(bytes, SlabMinSize) - 1)) - std::bit_width(static_cast<uint32_t>(SlabMinSize - 1));
+	if (sizeClass >= SlabClassCount)
+		return nullptr;
+
+	SlabThreadCache& cache = slabThreadCache;
+	if (!cache.Free[sizeClass])
+		cache.Refill(sizeClass);
+
+	SlabEntry *entry = cache.Free[sizeClass];
+	cache.Free[sizeClass] = entry->Next;
+	--cache.Count[sizeClass];
+
+	entry->Pointer = 0;
+	entry->Page = SlabPage;
+	entry->Size = bytes;
+	return entry;
+}
+
+void SlabAllocator::Free(ListMemoryPointer *ptr)
+{
+	SlabEntry *entry = static_cast<SlabEntry *>(ptr);
+	SlabThreadCache& cache = slabThreadCache;
+
+	entry->Next = cache.Free[entry->SizeClass];
+	cache.Free[entry->SizeClass] = entry;
+	if (++cache.Count[entry->SizeClass] > SlabBatch * 2) // Keep a thread that only frees, like a loader cleaning up after another, from hoarding
+		cache.Drain(entry->SizeClass, SlabBatch);
+}
+
+uint64_t SlabAllocator::GetReservedBytes()
+{
+	return slabReservedBytes;
+}
+
+SlabThreadCache::~SlabThreadCache()
+{
+	for (int32_t sizeClass = 0; sizeClass < SlabClassCount; ++sizeClass)
+		Drain(sizeClass, Count[sizeClass]);
+}
+
+void SlabThreadCache::Refill(int32_t sizeClass)
+{
+	std::lock_guard lock(slabSharedMutex);
+	while (slabSharedFree[sizeClass] && Count[sizeClass] < SlabBatch)
+	{
+		SlabEntry *entry = slabSharedFree[sizeClass];
+		slabSharedFree[sizeClass] = entry->Next;
+		entry->Next = Free[sizeClass];
+		Free[sizeClass] = entry;
+		++Count[sizeClass];
+	}
+	if (Count[sizeClass] > 0)
+		return;
+
+	int32_t stride = SlabHeaderSize + (SlabMinSize << sizeClass);
+	char *chunk = slabChunks.emplace_back(new char[SlabChunkSize]).get(); // new[] is aligned enough for SlabAlignment
+	slabReservedBytes += SlabChunkSize;
+	for (int32_t offset = 0; offset + stride <= SlabChunkSize; offset += stride)
+	{
+		SlabEntry *entry = new (chunk + offset) SlabEntry;
+		entry->SizeClass = sizeClass;
+		entry->Next = Free[sizeClass];
+		Free[sizeClass] = entry;
+		++Count[sizeClass];
+	}
+}
+
+void SlabThreadCache::Drain(int32_t sizeClass, int32_t count)
+{
+	std::lock_guard lock(slabSharedMutex);
+	for (int32_t i = 0; i < count && Free[sizeClass]; ++i)
+	{
+		SlabEntry *entry = Free[sizeClass];
+		Free[sizeClass] = entry->Next;
+		entry->Next = slabSharedFree[sizeClass];
+		slabSharedFree[sizeClass] = entry;
+		--Count[sizeClass];
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+#include "exports.h"
+#include "ListAllocator.h"
+
+constexpr int32_t SlabMinSize = 16;
+constexpr int32_t SlabClassCount = 9; // Powers of two from 16 bytes to 4 KB
+constexpr int32_t SlabMaxSize = SlabMinSize << (SlabClassCount - 1);
+constexpr int32_t SlabAlignment = 16;
+constexpr int32_t SlabChunkSize = 1 << 16; // Carved into entries of a single class
+constexpr int32_t SlabBatch = 32; // Entries moved between a thread's cache and the shared lists at once
+constexpr int32_t SlabPage = -1; // ListMemoryPointer::Page of every slab entry
+
+class SlabEntry : public ListMemoryPointer // Sits right before its data
+{
+public:
+	SlabEntry *Next; // While free
+	int32_t Size; // Bytes requested
+	int32_t SizeClass;
+};
+
+constexpr int32_t SlabHeaderSize = (sizeof(SlabEntry) + SlabAlignment - 1) / SlabAlignment * SlabAlignment;
+
+class SlabAllocator // Small allocations that never move, every thread allocates and frees through its own cache without locking
+{
+public:
+	XENGINEAPI static ListMemoryPointer *Allocate(int32_t bytes); // Up to SlabMaxSize, aligned to SlabAlignment
+	XENGINEAPI static void Free(ListMemoryPointer *ptr); // From any thread, the entry joins that thread's cache
+	XENGINEAPI static uint64_t GetReservedBytes(); // Held in chunks, they are kept for reuse and never given back
+
+	static bool Owns(ListMemoryPointer *ptr) { return ptr->Page == SlabPage; }
+	static char *GetData(ListMemoryPointer *ptr) { return reinterpret_cast<char *>(ptr) + SlabHeaderSize; }
+	static int32_t GetSize(ListMemoryPointer *ptr) { return static_cast<SlabEntry *>(ptr)->Size; }
+};
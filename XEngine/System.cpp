@@ -78,7 +78,9 @@ void SubsystemManager::ExecuteJobs(int32_t threadIndex, float deltaTime)
 	{
 		for (ISystem *system : m_mainThreadSystems)
 		{
+			auto start = std::chrono::steady_clock::now();
 			system->PostUpdate(deltaTime, 0);
+			system->__stats.AddJob(start, std::chrono::steady_clock::now());
 		}
 	}
 	
@@ -87,12 +89,50 @@ void SubsystemManager::ExecuteJobs(int32_t threadIndex, float deltaTime)
 		int32_t jobIndex = --system->__jobsLeft;
 		while (jobIndex >= 0)
 		{
+			auto start = std::chrono::steady_clock::now();
 			system->PostUpdate(deltaTime, jobIndex);
+			system->__stats.AddJob(start, std::chrono::steady_clock::now());
 			jobIndex = --system->__jobsLeft;
 		}
 	}
 }
 
+std::vector<SystemFrameStats> SubsystemManager::CollectFrameStats()
+{
+	std::vector<SystemFrameStats> stats;
+	stats.reserve(m_mainThreadSystems.size() + m_nonMainThreadSystems.size());
+	for (ISystem *system : m_mainThreadSystems)
+		stats.push_back(system->__stats.Collect(system->GetName()));
+	for (ISystem *system : m_nonMainThreadSystems)
+		stats.push_back(system->__stats.Collect(system->GetName()));
+	return stats;
+}
+
+void SystemCounters::AddJob(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	int64_t startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+	int64_t endTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end.time_since_epoch()).count();
+
+	++Jobs;
+	JobNanoseconds += endTime - startTime;
+	int64_t first = FirstStart.load(std::memory_order_relaxed);
+	while (startTime < first && !FirstStart.compare_exchange_weak(first, startTime, std::memory_order_relaxed));
+	int64_t last = LastEnd.load(std::memory_order_relaxed);
+	while (endTime > last && !LastEnd.compare_exchange_weak(last, endTime, std::memory_order_relaxed));
+}
+
+SystemFrameStats SystemCounters::Collect(std::string name)
+{
+	SystemFrameStats stats;
+	stats.Name = name;
+	stats.Jobs = Jobs.exchange(0);
+	stats.JobTime = JobNanoseconds.exchange(0) * 1e-9f;
+	int64_t first = FirstStart.exchange(INT64_MAX);
+	int64_t last = LastEnd.exchange(INT64_MIN);
+	stats.WallTime = stats.Jobs > 0 ? (last - first) * 1e-9f : 0.f;
+	return stats;
+}
+
 void SystemManager::AddSystem(std::string name)
 {
 	ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
@@ -4,6 +4,8 @@
 #include <map>
 #include <typeinfo>
 #include <set>
+#include <chrono>
+#include <atomic>
 
 #include "Component.h"
 #include "Entity.h"
@@ -15,6 +17,27 @@ enum class PostOrdering
 	First, Last, Anywhere
 };
 
+class SystemFrameStats
+{
+public:
+	std::string Name;
+	int32_t Jobs; // Update, Dispose and PostUpdate calls
+	float JobTime; // Seconds spent in those calls, summed over every thread
+	float WallTime; // Seconds from the first call starting to the last one finishing
+};
+
+class SystemCounters
+{
+public:
+	XENGINEAPI void AddJob(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end); // Safe from any thread
+	XENGINEAPI SystemFrameStats Collect(std::string name); // Read and reset, only between frames
+
+	std::atomic_int Jobs = 0;
+	std::atomic<int64_t> JobNanoseconds = 0;
+	std::atomic<int64_t> FirstStart = INT64_MAX; // Steady clock nanoseconds
+	std::atomic<int64_t> LastEnd = INT64_MIN;
+};
+
 class SubsystemManager;
 class ISystem
 {
@@ -46,6 +69,7 @@ public:
 
 	UniqueId __filteringGroup;
 	std::atomic_int __jobsLeft;
+	SystemCounters __stats; // This frame's jobs, collected by the subsystem manager
 private:
 	bool m_enabled = false;
 	SubsystemManager *m_manager;
@@ -79,6 +103,7 @@ public:
 	XENGINEAPI void InitializeSystemOrdering(); // Run when the scene's collection of systems changes
 	XENGINEAPI void ScheduleJobs(); // Run every frame from one thread
 	XENGINEAPI void ExecuteJobs(int32_t threadIndex, float deltaTime); // Run from every thread
+	XENGINEAPI std::vector<SystemFrameStats> CollectFrameStats(); // Job counts and times of the frame that just ran, resets them for the next
 private:
 	std::vector<ISystem *> m_mainThreadSystems; // PostUpdate to be run only from main thread
 	std::vector<ISystem *> m_nonMainThreadSystems;
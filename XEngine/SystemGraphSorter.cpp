@@ -1,6 +1,5 @@
 #include "pch.h"
 #include "SystemGraphSorter.h"
-#include <concurrent_vector.h>
 #include <stack>
 
 SystemGraphSorter::SystemGraphSorter(ComponentManager *manager, std::vector<ISystem *>& systems) : m_manager(manager)
@@ -40,10 +39,12 @@ void SystemGraphSorter::RunFromThread(bool isMain)
 			DirectedSystemGraphNode *node = reinterpret_cast<DirectedSystemGraphNode *>(job.UserPointer);
 			bool isDisposed = job.UserFlag;
 
+			auto start = std::chrono::steady_clock::now();
 			if (isDisposed)
 				node->System->Dispose(job);
 			else
 				node->System->Update(m_deltaTime, job);
+			node->System->__stats.AddJob(start, std::chrono::steady_clock::now());
 
 			if (--node->QueuedJobs == 0 && node->Mutex.try_lock())
 			{
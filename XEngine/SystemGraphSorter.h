@@ -1,6 +1,6 @@
 #pragma once
 #include "System.h"
-#include <concurrent_queue.h>
+#include "ConcurrentQueue.h"
 #include <map>
 #include <queue>
 
@@ -34,7 +34,7 @@ private:
 	std::atomic_int m_threadsBusy;
 	float m_deltaTime;
 
-	concurrency::concurrent_queue<ComponentDataIterator> m_jobs;
+	ConcurrentQueue<ComponentDataIterator> m_jobs;
 
 	std::vector<DirectedSystemGraphNode *> m_nodes;
 	std::vector<DirectedSystemGraphNode *> m_startingNodes;
@@ -295,6 +295,7 @@ void TextureAsset::SetFormat(int32_t width, int32_t height, int32_t depth, int32
 	m_levelsOnCpu.resize(levels);
 	m_levelsOnGpu.resize(levels);
 	m_levelsStreamingToCpuStatus.resize(levels);
+	m_levelsStreamingToCpuCallbacks.resize(levels);
 	m_levelsStreamingToGpuStatus.resize(levels);
 	m_levelsStreamingToGpu.resize(levels);
 	m_levelsOnCpuData.resize(levels);
@@ -407,27 +408,96 @@ void TextureAsset::LoadAllLevelsFully()
 	delete sync;
 }
 
-bool TextureAsset::StreamLevelToCPU(int32_t level)
+AsyncTask<> TextureAsset::LoadAllLevelsFullyAsync()
 {
-	if (!m_levelsStreamingToCpuStatus[level])
+	std::vector<int32_t> levels;
+	for (int32_t level = 0; level < m_sizeLevels.w; ++level)
 	{
-		std::lock_guard streamingLock(m_streamingMutex);
+		if (!m_levelsOnCpu[level])
+			levels.push_back(level);
+	}
+
+	if (!levels.empty())
+	{
+		co_await CallbackAwaiter([this, levels](std::function<void()> resume) // Stream every level at once and resume after the last one arrives
+			{
+				std::shared_ptr<std::atomic_int> remaining = std::make_shared<std::atomic_int>(levels.size());
+				for (int32_t level : levels)
+				{
+					std::function<void()> onStreamed = [remaining, resume]() { if (--*remaining == 0) resume(); };
+					if (JoinLevelStreamToCPU(level, onStreamed)) // Already streaming, wait for that stream instead of counting the level as done
+						continue;
+					if (!StreamLevelToCPU(level, onStreamed) && !JoinLevelStreamToCPU(level, onStreamed) && --*remaining == 0) // Another stream started in between, or has landed already
+						resume();
+				}
+			});
+	}
+
+	GraphicsCommandBuffer *buf = m_context->GetTransferBufferFromPool();
+	GraphicsSyncObject *sync = m_context->CreateSync(false);
+
+	buf->BeginRecording();
+
+	BuildGPUImage(buf, 0, m_sizeLevels.w - 1);
+	SetValidGPUImageBounds(0, m_sizeLevels.w - 1);
 
-		if (m_levelsOnCpu[level])
+	for (int32_t level = 0; level < m_sizeLevels.w; ++level)
+	{
+		if (!m_levelsOnGpu[level])
 		{
-			XEngineInstance->GetAssetManager()->GetAssetMemory().FreeSpace(m_levelsOnCpuData[level]);
-			m_levelsOnCpu[level] = false;
+			StreamLevelToGPU(buf, level);
+			m_levelsOnGpu[level] = true;
 		}
-
-		XEngineInstance->GetAssetManager()->PushLoadRequest(m_loader, this, reinterpret_cast<LoadMemoryPointer>(level));
-		m_levelsStreamingToCpuStatus[level] = true;
-		return true;
 	}
-	else
+
+	buf->SignalFence(sync);
+
+	buf->StopRecording();
+
+	m_context->SubmitCommands(buf, GraphicsQueueType::Transfer);
+
+	co_await WaitForSync(sync);
+
+	delete sync;
+}
+
+bool TextureAsset::StreamLevelToCPU(int32_t level, std::function<void()> onStreamed)
+{
+	std::lock_guard streamingLock(m_streamingMutex);
+	if (m_levelsStreamingToCpuStatus[level]) // Another stream got there first, callers join it instead
+		return false;
+
+	if (m_levelsOnCpu[level])
 	{
-		XEngineInstance->LogMessage("Cannot stream mipmap level that is already being streamed!", LogMessageType::Error);
+		XEngineInstance->GetAssetManager()->GetAssetMemory().FreeSpace(m_levelsOnCpuData[level]);
+		m_levelsOnCpu[level] = false;
+	}
+
+	if (onStreamed)
+		m_levelsStreamingToCpuCallbacks[level].push_back(onStreamed);
+	m_levelsStreamingToCpuStatus[level] = true; // Before the request, the loader drops levels that are not flagged
+	XEngineInstance->GetAssetManager()->PushLoadRequest(m_loader, this, reinterpret_cast<LoadMemoryPointer>(level), [this, level]() { FinishLevelStreamToCPU(level); });
+	return true;
+}
+
+bool TextureAsset::JoinLevelStreamToCPU(int32_t level, std::function<void()> onStreamed)
+{
+	std::lock_guard streamingLock(m_streamingMutex);
+	if (!m_levelsStreamingToCpuStatus[level]) // Landed already, SetCPUData clears the flag before the callbacks run
 		return false;
+	m_levelsStreamingToCpuCallbacks[level].push_back(onStreamed);
+	return true;
+}
+
+void TextureAsset::FinishLevelStreamToCPU(int32_t level)
+{
+	std::vector<std::function<void()>> callbacks;
+	{
+		std::lock_guard streamingLock(m_streamingMutex);
+		callbacks.swap(m_levelsStreamingToCpuCallbacks[level]);
 	}
+	for (std::function<void()>& callback : callbacks) // Outside the lock, a callback may resume a coroutine that streams again
+		callback();
 }
 
 bool TextureAsset::DeleteCPULevel(int32_t level)
@@ -37,8 +37,10 @@ public:
 	XENGINEAPI glm::ivec3 GetMipLevelSize(int32_t level);
 
 	XENGINEAPI void LoadAllLevelsFully();
+	XENGINEAPI AsyncTask<> LoadAllLevelsFullyAsync(); // Same as LoadAllLevelsFully without blocking on the streams and the fence
 
-	XENGINEAPI bool StreamLevelToCPU(int32_t level);
+	XENGINEAPI bool StreamLevelToCPU(int32_t level, std::function<void()> onStreamed = nullptr); // False if the level is already streaming, join that stream instead
+	XENGINEAPI bool JoinLevelStreamToCPU(int32_t level, std::function<void()> onStreamed); // Call onStreamed once the stream in flight lands, false if the level is not streaming
 	XENGINEAPI bool DeleteCPULevel(int32_t level);
 	XENGINEAPI PinnedLocalMemory<char> GetCPULevelMemory(int32_t level);
 	XENGINEAPI std::vector<bool>& GetLevelsOnCPU();
@@ -58,6 +60,7 @@ private:
 	friend class TextureAssetLoader;
 
 	void CheckGpuStream();
+	void FinishLevelStreamToCPU(int32_t level); // Run every callback waiting on the level
 
 	TextureAssetLoader *m_loader;
 	UniqueId m_id;
@@ -81,6 +84,7 @@ private:
 	std::vector<bool> m_levelsOnGpu;
 
 	std::vector<bool> m_levelsStreamingToCpuStatus;
+	std::vector<std::vector<std::function<void()>>> m_levelsStreamingToCpuCallbacks; // Per level, guarded by m_streamingMutex
 	std::vector<bool> m_levelsStreamingToGpuStatus;
 	std::vector<std::shared_ptr<GraphicsSyncObject>> m_levelsStreamingToGpu;
 
@@ -0,0 +1,105 @@
+#include "pch.h"
+#include "ThreadLayout.h"
+#include "VirtualMemory.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+thread_local ThreadTag currentThreadTag = ThreadTag::Untagged;
+
+ThreadLayout ThreadLayout::FromHardware()
+{
+	int32_t cores = std::max<int32_t>(1, std::thread::hardware_concurrency());
+	int32_t shared = std::max(0, cores - 3); // Cores left after the main, graphics submission and IO threads
+
+	ThreadLayout layout;
+	layout.ECSThreads = shared * 3 / 4;
+	layout.WorkerThreads = std::max(1, shared - layout.ECSThreads);
+	layout.PinThreads = cores >= 4; // With fewer cores the forced worker thread would share one
+	layout.HugePages = VirtualMemoryRange::HugePagesAvailable();
+	return layout;
+}
+
+ThreadLayout ThreadLayout::FromThreadCount(int32_t threadCount)
+{
+	ThreadLayout layout;
+	layout.ECSThreads = std::max(0, threadCount - 2);
+	return layout;
+}
+
+int32_t ThreadLayout::GetCore(ThreadTag tag, int32_t index)
+{
+	if (!PinThreads)
+		return -1;
+
+	switch (tag) // Cores are handed out in this order
+	{
+	case ThreadTag::Main:
+		return 0;
+	case ThreadTag::GraphicsSubmission:
+		return 1;
+	case ThreadTag::IO:
+		return 2;
+	case ThreadTag::ECS:
+		return 3 + index;
+	case ThreadTag::Worker:
+		return 3 + ECSThreads + index;
+	default:
+		return -1;
+	}
+}
+
+std::map<ThreadTag, std::wstring> threadTagToName {
+	{ ThreadTag::Main, L"XEngine Main" }, { ThreadTag::ECS, L"XEngine ECS" }, { ThreadTag::Worker, L"XEngine Worker" },
+	{ ThreadTag::GraphicsSubmission, L"XEngine Graphics Submission" }, { ThreadTag::IO, L"XEngine IO" }
+};
+std::map<ThreadTag, std::string> threadTagToShortName { // pthread names are limited to 15 characters
+	{ ThreadTag::Main, "XE Main" }, { ThreadTag::ECS, "XE ECS" }, { ThreadTag::Worker, "XE Worker" },
+	{ ThreadTag::GraphicsSubmission, "XE Submit" }, { ThreadTag::IO, "XE IO" }
+};
+
+void TagCurrentThread(ThreadTag tag, int32_t index, int32_t core)
+{
+	currentThreadTag = tag;
+
+#ifdef _WIN32
+	std::wstring name = threadTagToName[tag] + L" " + std::to_wstring(index);
+	SetThreadDescription(GetCurrentThread(), name.c_str());
+	if (core >= 0)
+	{
+		GROUP_AFFINITY affinity = { }; // Cores are numbered across processor groups of up to 64 each, cores past the last group stay unpinned
+		int32_t first = 0;
+		for (WORD group = 0; group < GetActiveProcessorGroupCount(); ++group)
+		{
+			int32_t count = GetActiveProcessorCount(group);
+			if (core < first + count)
+			{
+				affinity.Group = group;
+				affinity.Mask = 1ull << (core - first);
+				SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+				break;
+			}
+			first += count;
+		}
+	}
+#else
+	std::string name = threadTagToShortName[tag] + " " + std::to_string(index);
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+	if (core >= 0 && core < CPU_SETSIZE) // Cores past the set size are left unpinned
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+#endif
+}
+
+ThreadTag GetCurrentThreadTag()
+{
+	return currentThreadTag;
+}
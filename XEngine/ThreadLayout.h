@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+#include "exports.h"
+
+enum class ThreadTag
+{
+	Untagged, Main, ECS, Worker, GraphicsSubmission, IO
+};
+
+class ThreadLayout // How many threads of each kind the engine starts, which cores they are pinned to and how the memory they walk is paged
+{
+public:
+	int32_t ECSThreads = 0; // Besides the main thread, which also runs ECS jobs
+	int32_t WorkerThreads = 2;
+	bool PinThreads = false;
+	bool HugePages = false; // Back ECS chunks and asset memory with transparent huge pages, fewer TLB misses at the cost of memory committed 2 MB at a time
+
+	XENGINEAPI static ThreadLayout FromHardware(); // One core each for the main, graphics submission and IO threads, the rest split between ECS and workers, huge pages where the system has them
+	XENGINEAPI static ThreadLayout FromThreadCount(int32_t threadCount); // Unpinned layout for a total thread budget, as InitializeEngine used to take
+
+	XENGINEAPI int32_t GetCore(ThreadTag tag, int32_t index = 0); // -1 if threads of this kind are not pinned
+};
+
+XENGINEAPI void TagCurrentThread(ThreadTag tag, int32_t index = 0, int32_t core = -1); // Name the calling thread and pin it if core is not -1
+XENGINEAPI ThreadTag GetCurrentThreadTag();
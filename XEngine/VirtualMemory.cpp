@@ -0,0 +1,103 @@
+#include "pch.h"
+#include "VirtualMemory.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#endif
+
+VirtualMemoryRange::VirtualMemoryRange(uint64_t reserveSize, bool hugePages)
+{
+	uint64_t page = hugePages ? HugePageSize : GetPageSize();
+	m_reserved = (reserveSize + page - 1) / page * page;
+#ifdef _WIN32
+	m_base = VirtualAlloc(nullptr, m_reserved, MEM_RESERVE, PAGE_NOACCESS); // Large pages have to be committed along with the reservation, so they are not used here
+#else
+	uint64_t slack = hugePages ? HugePageSize : 0; // Room to align the base, huge pages are only used for aligned 2 MB spans
+	char *mapped = reinterpret_cast<char *>(mmap(nullptr, m_reserved + slack, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+	if (mapped == MAP_FAILED)
+		m_base = nullptr;
+	else
+	{
+		char *aligned = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(mapped) + page - 1) / page * page);
+		if (aligned > mapped)
+			munmap(mapped, aligned - mapped);
+		if (mapped + slack > aligned)
+			munmap(aligned + m_reserved, mapped + slack - aligned);
+		m_base = aligned;
+	}
+#ifdef MADV_HUGEPAGE
+	if (m_base && hugePages)
+		m_hugePages = madvise(m_base, m_reserved, MADV_HUGEPAGE) == 0; // Fails without transparent huge page support, normal pages then
+#endif
+#endif
+	if (!m_base)
+		m_reserved = 0;
+}
+
+VirtualMemoryRange::~VirtualMemoryRange()
+{
+	if (!m_base)
+		return;
+#ifdef _WIN32
+	VirtualFree(m_base, 0, MEM_RELEASE);
+#else
+	munmap(m_base, m_reserved);
+#endif
+}
+
+bool VirtualMemoryRange::Commit(uint64_t offset, uint64_t size)
+{
+	if (size == 0)
+		return true;
+	if (offset + size > m_reserved)
+		return false;
+
+	char *start = reinterpret_cast<char *>(m_base) + offset;
+#ifdef _WIN32
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return mprotect(start, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void VirtualMemoryRange::Decommit(uint64_t offset, uint64_t size)
+{
+	if (size == 0 || offset + size > m_reserved)
+		return;
+
+	char *start = reinterpret_cast<char *>(m_base) + offset;
+#ifdef _WIN32
+	VirtualFree(start, size, MEM_DECOMMIT);
+#else
+	madvise(start, size, MADV_DONTNEED); // Drops the pages, then makes stray accesses fault like they would on Windows
+	mprotect(start, size, PROT_NONE);
+#endif
+}
+
+uint64_t VirtualMemoryRange::GetPageSize()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+bool VirtualMemoryRange::HugePagesAvailable()
+{
+#if defined(_WIN32) || !defined(MADV_HUGEPAGE)
+	return false;
+#else
+	std::ifstream settings("/sys/kernel/mm/transparent_hugepage/enabled"); // The selected mode is bracketed, "always [madvise] never"
+	std::string mode;
+	std::getline(settings, mode);
+	return mode.find("[always]") != std::string::npos || mode.find("[madvise]") != std::string::npos;
+#endif
+}
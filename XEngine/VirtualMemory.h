@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+
+#include "exports.h"
+
+constexpr uint64_t HugePageSize = 1 << 21;
+
+class VirtualMemoryRange // Address space reserved up front, pages only use memory while they are committed
+{
+public:
+	XENGINEAPI VirtualMemoryRange(uint64_t reserveSize, bool hugePages = false); // Huge pages fall back to normal ones where the system cannot do them on demand
+	XENGINEAPI ~VirtualMemoryRange();
+	VirtualMemoryRange(const VirtualMemoryRange&) = delete;
+
+	XENGINEAPI bool Commit(uint64_t offset, uint64_t size); // Offsets and sizes are multiples of the page size
+	XENGINEAPI void Decommit(uint64_t offset, uint64_t size); // Contents are lost, the range reads back as zeroes once committed again
+
+	void *GetBase() { return m_base; } // Null if the reservation failed
+	uint64_t GetReservedSize() { return m_reserved; }
+	bool HasHugePages() { return m_hugePages; } // Asked for and accepted, the kernel may still back parts with normal pages
+	XENGINEAPI static uint64_t GetPageSize();
+	XENGINEAPI static bool HugePagesAvailable(); // Transparent huge pages can be asked for, never on Windows where large pages need a privilege and up front commits
+private:
+	void *m_base;
+	uint64_t m_reserved;
+	bool m_hugePages = false;
+};
@@ -1,11 +1,102 @@
 #include "pch.h"
 #include "WorkerManager.h"
 
-WorkerManager::WorkerManager(int32_t threads)
+thread_local WorkerManager *currentWorkerManager = nullptr;
+thread_local int32_t currentWorkerIndex = -1;
+
+void WorkerFuture::Wait()
+{
+	while (!IsDone())
+		if (!m_manager->RunPendingTask()) // Nothing queued, the remaining work is running on other threads
+			std::this_thread::yield();
+}
+
+bool WorkerFuture::WaitFor(int32_t millitime)
+{
+	auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(millitime);
+	while (!IsDone())
+		if (std::chrono::steady_clock::now() >= end)
+			return false;
+		else if (!m_manager->RunPendingTask())
+			std::this_thread::yield();
+	return true;
+}
+
+void ParallelForRange::Execute(WorkerManager *manager)
+{
+	while (m_last - m_first > m_state->LeafSize) // Hand the upper half to whichever worker is free next
+	{
+		int32_t middle = m_first + (m_last - m_first) / 2;
+		manager->PushLocal(new ParallelForRange(m_state, middle, m_last), m_state->Priority);
+		m_last = middle;
+	}
+
+	m_state->Func(m_first, m_last);
+	m_state->Future->Pending.fetch_sub(m_last - m_first, std::memory_order_acq_rel);
+	delete this;
+}
+
+void WorkerJob::DependsOn(std::shared_ptr<WorkerJob> predecessor)
+{
+	std::lock_guard lock(predecessor->m_mutex);
+	if (predecessor->m_finished)
+		return;
+	++m_dependencies;
+	predecessor->m_successors.push_back(shared_from_this());
+}
+
+std::shared_ptr<WorkerJob> WorkerJob::Then(std::function<void()> func)
+{
+	return m_manager->EnqueueJob(func, { shared_from_this() });
+}
+
+void WorkerJob::Submit()
+{
+	m_self = shared_from_this();
+	if (--m_dependencies == 0) // Drop the submission hold, predecessors may all have finished already
+		m_manager->Push(this, m_priority);
+}
+
+void WorkerJob::Wait()
+{
+	while (!IsDone())
+		if (!m_manager->RunPendingTask())
+			std::this_thread::yield();
+}
+
+void WorkerJob::Execute(WorkerManager *manager)
 {
+	std::shared_ptr<WorkerJob> self = std::move(m_self); // Released when this returns
+	m_func();
+
+	std::vector<std::shared_ptr<WorkerJob>> successors;
+	{
+		std::lock_guard lock(m_mutex);
+		m_finished = true;
+		successors.swap(m_successors);
+	}
+	m_done.store(true, std::memory_order_release);
+
+	for (std::shared_ptr<WorkerJob>& successor : successors)
+	{
+		if (--successor->m_dependencies == 0) // Keep the chain on this worker, its data is likely still in cache
+			manager->PushLocal(successor.get(), successor->m_priority);
+	}
+}
+
+WorkerManager::WorkerManager(int32_t threads, int32_t firstCore) : m_firstCore(firstCore)
+{
+	for (int32_t i = 0; i < threads; ++i)
+	{
+		m_localQueues.push_back(new WorkerLocalQueue);
+		m_counters.push_back(new WorkerCounters);
+	}
+	m_frameBegin.resize(threads);
+	m_frameStats.Workers.resize(threads);
+	std::fill(std::begin(m_frameStats.LaneDepth), std::end(m_frameStats.LaneDepth), 0);
 	for (int32_t i = 0; i < threads; ++i)
 	{
-		std::thread *worker = new std::thread(&WorkerManager::RunThreadTasks, this);
+		std::thread *worker = new std::thread(&WorkerManager::RunThreadTasks, this, i);
 		m_threads.push_back(worker);
 	}
 }
@@ -18,6 +109,125 @@ WorkerManager::~WorkerManager()
 		worker->join();
 		delete worker;
 	}
+	for (WorkerLocalQueue *queue : m_localQueues)
+		delete queue;
+	for (WorkerCounters *counters : m_counters)
+		delete counters;
+}
+
+WorkerFuture WorkerManager::ParallelForRanges(int32_t begin, int32_t end, std::function<void(int32_t, int32_t)> func, int32_t grain, WorkerPriority priority)
+{
+	std::shared_ptr<WorkerFutureState> future = std::make_shared<WorkerFutureState>();
+	future->Pending = std::max(end - begin, 0);
+	if (end <= begin)
+		return WorkerFuture(this, future);
+
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->Func = func;
+	state->Future = future;
+	state->LeafSize = std::max(grain, GetChunkSize(end - begin));
+	state->Priority = priority;
+
+	Push(new ParallelForRange(state, begin, end), priority);
+	return WorkerFuture(this, future);
+}
+
+std::shared_ptr<WorkerJob> WorkerManager::CreateJob(std::function<void()> func, WorkerPriority priority)
+{
+	return std::make_shared<WorkerJob>(this, func, priority);
+}
+
+std::shared_ptr<WorkerJob> WorkerManager::EnqueueJob(std::function<void()> func, std::vector<std::shared_ptr<WorkerJob>> predecessors, WorkerPriority priority)
+{
+	std::shared_ptr<WorkerJob> job = CreateJob(func, priority);
+	for (std::shared_ptr<WorkerJob>& predecessor : predecessors)
+		job->DependsOn(predecessor);
+	job->Submit();
+	return job;
+}
+
+bool WorkerManager::RunPendingTask()
+{
+	int32_t worker = GetCurrentWorkerIndex();
+
+	InternalWorkerTask *task = nullptr;
+	bool stolen = false;
+	if (!m_lanes[static_cast<int32_t>(WorkerPriority::FrameCritical)].try_pop(task)) // Frame work first, checked again at every task boundary
+	{
+		task = worker >= 0 ? PopLocal(worker) : nullptr; // Then this worker's own queue, shared work and other workers' queues
+		if (!task && !m_lanes[static_cast<int32_t>(WorkerPriority::Normal)].try_pop(task))
+			stolen = (task = Steal(worker)) != nullptr;
+	}
+	if (!task)
+		return RunBackgroundTask();
+
+	CountJob(worker, stolen);
+	task->Execute(this);
+	return true;
+}
+
+void WorkerManager::BeginFrame()
+{
+	m_frameInFlight = true;
+
+	m_frameBegin = GetWorkerStats();
+	for (int32_t i = 0; i < m_localQueues.size(); ++i)
+	{
+		std::lock_guard lock(m_localQueues[i]->Mutex);
+		m_frameBegin[i].QueueDepth = m_localQueues[i]->Tasks.size();
+	}
+	for (int32_t i = 0; i < WorkerPriorityCount; ++i)
+		m_frameStats.LaneDepth[i] = m_lanes[i].unsafe_size();
+}
+
+void WorkerManager::EndFrame()
+{
+	m_frameInFlight = false;
+
+	std::vector<WorkerStats> totals = GetWorkerStats(); // Time is added once a task or an idle spin ends, so a task spanning frames counts toward the one it ends in
+	for (int32_t i = 0; i < totals.size(); ++i)
+	{
+		WorkerStats& stats = m_frameStats.Workers[i];
+		stats.BusyTime = totals[i].BusyTime - m_frameBegin[i].BusyTime;
+		stats.IdleTime = totals[i].IdleTime - m_frameBegin[i].IdleTime;
+		stats.JobsExecuted = totals[i].JobsExecuted - m_frameBegin[i].JobsExecuted;
+		stats.Steals = totals[i].Steals - m_frameBegin[i].Steals;
+		stats.QueueDepth = m_frameBegin[i].QueueDepth;
+	}
+}
+
+std::vector<WorkerStats> WorkerManager::GetWorkerStats()
+{
+	std::vector<WorkerStats> stats(m_counters.size());
+	for (int32_t i = 0; i < m_counters.size(); ++i)
+	{
+		WorkerCounters *counters = m_counters[i];
+		stats[i].BusyTime = counters->BusyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+		stats[i].IdleTime = counters->IdleNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+		stats[i].JobsExecuted = counters->JobsExecuted.load(std::memory_order_relaxed);
+		stats[i].Steals = counters->Steals.load(std::memory_order_relaxed);
+		stats[i].QueueDepth = 0;
+	}
+	return stats;
+}
+
+void WorkerManager::PushLocal(InternalWorkerTask *task, WorkerPriority priority)
+{
+	int32_t worker = GetCurrentWorkerIndex();
+	if (worker < 0 || priority != WorkerPriority::Normal) // Local queues are served at normal priority, other lanes keep their place
+	{
+		Push(task, priority);
+		return;
+	}
+
+	WorkerLocalQueue *queue = m_localQueues[worker];
+	std::lock_guard lock(queue->Mutex);
+	queue->Tasks.push_back(task);
+}
+
+int32_t WorkerManager::GetCurrentWorkerIndex()
+{
+	return currentWorkerManager == this ? currentWorkerIndex : -1;
 }
 
 void WorkerManager::CheckForFree()
@@ -34,20 +244,88 @@ void WorkerManager::CheckForFree()
 	}
 }
 
-void WorkerManager::RunThreadTasks()
+void WorkerManager::RunThreadTasks(int32_t index)
 {
+	currentWorkerManager = this;
+	currentWorkerIndex = index;
+	TagCurrentThread(ThreadTag::Worker, index, m_firstCore >= 0 ? m_firstCore + index : -1);
+
+	WorkerCounters *counters = m_counters[index];
+	auto last = std::chrono::steady_clock::now();
 	while (m_running)
 	{
-		InternalWorkerTask *task;
-		if (m_tasks.try_pop(task))
-		{
-			int32_t iteration = task->GetNextIterationNumber();
-			if (iteration >= 0)
-				m_tasks.push(task);
-			else
-				iteration = -iteration - 1;
-			task->Perform(iteration);
-		}
-		else std::this_thread::sleep_for(std::chrono::milliseconds(0));
+		FrameArena::SyncThread(); // Between top level tasks only, one running nested below a wait may still hold frame memory
+		bool ran = RunPendingTask();
+		if (!ran)
+			std::this_thread::sleep_for(std::chrono::milliseconds(0));
+
+		auto now = std::chrono::steady_clock::now(); // Tasks run while helping inside another task are part of the outer task's time
+		std::atomic<uint64_t>& time = ran ? counters->BusyNanoseconds : counters->IdleNanoseconds;
+		time.store(time.load(std::memory_order_relaxed) + std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count(), std::memory_order_relaxed);
+		last = now;
+	}
+}
+
+int32_t WorkerManager::GetChunkSize(int32_t iterations)
+{
+	return std::max(1, iterations / ((GetThreadCount() + 1) * 8));
+}
+
+bool WorkerManager::RunBackgroundTask()
+{
+	if (m_backgroundRunning.fetch_add(1) >= m_backgroundThrottle && m_frameInFlight) // Leave the other threads to the frame
+	{
+		--m_backgroundRunning;
+		return false;
+	}
+
+	InternalWorkerTask *task;
+	bool found = m_lanes[static_cast<int32_t>(WorkerPriority::Background)].try_pop(task);
+	if (found)
+	{
+		CountJob(GetCurrentWorkerIndex(), false);
+		task->Execute(this);
 	}
-}
\ No newline at end of file
+	--m_backgroundRunning;
+	return found;
+}
+
+void WorkerManager::CountJob(int32_t worker, bool stolen)
+{
+	if (worker < 0) // Threads outside the pool that help while waiting are not tracked
+		return;
+	WorkerCounters *counters = m_counters[worker];
+	counters->JobsExecuted.store(counters->JobsExecuted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (stolen)
+		counters->Steals.store(counters->Steals.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+InternalWorkerTask *WorkerManager::PopLocal(int32_t worker)
+{
+	WorkerLocalQueue *queue = m_localQueues[worker];
+	std::lock_guard lock(queue->Mutex);
+	if (queue->Tasks.empty())
+		return nullptr;
+	InternalWorkerTask *task = queue->Tasks.back();
+	queue->Tasks.pop_back();
+	return task;
+}
+
+InternalWorkerTask *WorkerManager::Steal(int32_t worker)
+{
+	int32_t count = m_localQueues.size();
+	for (int32_t i = 1; i <= count; ++i)
+	{
+		WorkerLocalQueue *queue = m_localQueues[(worker + i + count) % count];
+		if (queue == (worker >= 0 ? m_localQueues[worker] : nullptr))
+			continue;
+
+		std::lock_guard lock(queue->Mutex);
+		if (queue->Tasks.empty())
+			continue;
+		InternalWorkerTask *task = queue->Tasks.front();
+		queue->Tasks.pop_front();
+		return task;
+	}
+	return nullptr;
+}
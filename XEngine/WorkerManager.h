@@ -1,104 +1,288 @@
 #pragma once
 #include <functional>
-#include <concurrent_queue.h>
 #include <thread>
-#include <ctime>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <deque>
+#include <coroutine>
+
+#include "ThreadLayout.h"
+#include "ConcurrentQueue.h"
 
 class WorkerManager;
 
+enum class WorkerPriority
+{
+	FrameCritical, Normal, Background // Lanes are served in this order
+};
+constexpr int32_t WorkerPriorityCount = 3;
+
 class InternalWorkerTask
 {
 public:
 	virtual ~InternalWorkerTask() { }
-	virtual int32_t GetNextIterationNumber() = 0;
-	virtual void Perform(int32_t iteration) = 0;
+	virtual void Execute(WorkerManager *manager) = 0; // Run a share of the task, queueing the rest before starting so other workers can join
 	virtual bool IsFree() = 0;
 };
 
+class WorkerFutureState
+{
+public:
+	std::atomic_int Pending; // Iterations that have not finished yet
+};
+
+class WorkerFuture
+{
+public:
+	WorkerFuture() { }
+	WorkerFuture(WorkerManager *manager, std::shared_ptr<WorkerFutureState> state) : m_manager(manager), m_state(state) { }
+
+	XENGINEAPI void Wait(); // Execute queued tasks on the waiting thread until the work is done
+	XENGINEAPI bool WaitFor(int32_t millitime);
+	bool IsDone() { return !m_state || m_state->Pending.load(std::memory_order_acquire) == 0; }
+private:
+	WorkerManager *m_manager = nullptr;
+	std::shared_ptr<WorkerFutureState> m_state;
+};
+
+class ParallelForState
+{
+public:
+	std::function<void(int32_t, int32_t)> Func;
+	std::shared_ptr<WorkerFutureState> Future;
+	int32_t LeafSize;
+	WorkerPriority Priority;
+};
+
+class ParallelForRange : public InternalWorkerTask
+{
+public:
+	ParallelForRange(std::shared_ptr<ParallelForState> state, int32_t first, int32_t last) : m_state(state), m_first(first), m_last(last) { }
+	XENGINEAPI virtual void Execute(WorkerManager *manager) override; // Split off halves for other workers until a leaf is left, deletes itself once done
+	virtual bool IsFree() override { return true; }
+private:
+	std::shared_ptr<ParallelForState> m_state;
+	int32_t m_first;
+	int32_t m_last;
+};
+
+class WorkerJob : public InternalWorkerTask, public std::enable_shared_from_this<WorkerJob>
+{
+public:
+	WorkerJob(WorkerManager *manager, std::function<void()> func, WorkerPriority priority) : m_manager(manager), m_func(func), m_priority(priority),
+		m_dependencies(1), m_done(false) { }
+	XENGINEAPI void DependsOn(std::shared_ptr<WorkerJob> predecessor); // Only valid before the job is submitted
+	XENGINEAPI std::shared_ptr<WorkerJob> Then(std::function<void()> func); // Submit a job that starts once this one has finished
+	XENGINEAPI void Submit(); // The job is queued as soon as its last predecessor finishes
+	XENGINEAPI void Wait(); // Execute queued tasks on the waiting thread until the job is done
+	bool IsDone() { return m_done.load(std::memory_order_acquire); }
+
+	XENGINEAPI virtual void Execute(WorkerManager *manager) override; // Run the job and queue the successors it was the last predecessor of
+	virtual bool IsFree() override { return true; }
+private:
+	WorkerManager *m_manager;
+	std::function<void()> m_func;
+	WorkerPriority m_priority;
+
+	std::atomic_int m_dependencies; // Unfinished predecessors, plus one until the job is submitted
+	std::mutex m_mutex;
+	std::vector<std::shared_ptr<WorkerJob>> m_successors;
+	bool m_finished = false; // Guarded by m_mutex, successors added afterwards do not wait on this job
+	std::atomic_bool m_done;
+
+	std::shared_ptr<WorkerJob> m_self; // Keeps the job alive while it is waiting or queued
+};
+
+class WorkerStats
+{
+public:
+	double BusyTime; // Seconds spent running tasks, double so that per-frame deltas of long-running totals stay precise
+	double IdleTime; // Seconds spent finding nothing to run
+	uint64_t JobsExecuted; // Tasks run, a task that requeues itself between chunks counts once per chunk
+	uint64_t Steals; // Tasks taken from another worker's queue
+	int32_t QueueDepth; // Tasks in the worker's own queue when the frame started
+};
+
+class WorkerPoolStats
+{
+public:
+	std::vector<WorkerStats> Workers;
+	int32_t LaneDepth[WorkerPriorityCount]; // Tasks waiting in each shared lane when the frame started
+};
+
+class alignas(CacheLineSize) WorkerCounters // Only written by the owning worker, read from anywhere
+{
+public:
+	std::atomic<uint64_t> BusyNanoseconds = 0;
+	std::atomic<uint64_t> IdleNanoseconds = 0;
+	std::atomic<uint64_t> JobsExecuted = 0;
+	std::atomic<uint64_t> Steals = 0;
+	std::atomic<int32_t> QueueDepth = 0;
+};
+
+class WorkerLocalQueue
+{
+public:
+	std::mutex Mutex;
+	std::deque<InternalWorkerTask *> Tasks; // The owning worker takes from the back, other threads steal from the front
+};
+
+class CoroutineResumeTask : public InternalWorkerTask
+{
+public:
+	CoroutineResumeTask(std::coroutine_handle<> handle) : m_handle(handle) { }
+	virtual void Execute(WorkerManager *manager) override
+	{
+		std::coroutine_handle<> handle = m_handle;
+		delete this;
+		handle.resume();
+	}
+	virtual bool IsFree() override { return true; }
+private:
+	std::coroutine_handle<> m_handle;
+};
+
+template<class T>
+class WorkerTask;
+
+class WorkerManager
+{
+public:
+	XENGINEAPI WorkerManager(int32_t threads, int32_t firstCore = -1); // Worker i is pinned to firstCore + i unless firstCore is -1
+	XENGINEAPI ~WorkerManager();
+	template<class T>
+	WorkerTask<T>& EnqueueTask(std::function<T(int32_t)> task, int32_t iterations, WorkerPriority priority = WorkerPriority::Normal)
+	{
+		WorkerTask<T> *taskd = new WorkerTask<T>(this, task, iterations, GetChunkSize(iterations), priority);
+		if (iterations > 0)
+		{
+			Push(taskd, priority);
+			m_workerTaskHolders.push_back(taskd);
+		}
+		return *taskd;
+	}
+
+	template<class F>
+	WorkerFuture ParallelFor(int32_t begin, int32_t end, F func, int32_t grain = 0, WorkerPriority priority = WorkerPriority::Normal) // Run func(i) for every i in [begin, end)
+	{
+		return ParallelForRanges(begin, end, [func](int32_t first, int32_t last)
+			{
+				for (int32_t i = first; i < last; ++i)
+					func(i);
+			}, grain, priority);
+	}
+	XENGINEAPI WorkerFuture ParallelForRanges(int32_t begin, int32_t end, std::function<void(int32_t, int32_t)> func, int32_t grain = 0,
+		WorkerPriority priority = WorkerPriority::Normal); // Run func once per leaf range
+
+	XENGINEAPI std::shared_ptr<WorkerJob> CreateJob(std::function<void()> func, WorkerPriority priority = WorkerPriority::Normal); // Job that waits for Submit, so predecessors can be declared first
+	XENGINEAPI std::shared_ptr<WorkerJob> EnqueueJob(std::function<void()> func, std::vector<std::shared_ptr<WorkerJob>> predecessors = {},
+		WorkerPriority priority = WorkerPriority::Normal);
+
+	XENGINEAPI bool RunPendingTask(); // Execute one queued task on the calling thread, false if the queue was empty
+	inline void Push(InternalWorkerTask *task, WorkerPriority priority = WorkerPriority::Normal) { m_lanes[static_cast<int32_t>(priority)].push(task); }
+	inline void Schedule(std::coroutine_handle<> handle, WorkerPriority priority = WorkerPriority::Normal) { Push(new CoroutineResumeTask(handle), priority); } // Resume a suspended coroutine on a worker
+	XENGINEAPI void PushLocal(InternalWorkerTask *task, WorkerPriority priority = WorkerPriority::Normal); // Queue on the calling worker's own queue, or the lane from other threads
+
+	XENGINEAPI void BeginFrame(); // Background work is throttled until EndFrame
+	XENGINEAPI void EndFrame();
+	XENGINEAPI std::vector<WorkerStats> GetWorkerStats(); // Totals since the pool started
+	inline WorkerPoolStats& GetFrameStats() { return m_frameStats; } // Counted between the last BeginFrame and EndFrame, only read from the thread calling them
+	inline void SetBackgroundThrottle(int32_t threads) { m_backgroundThrottle = threads; } // Threads allowed to run background tasks while a frame is in flight
+	XENGINEAPI int32_t GetCurrentWorkerIndex(); // Index of the calling worker thread, -1 if it does not belong to this manager
+	inline int32_t GetThreadCount() { return m_threads.size(); }
+
+	XENGINEAPI void CheckForFree();
+private:
+	std::atomic_bool m_running = true;
+	void RunThreadTasks(int32_t index);
+	int32_t GetChunkSize(int32_t iterations); // Enough chunks per thread to balance uneven iterations
+	InternalWorkerTask *PopLocal(int32_t worker);
+	InternalWorkerTask *Steal(int32_t worker);
+	bool RunBackgroundTask();
+	void CountJob(int32_t worker, bool stolen);
+
+	std::vector<std::thread *> m_threads;
+	std::vector<WorkerLocalQueue *> m_localQueues;
+	std::vector<WorkerCounters *> m_counters;
+	std::vector<WorkerStats> m_frameBegin; // Totals when the frame started
+	WorkerPoolStats m_frameStats;
+	std::vector<InternalWorkerTask *> m_workerTaskHolders;
+	ConcurrentQueue<InternalWorkerTask *> m_lanes[WorkerPriorityCount];
+	int32_t m_firstCore;
+
+	std::atomic_bool m_frameInFlight = false;
+	std::atomic_int m_backgroundRunning = 0;
+	int32_t m_backgroundThrottle = 1;
+};
+
 template<class T>
 class WorkerTask : public InternalWorkerTask
 {
 public:
-	WorkerTask(std::function<T(int32_t)> func, int32_t iterCount) : m_func(func), m_freed(false), 
-		m_resultsReturned(0), m_resultsExpected(iterCount), m_iterQueued(0)
+	WorkerTask(WorkerManager *manager, std::function<T(int32_t)> func, int32_t iterCount, int32_t chunkSize, WorkerPriority priority) : m_manager(manager),
+		m_func(func), m_freed(false), m_resultsReturned(0), m_resultsExpected(iterCount), m_iterQueued(0), m_chunkSize(chunkSize), m_priority(priority)
 	{
-		m_resultCounter.resize(iterCount);
-		m_results.resize(iterCount);
+		m_resultCounter.reset(new std::atomic_bool[iterCount]());
+		m_resultStore.reset(new T[iterCount]);
 	}
 	virtual ~WorkerTask() override { }
-	void BlockUntilDone() 
-	{ 
-		while (m_resultsExpected != m_resultsReturned)
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	void BlockUntilDone()
+	{
+		while (!IsDone())
+			if (!m_manager->RunPendingTask()) // Help with queued work instead of sleeping
+				std::this_thread::yield();
 	}
 	bool BlockUntilDoneFor(int32_t millitime)
 	{
-		clock_t t = std::clock();
-		while (m_resultsExpected != m_resultsReturned)
-			if ((clock() - t) / CLOCKS_PER_SEC * 1000 >= millitime)
+		auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(millitime);
+		while (!IsDone())
+			if (std::chrono::steady_clock::now() >= end)
 				return false;
-			else
-				std::this_thread::sleep_for(std::milli(1));
+			else if (!m_manager->RunPendingTask())
+				std::this_thread::yield();
 		return true;
 	}
 	void Destroy() { m_freed = true; }
 	bool IsDone() { return m_resultsExpected == m_resultsReturned; }
-	int32_t GetRemainingIterationsCount() { return m_resultsReturned; }
+	int32_t GetRemainingIterationsCount() { return m_resultsExpected - m_resultsReturned; }
 	int32_t GetExpectedIterationsCount() { return m_resultsExpected; }
-	bool IsIterationDone(int32_t iteration) { return m_resultCounter[iteration]; }
-	std::vector<T>& GetResults() { BlockUntilDone(); return m_results; }
-
-	virtual void Perform(int32_t iteration) 
+	bool IsIterationDone(int32_t iteration) { return m_resultCounter[iteration].load(std::memory_order_acquire); }
+	std::vector<T>& GetResults()
 	{
-		m_results[iteration] = m_func(iteration);
-		m_resultCounter[iteration] = true;
-		++m_resultsReturned;
+		BlockUntilDone();
+		if (m_results.size() != m_resultsExpected) // Results are written to a plain array so that no two iterations share storage, as they would in a vector<bool>
+			m_results.assign(std::make_move_iterator(m_resultStore.get()), std::make_move_iterator(m_resultStore.get() + m_resultsExpected));
+		return m_results;
 	}
 
-	virtual int32_t GetNextIterationNumber()
+	virtual void Execute(WorkerManager *manager) override
 	{
-		int32_t i = m_iterQueued++;
-		if (m_iterQueued >= m_resultsExpected)
-			return -i - 1;
-		else
-			return i;
+		int32_t first = m_iterQueued.fetch_add(m_chunkSize); // Claim a chunk, the queue holds at most one entry of this task so the claim is never past the end
+		int32_t last = std::min(first + m_chunkSize, m_resultsExpected.load());
+		if (last < m_resultsExpected) // Requeued between chunks, so higher lanes get in at every chunk boundary
+			manager->Push(this, m_priority);
+
+		for (int32_t iteration = first; iteration < last; ++iteration)
+		{
+			m_resultStore[iteration] = m_func(iteration);
+			m_resultCounter[iteration].store(true, std::memory_order_release);
+		}
+		m_resultsReturned += last - first;
 	}
 
 	virtual bool IsFree() override { return m_freed; }
 private:
+	WorkerManager *m_manager;
 	std::function<T(int32_t)> m_func;
-	std::vector<bool> m_resultCounter;
+	std::unique_ptr<std::atomic_bool[]> m_resultCounter;
+	std::unique_ptr<T[]> m_resultStore;
 	std::vector<T> m_results;
 	std::atomic<bool> m_freed;
 	std::atomic<int32_t> m_resultsReturned;
 	std::atomic<int32_t> m_resultsExpected;
 	std::atomic<int32_t> m_iterQueued;
+	int32_t m_chunkSize;
+	WorkerPriority m_priority;
 };
-
-class WorkerManager
-{
-public:
-	XENGINEAPI WorkerManager(int32_t threads);
-	XENGINEAPI ~WorkerManager();
-	template<class T>
-	WorkerTask<T>& EnqueueTask(std::function<T(int32_t)> task, int32_t iterations)
-	{
-		WorkerTask<T> *taskd = new WorkerTask<T>(task, iterations);
-		if (iterations > 0)
-		{
-			m_tasks.push(taskd);
-			m_workerTaskHolders.push_back(taskd);
-		}
-		return *taskd;
-	}
-
-	XENGINEAPI void CheckForFree();
-private:
-	bool m_running = true;
-	void RunThreadTasks();
-
-	std::vector<std::thread *> m_threads;
-	std::vector<InternalWorkerTask *> m_workerTaskHolders;
-	concurrency::concurrent_queue<InternalWorkerTask *> m_tasks;
-};
-
@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "WorldCell.h"
+
+WorldCell::WorldCell(Scene *scene) : m_scene(scene), m_ready(false)
+{
+}
+
+WorldCell::~WorldCell()
+{
+	if (m_thread)
+	{
+		m_thread->join();
+		delete m_thread;
+	}
+	for (auto& archetypePair : m_archetypes)
+	{
+		for (MemoryChunkAllocator& alloc : archetypePair.second->Allocators)
+			alloc.CleanupAllocator(); // Moved out if the cell was attached
+		delete archetypePair.second;
+	}
+	for (IAsset *asset : m_assets)
+		asset->RemoveRef();
+}
+
+void WorldCell::PrepareAsync(std::function<void(WorldCell&)> builder)
+{
+	m_thread = new std::thread([this, builder]()
+	{
+		builder(*this);
+		m_ready = true;
+	});
+}
+
+std::vector<ComponentGroupId> WorldCell::AddEntities(ComponentRowTemplate& rowTemplate, int32_t count)
+{
+	ComponentManager *manager = m_scene->GetComponentManager();
+
+	WorldCellArchetype *&archetype = m_archetypes[rowTemplate.Components];
+	if (!archetype) // First rows of this archetype, lay out staging columns from the registrar alone, the manager's archetype maps belong to the main thread
+	{
+		ECSRegistrar *registrar = XEngine::GetInstance().GetECSRegistrar();
+		archetype = new WorldCellArchetype;
+		archetype->PointerSpace = MemoryChunkAllocator::ReservePointerSpace();
+		archetype->OverflowArena = std::make_unique<ArenaAllocator>();
+		archetype->ComponentIndices = rowTemplate.ComponentIndices;
+		for (int32_t index : rowTemplate.ComponentIndices)
+			archetype->Allocators.push_back(MemoryChunkAllocator(manager->GetChunkSize(), registrar->GetComponentInfoByIndex(index).Size, archetype->PointerSpace));
+	}
+
+	std::vector<ComponentGroupId> ids(count);
+	std::vector<MemoryChunkObjectPointer> ptrs(count);
+	manager->StampRows(archetype->ComponentIndices, archetype->Allocators, archetype->OverflowArena.get(), rowTemplate, count, ids.data(), ptrs.data(), true); // Found by pointer once attached, no row is registered
+
+	m_entityIds.insert(m_entityIds.end(), ids.begin(), ids.end());
+	return ids;
+}
+
+void WorldCell::RequestAsset(UniqueId id)
+{
+	IAsset *asset = XEngineInstance->GetAssetManager()->GetAssetPtr(id);
+	if (!asset)
+		return;
+	asset->AddRef();
+	m_assets.push_back(asset);
+}
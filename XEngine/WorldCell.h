@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "Component.h"
+
+class WorldCellArchetype
+{
+public:
+	std::vector<int32_t> ComponentIndices; // Dense component index of each column, in the column order the live archetype will use
+	MemoryChunkObjectPointer PointerSpace; // Of this archetype alone, so the space of a row's pointer tells which type holds it
+	std::vector<MemoryChunkAllocator> Allocators; // Columns the rows are built in, the manager takes them over whole
+	std::unique_ptr<ArenaAllocator> OverflowArena; // Buffered component storage, handed over along with the columns
+	ComponentGroupType *Type = nullptr; // Holding the rows once the cell is attached
+};
+
+class Scene;
+class IAsset;
+class WorldCell
+{
+public:
+	XENGINEAPI WorldCell(Scene *scene);
+	XENGINEAPI ~WorldCell();
+
+	XENGINEAPI void PrepareAsync(std::function<void(WorldCell&)> builder); // Run builder on a background thread, the cell is ready once it returns
+	XENGINEAPI std::vector<ComponentGroupId> AddEntities(ComponentRowTemplate& rowTemplate, int32_t count); // Build rows into the cell's own chunks
+	XENGINEAPI void RequestAsset(UniqueId id); // Keep an asset referenced for as long as the cell lives
+
+	inline bool IsReady() { return m_ready; }
+	inline bool IsAttached() { return m_attached; }
+	inline std::vector<ComponentGroupId>& GetEntityIds() { return m_entityIds; }
+	inline Scene *GetScene() { return m_scene; }
+private:
+	friend ComponentManager;
+
+	Scene *m_scene;
+
+	std::map<std::set<ComponentTypeId>, WorldCellArchetype *> m_archetypes; // Keyed by components, archetypes are only resolved on the main thread once the cell is attached
+	std::vector<ComponentGroupId> m_entityIds;
+	std::vector<IAsset *> m_assets; // Referenced until the cell is destroyed
+
+	std::thread *m_thread = nullptr;
+	std::atomic_bool m_ready;
+	bool m_attached = false;
+};
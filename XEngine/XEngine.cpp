@@ -5,18 +5,27 @@
 
 #include "MeshAsset.h"
 #include "TextureAsset.h"
+#include "ProtoAsset.h"
 
 #include "OBJMeshImporter.h"
 #include "ImageImporter.h"
 
+#include <cstdio>
+#include <mutex>
+
 XEngine *XEngineInstance;
 XEngine *XEngine::m_engineInstance;
 
 void XEngine::InitializeEngine(std::string name, int32_t threadCount, bool defaultSystems, std::string rootPath)
 {
-	XEngineInstance = m_engineInstance = new XEngine;
+	InitializeEngine(name, ThreadLayout::FromThreadCount(threadCount), defaultSystems, rootPath);
+}
+
+void XEngine::InitializeEngine(std::string name, ThreadLayout layout, bool defaultSystems, std::string rootPath)
+{
+	XEngineInstance = m_engineInstance = new XEngine(layout);
 	m_engineInstance->m_name = name;
-	m_engineInstance->m_maxECSThreads = std::max(0, threadCount - 2);
+	m_engineInstance->m_maxECSThreads = layout.ECSThreads;
 	m_engineInstance->m_rootPath = rootPath;
 	m_engineInstance->m_ecsThreads = new std::thread *[m_engineInstance->m_maxECSThreads];
 }
@@ -47,11 +56,13 @@ void XEngine::AddInterface(HardwareInterface *interface, HardwareInterfaceType t
 	}
 }
 
-XEngine::XEngine() : m_scene(nullptr)
+XEngine::XEngine(ThreadLayout layout) : m_scene(nullptr), m_threadLayout(layout)
 {
 	m_engineInstanceId = GenerateID();
 
-	m_assetManager = new AssetManager(8e8, 2e9); // Hardcoded numbers
+	m_workerManager = new WorkerManager(layout.WorkerThreads, layout.GetCore(ThreadTag::Worker)); // Resumes coroutines and runs jobs off the ECS threads
+	MemoryChunkPool::GetInstance().SetHugePageSlabs(layout.HugePages); // Chunks are walked by every system, fewer TLB misses over them
+	m_assetManager = new AssetManager(8e8, 2e9, layout.GetCore(ThreadTag::IO), layout.HugePages); // Soft limits, memory is only committed as it gets used
 
 	m_sysManager = new SubsystemManager;
 	m_ecsRegistrar = new ECSRegistrar;
@@ -62,6 +73,7 @@ XEngine::~XEngine()
 	delete m_sysManager;
 	delete m_ecsRegistrar;
 	delete m_assetManager;
+	delete m_workerManager;
 	delete[] m_ecsThreads;
 }
 
@@ -72,6 +84,7 @@ void XEngine::Run()
 	int32_t intervalCount = 0;
 	m_beginTime = std::chrono::high_resolution_clock::now();
 	m_running = true;
+	TagCurrentThread(ThreadTag::Main, 0, m_threadLayout.GetCore(ThreadTag::Main));
 	Init();
 	while (m_running)
 	{
@@ -222,19 +235,38 @@ void XEngine::AddEndMarker(std::string label)
 
 void XEngine::LogMessage(std::string message, LogMessageType type)
 {
+	Log(m_name + ": " + message, type);
+}
+
+void XEngine::Log(std::string message, LogMessageType type)
+{
+	static std::mutex logMutex; // Keeps lines from different threads whole
+	std::lock_guard lock(logMutex);
 	switch (type)
 	{
 	case LogMessageType::Error:
+		fprintf(stderr, "Error: %s\n", message.c_str());
 		break;
 	case LogMessageType::Warning:
+		fprintf(stderr, "Warning: %s\n", message.c_str());
 		break;
 	case LogMessageType::Message:
+		fprintf(stdout, "%s\n", message.c_str());
 		break;
 	case LogMessageType::Internal:
+		fprintf(stdout, "Internal: %s\n", message.c_str());
 		break;
 	}
 }
 
+void XEngine::LogAnywhere(std::string message, LogMessageType type)
+{
+	if (m_engineInstance)
+		m_engineInstance->LogMessage(message, type);
+	else
+		Log(message, type);
+}
+
 void XEngine::RaiseCriticalError(std::string error)
 {
 	LogMessage("CRITICAL ERROR (shutdown necessary) " + error, LogMessageType::Error);
@@ -280,14 +312,48 @@ AssetManager *XEngine::GetAssetManager()
 	return m_assetManager;
 }
 
+WorkerManager *XEngine::GetWorkerManager()
+{
+	return m_workerManager;
+}
+
+std::vector<FrameArenaStats> XEngine::GetFrameArenaStats()
+{
+	return FrameArena::GetThreadArenaStats();
+}
+
+std::vector<WorkerStats> XEngine::GetWorkerStats()
+{
+	return m_workerManager->GetWorkerStats();
+}
+
+std::vector<EngineFrameStats> XEngine::GetFrameStats(uint64_t sinceFrame)
+{
+	return m_frameStats.GetSince(sinceFrame);
+}
+
+uint64_t XEngine::GetLatestStatsFrame()
+{
+	return m_frameStats.GetLatestFrame();
+}
+
+std::vector<ListAllocatorStats> XEngine::GetAllocatorStats()
+{
+	return ListAllocator::GetAllStats();
+}
+
 void XEngine::Tick(float deltaTime)
 {
+	auto tickStart = std::chrono::steady_clock::now();
+
 	for (auto kp : m_hwInterfaces)
 	{
 		if (kp.second && kp.second->GetStatus(kp.first) == HardwareStatus::Initialized && !m_excludeFromFrame[kp.first])
 			kp.second->BeginFrame();
 	}
 
+	m_workerManager->BeginFrame(); // Background jobs give way to the frame until it ends
+
 	if (m_scene)
 	{
 		m_sysManager->ScheduleJobs();
@@ -302,6 +368,22 @@ void XEngine::Tick(float deltaTime)
 		if (kp.second && kp.second->GetStatus(kp.first) == HardwareStatus::Initialized && !m_excludeFromFrame[kp.first])
 			kp.second->EndFrame();
 	}
+
+	FrameArena::EndFrame(); // Transient memory of this frame can be reused
+	FrameArena::SyncThread();
+	m_workerManager->EndFrame();
+
+	if (!m_defragJob || m_defragJob->IsDone()) // One budgeted pass per frame at most, in the background lane so it never delays the frame
+		m_defragJob = m_workerManager->EnqueueJob([]() { ListAllocator::RunDefragBudgets(); }, {}, WorkerPriority::Background);
+
+	EngineFrameStats stats;
+	stats.FrameTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - tickStart).count();
+	stats.Workers = m_workerManager->GetFrameStats();
+	if (m_scene)
+		stats.Systems = m_sysManager->CollectFrameStats();
+	if (m_allocatorStatsPerFrame)
+		stats.Allocators = ListAllocator::GetAllStats();
+	m_frameStats.Push(std::move(stats));
 }
 
 std::map<HardwareInterfaceType, std::string> interfaceToName {
@@ -334,6 +416,7 @@ void XEngine::Init()
 
 	m_assetManager->RegisterLoader(new MeshAssetLoader(1e12, 1e8));
 	m_assetManager->RegisterLoader(new TextureAssetLoader);
+	m_assetManager->RegisterLoader(new ProtoAssetLoader);
 	m_assetManager->RegisterImporter(new OBJMeshImporter);
 	m_assetManager->RegisterImporter(new ImageImporter);
 
@@ -374,8 +457,11 @@ void XEngine::Cleanup()
 
 void XEngine::RunECSThread(int32_t index)
 {
+	TagCurrentThread(ThreadTag::ECS, index - 1, m_threadLayout.GetCore(ThreadTag::ECS, index - 1));
+
 	while (m_running)
 	{
+		FrameArena::SyncThread();
 		if (m_ecsQueued > 0)
 		{
 			--m_ecsQueued;
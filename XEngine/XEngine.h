@@ -7,8 +7,11 @@
 
 #include "ECS.h"
 #include "HardwareInterfaces.h"
+#include "ThreadLayout.h"
 #include "WorkerManager.h"
+#include "AsyncTask.h"
 #include "AssetManager.h"
+#include "FrameStats.h"
 
 enum class LogMessageType
 {
@@ -18,7 +21,7 @@ enum class LogMessageType
 class XEngine
 {
 public:
-	XENGINEAPI XEngine();
+	XENGINEAPI XEngine(ThreadLayout layout = ThreadLayout());
 	XENGINEAPI ~XEngine();
 
 	XENGINEAPI void Run();
@@ -48,6 +51,7 @@ public:
 	XENGINEAPI void AddEndMarker(std::string label);
 
 	XENGINEAPI void LogMessage(std::string message, LogMessageType type);
+	XENGINEAPI static void LogAnywhere(std::string message, LogMessageType type); // Through the engine if there is one, straight to the console from tools and tests that run without it
 	XENGINEAPI void RaiseCriticalError(std::string error);
 
 	XENGINEAPI void SetRootPath(std::string rootPath);
@@ -57,8 +61,18 @@ public:
 	XENGINEAPI SubsystemManager *GetSubsystemManager();
 	XENGINEAPI ECSRegistrar *GetECSRegistrar();
 	XENGINEAPI AssetManager *GetAssetManager();
+	XENGINEAPI WorkerManager *GetWorkerManager();
+	inline ThreadLayout& GetThreadLayout() { return m_threadLayout; }
+
+	XENGINEAPI std::vector<FrameArenaStats> GetFrameArenaStats(); // Usage and high-water marks of every thread's frame arena
+	XENGINEAPI std::vector<WorkerStats> GetWorkerStats(); // Totals for every worker since startup
+	XENGINEAPI std::vector<EngineFrameStats> GetFrameStats(uint64_t sinceFrame = 0); // Worker, system and allocator stats of the buffered frames after sinceFrame
+	XENGINEAPI uint64_t GetLatestStatsFrame();
+	XENGINEAPI std::vector<ListAllocatorStats> GetAllocatorStats(); // Usage, fragmentation and defrag work of every list allocator
+	inline void SetAllocatorStatsPerFrame(bool enabled) { m_allocatorStatsPerFrame = enabled; } // Adds them to every frame's stats, off by default
 
 	XENGINEAPI static void InitializeEngine(std::string name, int32_t threadCount, bool defaultSystems = true, std::string rootPath = "");
+	XENGINEAPI static void InitializeEngine(std::string name, ThreadLayout layout, bool defaultSystems = true, std::string rootPath = "");
 	XENGINEAPI static XEngine& GetInstance();
 
 	XENGINEAPI void DoIdleWork();
@@ -82,6 +96,7 @@ public:
 	std::string GetName() { return m_name; }
 
 private:
+	static void Log(std::string message, LogMessageType type); // Errors and warnings to stderr, the rest to stdout
 	void Tick(float deltaTime);
 	void Init();
 	void Cleanup();
@@ -98,6 +113,7 @@ private:
 	std::string m_name;
 
 	int32_t m_maxECSThreads;
+	ThreadLayout m_threadLayout;
 
 	int32_t m_maxFps = 240;
 	int32_t m_fps = 0;
@@ -110,6 +126,7 @@ private:
 	Scene *m_scene;
 	SubsystemManager *m_sysManager;
 	AssetManager *m_assetManager;
+	WorkerManager *m_workerManager;
 
 	std::map<UniqueId, glm::ivec2> m_timeAndScale;
 	float m_globalTimeScale = 1.f;
@@ -122,6 +139,10 @@ private:
 
 	std::map<HardwareInterfaceType, HardwareInterface *> m_hwInterfaces;
 	std::map<HardwareInterfaceType, bool> m_excludeFromFrame;
+
+	FrameStatsRing m_frameStats;
+	bool m_allocatorStatsPerFrame = false;
+	std::shared_ptr<WorkerJob> m_defragJob; // Last frame's allocator defrag pass
 };
 
 XENGINEAPI extern XEngine *XEngineInstance;
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <ConcurrentQueue.h>
+#include <ConcurrentHashMap.h>
+#include <queue>
+#include <unordered_map>
+
+constexpr int32_t QueueItemsPerProducer = 200000;
+constexpr int32_t MapOpsPerThread = 200000;
+constexpr int32_t MapKeyRange = 1 << 16;
+constexpr int32_t ThreadCounts[] = { 1, 2, 4, 8, 16, 32 };
+
+template<class T>
+class MutexQueue // The baseline: one lock around a std::queue
+{
+public:
+	void push(const T& value)
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.push(value);
+	}
+	bool try_pop(T& value)
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_queue.empty())
+			return false;
+		value = m_queue.front();
+		m_queue.pop();
+		return true;
+	}
+private:
+	std::mutex m_mutex;
+	std::queue<T> m_queue;
+};
+
+template<class Queue, class Push>
+static double RunQueue(Queue& queue, Push push, int32_t threads, bool& valid) // Seconds for threads producers and threads consumers to move every item through
+{
+	std::atomic_int64_t popped = 0;
+	std::atomic_int64_t sum = 0;
+	int64_t total = static_cast<int64_t>(threads) * QueueItemsPerProducer;
+	std::atomic_bool start = false;
+	std::vector<std::thread> pool;
+
+	for (int32_t t = 0; t < threads; ++t)
+	{
+		pool.emplace_back([&, t]()
+			{
+				while (!start.load(std::memory_order_acquire));
+				for (int32_t i = 0; i < QueueItemsPerProducer; ++i)
+					push(queue, t * QueueItemsPerProducer + i);
+			});
+		pool.emplace_back([&]()
+			{
+				while (!start.load(std::memory_order_acquire));
+				int64_t localSum = 0;
+				int32_t value;
+				while (popped.load(std::memory_order_relaxed) < total)
+				{
+					if (queue.try_pop(value))
+					{
+						localSum += value;
+						popped.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+						std::this_thread::yield();
+				}
+				sum += localSum;
+			});
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	start.store(true, std::memory_order_release);
+	for (std::thread& thread : pool)
+		thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	valid = popped == total && sum == total * (total - 1) / 2; // Every item arrived exactly once
+	return seconds;
+}
+
+XBENCHMARK(ConcurrentQueueVersusMutex)
+{
+	printf("%d items per producer, as many consumers as producers, million items per second\n", QueueItemsPerProducer);
+	printf("  producers    mutex   unbounded   bounded\n");
+	for (int32_t threads : ThreadCounts)
+	{
+		bool valid;
+		MutexQueue<int32_t> mutexQueue;
+		double mutexTime = RunQueue(mutexQueue, [](MutexQueue<int32_t>& q, int32_t v) { q.push(v); }, threads, valid);
+		XCHECK(valid);
+
+		ConcurrentQueue<int32_t> unbounded; // Every push and pop also passes the shared accessor count that guards segment reclamation
+		double unboundedTime = RunQueue(unbounded, [](ConcurrentQueue<int32_t>& q, int32_t v) { q.push(v); }, threads, valid);
+		XCHECK(valid);
+
+		BoundedConcurrentQueue<int32_t> bounded(4096);
+		double boundedTime = RunQueue(bounded, [](BoundedConcurrentQueue<int32_t>& q, int32_t v)
+			{
+				while (!q.try_push(v))
+					std::this_thread::yield();
+			}, threads, valid);
+		XCHECK(valid);
+
+		double items = static_cast<double>(threads) * QueueItemsPerProducer * 1e-6;
+		printf("  %9d %8.2f %11.2f %9.2f\n", threads, items / mutexTime, items / unboundedTime, items / boundedTime);
+	}
+	return true;
+}
+
+template<class Map, class Find, class Insert>
+static double RunMap(Map& map, Find find, Insert insert, int32_t threads) // One insert per eight lookups, keys spread over MapKeyRange
+{
+	std::atomic_bool start = false;
+	std::vector<std::thread> pool;
+	for (int32_t t = 0; t < threads; ++t)
+	{
+		pool.emplace_back([&, t]()
+			{
+				uint32_t state = 2463534242u + t; // xorshift, so every thread walks its own key sequence
+				while (!start.load(std::memory_order_acquire));
+				for (int32_t i = 0; i < MapOpsPerThread; ++i)
+				{
+					state ^= state << 13;
+					state ^= state >> 17;
+					state ^= state << 5;
+					uint64_t key = state % MapKeyRange;
+					if ((i & 7) == 0)
+						insert(map, key);
+					else
+						find(map, key);
+				}
+			});
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	start.store(true, std::memory_order_release);
+	for (std::thread& thread : pool)
+		thread.join();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+XBENCHMARK(ConcurrentHashMapVersusMutex)
+{
+	printf("%d operations per thread, one insert per eight lookups, million operations per second\n", MapOpsPerThread);
+	printf("  threads    mutex   sharded\n");
+	for (int32_t threads : ThreadCounts)
+	{
+		std::mutex mutex;
+		std::unordered_map<uint64_t, uint64_t> locked;
+		double mutexTime = RunMap(locked,
+			[&mutex](std::unordered_map<uint64_t, uint64_t>& m, uint64_t key) { std::lock_guard lock(mutex); return m.find(key) != m.end(); },
+			[&mutex](std::unordered_map<uint64_t, uint64_t>& m, uint64_t key) { std::lock_guard lock(mutex); m[key] = key; }, threads);
+
+		ConcurrentHashMap<uint64_t, uint64_t> sharded;
+		double shardedTime = RunMap(sharded,
+			[](ConcurrentHashMap<uint64_t, uint64_t>& m, uint64_t key) { uint64_t value; return m.try_get(key, value); },
+			[](ConcurrentHashMap<uint64_t, uint64_t>& m, uint64_t key) { m[key] = key; }, threads);
+
+		XCHECK(locked.size() == sharded.size()); // Both saw the same keys
+		for (auto& pair : locked)
+		{
+			uint64_t value;
+			XCHECK(sharded.try_get(pair.first, value) && value == pair.first);
+		}
+
+		double ops = static_cast<double>(threads) * MapOpsPerThread * 1e-6;
+		printf("  %7d %8.2f %9.2f\n", threads, ops / mutexTime, ops / shardedTime);
+	}
+	return true;
+}
@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <GPUMemoryAllocator.h>
+#include <cstring>
+#include <random>
+
+constexpr uint64_t DefragTestPageSize = 16ull << 20;
+constexpr uint64_t DefragTestArenaSize = 4ull << 20; // Smaller for the allocator-driven case, every pass copies the whole page twice
+
+static bool ApplyCopies(std::vector<GPUBufferCopy>& copies, std::vector<uint8_t>& page, std::vector<uint8_t>& staging) // In submission order, as the transfer queue runs them
+{
+	for (GPUBufferCopy& copy : copies)
+	{
+		std::vector<uint8_t>& source = copy.Source == GPUCopyBuffer::Staging ? staging : page;
+		std::vector<uint8_t>& dest = copy.Dest == GPUCopyBuffer::Staging ? staging : page;
+		if (copy.Size <= 0 || copy.SourceOffset + copy.Size > source.size() || copy.DestOffset + copy.Size > dest.size())
+			return false;
+		if (&source == &dest && copy.SourceOffset < copy.DestOffset + copy.Size && copy.DestOffset < copy.SourceOffset + copy.Size) // Buffer copies must not overlap themselves
+			return false;
+		std::memcpy(dest.data() + copy.DestOffset, source.data() + copy.SourceOffset, copy.Size);
+	}
+	return true;
+}
+
+static bool CheckPlan(std::vector<MoveData> moves, std::vector<uint8_t>& page) // Planned copies leave the page as the moves made one after another would
+{
+	std::vector<uint8_t> expected = page;
+	for (MoveData& move : moves)
+		std::memmove(expected.data() + move.DestIndex, expected.data() + move.SrcIndex, move.Size);
+
+	std::vector<uint8_t> staging(GPUDefragStagingSize);
+	std::vector<GPUBufferCopy> copies = GPUMemoryAllocator::PlanMoves(moves);
+	if (!ApplyCopies(copies, page, staging))
+		return false;
+	return page == expected;
+}
+
+static void FillRandom(std::vector<uint8_t>& bytes, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	for (uint8_t& byte : bytes)
+		byte = rng();
+}
+
+XTEST(PlanMovesOverlappingRuns)
+{
+	std::vector<uint8_t> page(DefragTestPageSize);
+	FillRandom(page, 1);
+
+	XCHECK(CheckPlan({ { 3000, 1000, 5000 } }, page)); // Shift shorter than the run, copied in shift-sized pieces
+	XCHECK(CheckPlan({ { 1000, 3000, 5000 } }, page)); // Same upwards, pieces go from the end
+	XCHECK(CheckPlan({ { 4096, 0, 4096 } }, page)); // Shift equal to the run
+	XCHECK(CheckPlan({ { 100, 100, 4096 } }, page)); // Not moving at all
+	XCHECK(CheckPlan({ { 1000, 900, 100 }, { 1100, 1000, 200 }, { 1300, 1200, 50 } }, page)); // Neighbours moving by the same amount, one run
+	XCHECK(CheckPlan({ { 2000, 1000, 1000 }, { 3000, 2000, 1000 }, { 5000, 3000, 500 } }, page)); // The last one moves by more, two runs
+	return true;
+}
+
+XTEST(PlanMovesStagedRuns)
+{
+	std::vector<uint8_t> page(DefragTestPageSize);
+	FillRandom(page, 2);
+
+	XCHECK(CheckPlan({ { 64, 0, 4 << 20 } }, page)); // Tiny shift of a large run, goes through both staging halves
+	XCHECK(CheckPlan({ { 0, 48, 4 << 20 } }, page));
+	XCHECK(CheckPlan({ { (1 << 20) + 16, 1 << 20, (3 << 20) + 12345 } }, page)); // Last chunk shorter than a half
+	XCHECK(CheckPlan({ { 4096, 4000, 2 << 20 }, { (6 << 20) + 32, 6 << 20, 3 << 20 } }, page)); // Staging halves keep alternating across runs
+	return true;
+}
+
+XTEST(PlanMovesAllocatorDefragments)
+{
+	std::vector<uint8_t> page(DefragTestArenaSize);
+	FillRandom(page, 3);
+
+	std::vector<MoveData> moves;
+	int32_t passes = 0;
+	bool matched = true;
+	ListAllocator allocator(DefragTestArenaSize, 4096);
+	allocator.SetMoveCallback([&moves](MoveData& move) { moves.push_back(move); });
+	allocator.SetDefragBeginCallback([&moves]() { moves.clear(); });
+	allocator.SetDefragEndCallback([&]()
+		{
+			matched = CheckPlan(moves, page) && matched;
+			++passes;
+		});
+
+	std::mt19937 rng(4);
+	std::vector<ListMemoryPointer *> live;
+	for (int32_t i = 0; i < 10000; ++i)
+	{
+		if (live.empty() || rng() % 5 < 3)
+		{
+			int32_t size = rng() % 8 == 0 ? 1 + rng() % (256 << 10) : 1 + rng() % 4096; // Some runs large enough to be staged
+			if (ListMemoryPointer *ptr = allocator.TryAllocateMemory(size, 1 << (rng() % 8)))
+				live.push_back(ptr);
+			else
+				allocator.DefragmentStep(DefragTestArenaSize, 64);
+		}
+		else
+		{
+			int32_t index = rng() % live.size();
+			allocator.DeallocateMemory(live[index]);
+			live[index] = live.back();
+			live.pop_back();
+		}
+		if (i % 64 == 0)
+			allocator.DefragmentStep(1 << 16, 16);
+	}
+
+	XCHECK(passes > 0);
+	XCHECK(matched);
+	return true;
+}
+
+XTEST(ListFreeListReusesHoles)
+{
+	ListAllocator allocator(1 << 20, 64);
+	std::vector<ListMemoryPointer *> blocks;
+	for (int32_t i = 0; i < 6; ++i) // Large and small blocks taking turns, the rest of the arena stays one free block
+		blocks.push_back(allocator.AllocateMemory(i % 2 == 0 ? 64 << 10 : 4 << 10, 16));
+	ListPointer smallAt = blocks[1]->Pointer;
+	ListPointer holeAt = blocks[2]->Pointer;
+
+	allocator.DeallocateMemory(blocks[2]);
+	ListMemoryPointer *inHole = allocator.AllocateMemory(16 << 10, 16);
+	XCHECK(inHole && inHole->Pointer == holeAt); // The hole is in a smaller class than the rest of the arena
+
+	allocator.DeallocateMemory(blocks[1]);
+	allocator.DeallocateMemory(blocks[3]);
+	allocator.DeallocateMemory(inHole);
+	ListMemoryPointer *merged = allocator.AllocateMemory(60 << 10, 16); // Only fits where the freed neighbours joined up
+	XCHECK(merged && merged->Pointer == smallAt);
+
+	ListAllocatorStats stats = allocator.GetStats();
+	XCHECK(stats.Defragments == 0 && stats.DefragmentSteps == 0);
+	XCHECK(stats.Allocations == 4);
+	XCHECK(stats.FreeBytes == (1 << 20) - (2 * (64 << 10) + (4 << 10) + (60 << 10))); // Every split and merge kept the count exact
+	return true;
+}
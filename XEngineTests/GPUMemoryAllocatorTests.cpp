@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include "NullGraphicsContext.h"
+#include <GPUMemoryAllocator.h>
+
+constexpr uint64_t PagingTestPageSize = 64 << 10;
+constexpr int32_t PagingTestMaxAllocs = 256;
+
+static uint8_t *GetPageBytes(GPUMemoryAllocator& allocator, ListMemoryPointer *ptr)
+{
+	return static_cast<NullGraphicsBuffer *>(allocator.GetPageBuffer(ptr->Page))->Bytes.data() + ptr->Pointer;
+}
+
+static void Fill(GPUMemoryAllocator& allocator, ListMemoryPointer *ptr, int32_t size, uint8_t seed)
+{
+	uint8_t *bytes = GetPageBytes(allocator, ptr);
+	for (int32_t i = 0; i < size; ++i)
+		bytes[i] = seed + i * 7;
+}
+
+static bool Matches(GPUMemoryAllocator& allocator, ListMemoryPointer *ptr, int32_t size, uint8_t seed)
+{
+	uint8_t *bytes = GetPageBytes(allocator, ptr);
+	for (int32_t i = 0; i < size; ++i)
+	{
+		if (bytes[i] != static_cast<uint8_t>(seed + i * 7))
+			return false;
+	}
+	return true;
+}
+
+XTEST(GPUAllocatorGrowsByAPage)
+{
+	NullGraphicsContext context;
+	GPUMemoryAllocator allocator(&context, PagingTestPageSize, PagingTestMaxAllocs, true);
+	XCHECK(allocator.GetPageCount() == 1);
+
+	std::vector<ListMemoryPointer *> first;
+	for (int32_t i = 0; i < 4; ++i)
+		first.push_back(allocator.RequestSpace(PagingTestPageSize / 4));
+	for (ListMemoryPointer *ptr : first)
+		XCHECK(ptr && ptr->Page == 0);
+	XCHECK(allocator.GetPageCount() == 1);
+
+	ListMemoryPointer *next = allocator.RequestSpace(PagingTestPageSize - 1024); // The first page is full
+	XCHECK(next && next->Page == 1);
+	XCHECK(allocator.GetPageCount() == 2 && context.BuffersCreated == 2);
+	XCHECK(static_cast<NullGraphicsBuffer *>(allocator.GetPageBuffer(1))->Bytes.size() == PagingTestPageSize);
+
+	allocator.FreeSpace(first[2]);
+	XCHECK(allocator.RequestSpace(PagingTestPageSize / 4)->Page == 0); // Only fits where the first page freed up, no third page
+	XCHECK(allocator.GetPageCount() == 2);
+	XCHECK(context.Submissions == 0); // Growing never moves what is already placed
+	return true;
+}
+
+XTEST(GPUAllocatorOversizedPage)
+{
+	NullGraphicsContext context;
+	GPUMemoryAllocator allocator(&context, PagingTestPageSize, PagingTestMaxAllocs, true);
+	ListMemoryPointer *small = allocator.RequestSpace(1024);
+
+	int32_t size = PagingTestPageSize * 2 + 100;
+	ListMemoryPointer *big = allocator.RequestSpace(size, 256);
+	XCHECK(big && big->Page == 1);
+	XCHECK(static_cast<NullGraphicsBuffer *>(allocator.GetPageBuffer(1))->Bytes.size() == PagingTestPageSize * 3); // Rounded up to whole pages
+	XCHECK(big->Pointer % 256 == 0 && big->Pointer + size <= PagingTestPageSize * 3);
+
+	XCHECK(allocator.RequestSpace(1024) && small->Page == 0); // Regular requests fit in what the pages have left
+	XCHECK(allocator.GetPageCount() == 2);
+
+	std::vector<ListAllocatorStats> stats = allocator.GetStats();
+	XCHECK(stats.size() == 2 && stats[0].Size == PagingTestPageSize && stats[1].Size == PagingTestPageSize * 3);
+	return true;
+}
+
+XTEST(GPUAllocatorPageStampedFreesAndPins)
+{
+	NullGraphicsContext context;
+	GPUMemoryAllocator allocator(&context, PagingTestPageSize, PagingTestMaxAllocs, true);
+	ListMemoryPointer *first = allocator.RequestSpace(PagingTestPageSize / 2);
+	ListMemoryPointer *second = allocator.RequestSpace(PagingTestPageSize / 2 + 1); // Goes to a page of its own
+	XCHECK(first->Page == 0 && second->Page == 1);
+
+	{
+		PinnedGPUMemory pinned = allocator.GetMemory(second);
+		XCHECK(pinned.GetPage() == 1 && pinned.GetBuffer() == allocator.GetPageBuffer(1));
+		XCHECK(pinned.GetPointer() == second && pinned.GetSize() == PagingTestPageSize / 2 + 1);
+
+		PinnedGPUMemory other = allocator.GetMemory(first);
+		XCHECK(other.GetPage() == 0 && other.GetBuffer() == allocator.GetPageBuffer(0));
+	}
+
+	allocator.FreeSpace(second); // Back to the page it came from, the other one is untouched
+	std::vector<ListAllocatorStats> stats = allocator.GetStats();
+	XCHECK(stats[0].Allocations == 1 && stats[1].Allocations == 0);
+	XCHECK(stats[1].FreeBytes == PagingTestPageSize);
+
+	allocator.FreeSpace(first);
+	stats = allocator.GetStats();
+	XCHECK(stats[0].Allocations == 0 && stats[0].FreeBytes == PagingTestPageSize);
+	return true;
+}
+
+XTEST(GPUAllocatorDefragmentsPerPage)
+{
+	NullGraphicsContext context;
+	GPUMemoryAllocator allocator(&context, PagingTestPageSize, PagingTestMaxAllocs, true);
+
+	std::vector<ListMemoryPointer *> live;
+	std::vector<int32_t> sizes;
+	for (int32_t i = 0; i < 48; ++i) // Spread over three pages
+	{
+		int32_t size = 3000 + i * 37;
+		ListMemoryPointer *ptr = allocator.RequestSpace(size, 16);
+		XCHECK(ptr);
+		Fill(allocator, ptr, size, i);
+		live.push_back(ptr);
+		sizes.push_back(size);
+	}
+	XCHECK(allocator.GetPageCount() > 1);
+
+	for (int32_t i = 0; i < live.size(); i += 2) // Holes all over every page
+	{
+		allocator.FreeSpace(live[i]);
+		live[i] = nullptr;
+	}
+
+	PinnedGPUMemory pinned = allocator.GetMemory(live[5]); // Stays where it is, the rest of its page moves around it
+	ListPointer pinnedAt = live[5]->Pointer;
+
+	allocator.SetDefragBudget(8 << 10, 4); // Small steps, each page runs its own passes
+	for (int32_t pass = 0; pass < 256; ++pass)
+		ListAllocator::RunDefragBudgets();
+	allocator.SetDefragBudget(0, 0);
+
+	XCHECK(context.Submissions > 0);
+	XCHECK(live[5]->Pointer == pinnedAt);
+	for (int32_t i = 1; i < live.size(); i += 2) // Every copy went to the buffer of the page the allocation is on
+		XCHECK(Matches(allocator, live[i], sizes[i], i));
+
+	for (ListAllocatorStats& stats : allocator.GetStats())
+		XCHECK(stats.DefragmentSteps > 0);
+	return true;
+}
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <ListAllocator.h>
+
+constexpr int32_t PinTestBlockSize = 8 << 10;
+constexpr int32_t PinTestBlocks = 8;
+constexpr uint64_t PinTestArenaSize = PinTestBlockSize * (PinTestBlocks + 1); // Room past the blocks, a free block only takes requests a size class below its own
+
+static int32_t GetPinCount(ListMemoryPointer *ptr)
+{
+	return static_cast<ListEntryHeader *>(ptr)->PinCount.load();
+}
+
+static std::vector<ListMemoryPointer *> FillWithHoles(ListAllocator& allocator) // Every even block freed, so no free block is bigger than one block
+{
+	std::vector<ListMemoryPointer *> blocks;
+	for (int32_t i = 0; i < PinTestBlocks; ++i)
+		blocks.push_back(allocator.AllocateMemory(PinTestBlockSize, 16));
+	for (int32_t i = 0; i < PinTestBlocks; i += 2)
+	{
+		allocator.DeallocateMemory(blocks[i]);
+		blocks[i] = nullptr;
+	}
+	return blocks;
+}
+
+XTEST(ListPinsNest)
+{
+	ListAllocator allocator(PinTestArenaSize, 64);
+	ListMemoryPointer *ptr = allocator.AllocateMemory(PinTestBlockSize, 16);
+	XCHECK(GetPinCount(ptr) == 0);
+
+	allocator.PinMemoryUnmanaged(ptr);
+	allocator.PinMemoryUnmanaged(ptr);
+	XCHECK(GetPinCount(ptr) == 2);
+	{
+		PinnedListMemory pinned = allocator.PinMemory(ptr);
+		XCHECK(GetPinCount(ptr) == 3 && pinned.GetPointer() == ptr);
+		allocator.UnpinMemoryUnmanaged(ptr);
+		XCHECK(GetPinCount(ptr) == 2);
+	}
+	XCHECK(GetPinCount(ptr) == 1);
+	allocator.UnpinMemoryUnmanaged(ptr);
+	XCHECK(GetPinCount(ptr) == 0);
+	return true;
+}
+
+XTEST(ListDefragmentSkipsPinned)
+{
+	ListAllocator allocator(PinTestArenaSize, 64);
+	std::vector<MoveData> moves;
+	allocator.SetMoveCallback([&moves](MoveData& move) { moves.push_back(move); });
+	std::vector<ListMemoryPointer *> blocks = FillWithHoles(allocator);
+
+	PinnedListMemory pinned = allocator.PinMemory(blocks[3]);
+	ListPointer pinnedAt = blocks[3]->Pointer;
+
+	ListMemoryPointer *big = allocator.AllocateMemory(PinTestBlockSize * 2, 16); // Fits nowhere until a full defragment closes the holes
+	XCHECK(big);
+	XCHECK(allocator.GetStats().Defragments == 1);
+	XCHECK(!moves.empty());
+	for (MoveData& move : moves)
+		XCHECK(move.SrcIndex != pinnedAt);
+	XCHECK(blocks[3]->Pointer == pinnedAt && GetPinCount(blocks[3]) == 1);
+	XCHECK(blocks[1]->Pointer == 0); // The block before it still moved down
+	for (int32_t i : { 1, 5, 7 })
+		XCHECK(GetPinCount(blocks[i]) == 0);
+	return true;
+}
+
+XTEST(ListDefragmentStepSkipsPinned)
+{
+	ListAllocator allocator(PinTestArenaSize, 64);
+	std::vector<MoveData> moves;
+	allocator.SetMoveCallback([&moves](MoveData& move) { moves.push_back(move); });
+	std::vector<ListMemoryPointer *> blocks = FillWithHoles(allocator);
+
+	PinnedListMemory pinned = allocator.PinMemory(blocks[1]); // Right behind the first hole
+	ListPointer pinnedAt = blocks[1]->Pointer;
+
+	while (allocator.DefragmentStep(PinTestArenaSize, PinTestBlocks));
+	XCHECK(!moves.empty());
+	for (MoveData& move : moves)
+		XCHECK(move.SrcIndex != pinnedAt);
+	XCHECK(blocks[1]->Pointer == pinnedAt && GetPinCount(blocks[1]) == 1);
+	XCHECK(blocks[3]->Pointer == PinTestBlockSize * 2); // Later blocks slid into the holes behind the pinned one
+	for (int32_t i : { 3, 5, 7 })
+		XCHECK(GetPinCount(blocks[i]) == 0);
+
+	pinned.Unpin();
+	allocator.DefragmentStep(PinTestArenaSize, PinTestBlocks);
+	XCHECK(blocks[1]->Pointer == 0); // Free to move once unpinned
+	return true;
+}
+
+XTEST(ListPinMoveAssignReleasesOnce)
+{
+	ListAllocator allocator(PinTestArenaSize, 64);
+	ListMemoryPointer *first = allocator.AllocateMemory(PinTestBlockSize, 16);
+	ListMemoryPointer *second = allocator.AllocateMemory(PinTestBlockSize, 16);
+
+	allocator.PinMemoryUnmanaged(first);
+	PinnedListMemory pinned = allocator.PinMemory(first);
+	PinnedListMemory other = allocator.PinMemory(second);
+	XCHECK(GetPinCount(first) == 2 && GetPinCount(second) == 1);
+
+	pinned = std::move(other); // Drops the pin it held, takes over the other one
+	XCHECK(GetPinCount(first) == 1 && GetPinCount(second) == 1);
+	XCHECK(pinned.GetPointer() == second);
+
+	other.Unpin(); // Moved from, holds nothing
+	XCHECK(GetPinCount(second) == 1);
+
+	PinnedListMemory moved(std::move(pinned));
+	XCHECK(GetPinCount(second) == 1);
+	moved.Unpin();
+	XCHECK(GetPinCount(second) == 0);
+	moved.Unpin();
+	pinned.Unpin();
+	XCHECK(GetPinCount(second) == 0);
+
+	allocator.UnpinMemoryUnmanaged(first);
+	XCHECK(GetPinCount(first) == 0);
+	return true;
+}
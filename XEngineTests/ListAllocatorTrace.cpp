@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <ListAllocator.h>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+
+constexpr int32_t ChurnTraceEvents = 1000000;
+constexpr uint64_t ChurnArenaSize = 256ull << 20;
+constexpr int32_t ChurnMaxAllocations = 65536;
+constexpr double ChurnMinOccupancy = 0.25; // Live bytes swing between these fractions of the arena
+constexpr double ChurnMaxOccupancy = 0.7;
+constexpr int32_t TraceStatsInterval = 4096; // Events between fragmentation samples
+
+class TraceEvent
+{
+public:
+	bool Free;
+	int32_t Id; // Header index when recorded, reused only after the allocation it named was freed
+	int32_t Size;
+	int32_t Alignment;
+};
+
+class AllocationTrace
+{
+public:
+	uint64_t ArenaSize = 0;
+	int32_t MaxAllocations = 0;
+	std::vector<TraceEvent> Events;
+};
+
+static bool LoadTrace(const std::string& path, AllocationTrace& trace) // Read a file written by ListAllocator::RecordTrace
+{
+	std::ifstream stream(path);
+	if (!stream)
+		return false;
+
+	char kind;
+	while (stream >> kind)
+	{
+		TraceEvent event = { kind == 'f', 0, 0, 1 };
+		if (kind == 's')
+			stream >> trace.ArenaSize >> trace.MaxAllocations;
+		else if (kind == 'a')
+		{
+			stream >> event.Id >> event.Size >> event.Alignment;
+			trace.Events.push_back(event);
+		}
+		else if (kind == 'f')
+		{
+			stream >> event.Id;
+			trace.Events.push_back(event);
+		}
+	}
+	return trace.ArenaSize > 0;
+}
+
+static AllocationTrace GenerateChurnTrace() // Used when no recorded trace is given: asset-like sizes streamed in and out in waves
+{
+	AllocationTrace trace;
+	trace.ArenaSize = ChurnArenaSize;
+	trace.MaxAllocations = ChurnMaxAllocations;
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<double> sizeExponent(6.0, 22.0); // 64 bytes to 4MB, uniform in log space like a mix of headers, meshes and textures
+	const int32_t alignments[] = { 1, 4, 16, 256 };
+	std::vector<int32_t> live;
+	std::vector<int32_t> freeIds;
+	std::unordered_map<int32_t, int32_t> sizes;
+	int32_t nextId = 0;
+	uint64_t liveBytes = 0;
+	for (int32_t step = 0; step < ChurnTraceEvents; ++step)
+	{
+		double wave = std::sin(step * 6.283185307 / 200000) * 0.5 + 0.5;
+		uint64_t target = static_cast<uint64_t>(trace.ArenaSize * (ChurnMinOccupancy + (ChurnMaxOccupancy - ChurnMinOccupancy) * wave));
+		bool allocate = liveBytes < target ? random() % 4 != 0 : random() % 4 == 0;
+		if (allocate && live.size() < trace.MaxAllocations / 2)
+		{
+			TraceEvent event = { false, 0, static_cast<int32_t>(std::exp2(sizeExponent(random))), alignments[random() % 4] };
+			if (freeIds.empty())
+				event.Id = nextId++;
+			else
+			{
+				event.Id = freeIds.back();
+				freeIds.pop_back();
+			}
+			trace.Events.push_back(event);
+			live.push_back(event.Id);
+			sizes[event.Id] = event.Size;
+			liveBytes += event.Size;
+		}
+		else if (!live.empty())
+		{
+			int32_t index = random() % live.size();
+			TraceEvent event = { true, live[index], 0, 1 };
+			std::swap(live[index], live.back());
+			live.pop_back();
+			trace.Events.push_back(event);
+			freeIds.push_back(event.Id);
+			liveBytes -= sizes[event.Id];
+		}
+	}
+	return trace;
+}
+
+XBENCHMARK(ListAllocatorTraceReplay) // --trace=<file> replays a recorded trace, otherwise a generated asset churn trace
+{
+	AllocationTrace trace;
+	auto option = GetTestOptions().find("trace");
+	if (option != GetTestOptions().end())
+	{
+		XCHECK(LoadTrace(option->second, trace));
+		printf("Replaying %s: %zu events, %llu byte arena\n", option->second.c_str(), trace.Events.size(), trace.ArenaSize);
+	}
+	else
+	{
+		trace = GenerateChurnTrace();
+		printf("Replaying a generated churn trace: %zu events, %llu byte arena\n", trace.Events.size(), trace.ArenaSize);
+	}
+
+	std::vector<char> memory(trace.ArenaSize);
+	std::unordered_map<int32_t, ListMemoryPointer *> live;
+	std::unordered_map<int32_t, void *> heapLive;
+	live.reserve(trace.MaxAllocations);
+	heapLive.reserve(trace.MaxAllocations);
+
+	double fragmentationSum = 0.0;
+	float fragmentationMax = 0.f;
+	int32_t samples = 0;
+	int32_t failed = 0;
+	int32_t corrupted = 0; // Allocations whose stamp did not survive the moves
+	ListAllocatorStats stats;
+	double listTime = MeasureSeconds([&]()
+		{
+			ListAllocator allocator(trace.ArenaSize, trace.MaxAllocations);
+			allocator.SetMoveCallback([&memory](MoveData& move) { std::memmove(memory.data() + move.DestIndex, memory.data() + move.SrcIndex, move.Size); });
+			for (int32_t i = 0; i < trace.Events.size(); ++i)
+			{
+				TraceEvent& event = trace.Events[i];
+				if (!event.Free)
+				{
+					if (ListMemoryPointer *ptr = allocator.AllocateMemory(event.Size, event.Alignment))
+					{
+						live[event.Id] = ptr;
+						std::memcpy(memory.data() + ptr->Pointer, &event.Id, std::min<int32_t>(event.Size, sizeof(event.Id))); // Has to move with the allocation
+					}
+					else
+						++failed;
+				}
+				else
+				{
+					auto iter = live.find(event.Id);
+					if (iter == live.end()) // Its allocation failed
+						continue;
+					if (allocator.GetAllocationSize(iter->second) >= sizeof(int32_t))
+					{
+						int32_t stamp;
+						std::memcpy(&stamp, memory.data() + iter->second->Pointer, sizeof(stamp));
+						if (stamp != event.Id)
+							++corrupted;
+					}
+					allocator.DeallocateMemory(iter->second);
+					live.erase(iter);
+				}
+
+				if (i % TraceStatsInterval == 0)
+				{
+					float fragmentation = allocator.GetStats().Fragmentation;
+					fragmentationSum += fragmentation;
+					fragmentationMax = std::max(fragmentationMax, fragmentation);
+					++samples;
+				}
+			}
+			stats = allocator.GetStats();
+		});
+
+	double heapTime = MeasureSeconds([&]()
+		{
+			for (TraceEvent& event : trace.Events)
+			{
+				if (!event.Free)
+					heapLive[event.Id] = std::malloc(event.Size);
+				else
+				{
+					std::free(heapLive[event.Id]);
+					heapLive.erase(event.Id);
+				}
+			}
+			for (auto& pair : heapLive)
+				std::free(pair.second);
+		});
+
+	double events = trace.Events.size() * 1e-6;
+	printf("  ListAllocator     %8.2f million events per second\n", events / listTime);
+	printf("  malloc and free   %8.2f million events per second\n", events / heapTime);
+	printf("  fragmentation     %.3f on average, %.3f at worst\n", samples ? fragmentationSum / samples : 0.0, fragmentationMax);
+	printf("  failed allocations %d, corrupted %d, full defragments %d, bytes moved %llu, high water %llu bytes\n",
+		failed, corrupted, stats.Defragments, stats.BytesMoved, stats.HighWaterBytes);
+	return failed == 0 && corrupted == 0;
+}
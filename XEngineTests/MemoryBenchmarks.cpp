@@ -0,0 +1,113 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <ChunkAllocator.h>
+#include <VirtualMemory.h>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+constexpr uint64_t TLBBenchmarkBytes = 512ull << 20; // Far past what the TLB covers with 4 KB pages, within it with 2 MB ones
+constexpr uint64_t TLBBenchmarkStride = 256; // One chased slot per this many bytes
+constexpr int32_t TLBBenchmarkReads = 1 << 23;
+constexpr int32_t ChunkBenchmarkChunks = 65536;
+constexpr int32_t ChunkBenchmarkBytes = 33 * 64; // 32 rows of 64 bytes and the spare one MemoryChunkAllocator asks for
+
+XBENCHMARK(HugePageRandomReads) // Dependent reads over a large range, each one a likely TLB miss without huge pages
+{
+	printf("  transparent huge pages %s\n", VirtualMemoryRange::HugePagesAvailable() ? "available" : "not available");
+
+	uint64_t slots = TLBBenchmarkBytes / TLBBenchmarkStride;
+	std::vector<uint32_t> order(slots);
+	std::iota(order.begin(), order.end(), 0);
+	std::mt19937 rng(1);
+	for (uint64_t i = slots - 1; i > 0; --i) // Sattolo's shuffle, one cycle through every slot
+		std::swap(order[i], order[rng() % i]);
+
+	uint64_t reference = 0;
+	for (bool hugePages : { false, true })
+	{
+		VirtualMemoryRange range(TLBBenchmarkBytes, hugePages);
+		XCHECK(range.GetBase() && range.Commit(0, TLBBenchmarkBytes));
+		char *base = reinterpret_cast<char *>(range.GetBase());
+		for (uint64_t i = 0; i < slots; ++i)
+			*reinterpret_cast<uint64_t *>(base + order[i] * TLBBenchmarkStride) = order[(i + 1) % slots] * TLBBenchmarkStride;
+
+		uint64_t offset = 0;
+		uint64_t sum = 0;
+		double seconds = MeasureSeconds([&]()
+			{
+				offset = 0;
+				sum = 0;
+				for (int32_t i = 0; i < TLBBenchmarkReads; ++i)
+				{
+					offset = *reinterpret_cast<uint64_t *>(base + offset);
+					sum += offset;
+				}
+			}, 3);
+		printf("  %s pages%s: %.1f ns per read\n", hugePages ? "huge" : "normal", hugePages && !range.HasHugePages() ? " (refused, normal)" : "",
+			seconds * 1e9 / TLBBenchmarkReads);
+
+		if (!hugePages)
+			reference = sum;
+		else
+			XCHECK(sum == reference);
+	}
+	return true;
+}
+
+XBENCHMARK(HugePageChunkPool) // Chunks carved from a huge page slab against separate heap allocations, as archetypes acquire, walk and churn them
+{
+	for (bool slabs : { false, true })
+	{
+		MemoryChunkPool pool;
+		pool.SetHugePageSlabs(slabs);
+		std::vector<void *> chunks(ChunkBenchmarkChunks);
+		std::vector<int32_t> walkOrder(ChunkBenchmarkChunks); // Systems visit the chunks of many archetypes, which are acquired interleaved
+		std::iota(walkOrder.begin(), walkOrder.end(), 0);
+		std::shuffle(walkOrder.begin(), walkOrder.end(), std::mt19937(2));
+
+		double acquire = MeasureSeconds([&]()
+			{
+				for (void *& chunk : chunks)
+					chunk = pool.AcquireChunk(ChunkBenchmarkBytes);
+			});
+
+		uint64_t sum = 0;
+		for (int32_t i = 0; i < ChunkBenchmarkChunks; ++i)
+			std::memset(chunks[i], i & 0xff, ChunkBenchmarkBytes);
+		double walk = MeasureSeconds([&]()
+			{
+				sum = 0;
+				for (int32_t index : walkOrder)
+				{
+					uint8_t *bytes = reinterpret_cast<uint8_t *>(chunks[index]);
+					for (int32_t offset = 0; offset < ChunkBenchmarkBytes; offset += 64)
+						sum += bytes[offset];
+				}
+			}, 3);
+
+		std::mt19937 rng(3);
+		double churn = MeasureSeconds([&]()
+			{
+				for (int32_t i = 0; i < ChunkBenchmarkChunks; ++i) // Release and reacquire, slab chunks stay pooled while heap ones past the pooling limit go back to the heap
+				{
+					int32_t index = rng() % ChunkBenchmarkChunks;
+					pool.ReleaseChunk(chunks[index], ChunkBenchmarkBytes);
+					chunks[index] = pool.AcquireChunk(ChunkBenchmarkBytes);
+				}
+			});
+
+		for (void *chunk : chunks)
+			pool.ReleaseChunk(chunk, ChunkBenchmarkBytes);
+		pool.Trim();
+
+		uint64_t expected = 0;
+		for (int32_t i = 0; i < ChunkBenchmarkChunks; ++i)
+			expected += static_cast<uint64_t>(i & 0xff) * (ChunkBenchmarkBytes / 64);
+		XCHECK(sum == expected);
+
+		printf("  %s: acquire %.1f ns, walk %.1f ns, release and reacquire %.1f ns per chunk\n", slabs ? "huge page slab" : "heap",
+			acquire * 1e9 / ChunkBenchmarkChunks, walk * 1e9 / ChunkBenchmarkChunks, churn * 1e9 / ChunkBenchmarkChunks);
+	}
+	return true;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <GraphicsDefs.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+class NullGraphicsBuffer : public GraphicsMemoryBuffer // Plain CPU memory, always mapped
+{
+public:
+	NullGraphicsBuffer(uint64_t size) : Bytes(size) {}
+	void MapBuffer(uint64_t offset, int32_t length, bool coherent, bool writeOnly) override {}
+	void UnmapBuffer() override {}
+	void *GetMappedPointer() override { return Bytes.data(); }
+	void FlushMapped(uint64_t offset, int32_t size) override {}
+	void InvalidateMapped(uint64_t offset, int32_t size) override {}
+
+	std::vector<uint8_t> Bytes;
+};
+
+class NullGraphicsSync : public GraphicsSyncObject // Work is done by the time it is submitted, so every fence is signaled
+{
+public:
+	bool Wait(uint64_t nanoSecTimeout) override { return true; }
+	void Reset() override {}
+	bool GetCurrentStatus() override { return true; }
+	void AddSignalCallback(std::function<void()> callback) override { callback(); }
+};
+
+class NullBufferCopy
+{
+public:
+	NullGraphicsBuffer *Source;
+	NullGraphicsBuffer *Dest;
+	uint64_t SourceOffset;
+	uint64_t DestOffset;
+	int32_t Size;
+};
+
+class NullGraphicsCommandBuffer : public GraphicsCommandBuffer // Records buffer copies and runs them in order on submission, everything else is ignored
+{
+public:
+	void BindRenderPipeline(GraphicsRenderPipeline *pipeline) override {}
+	void BindComputePipeline(GraphicsComputePipeline *pipeline) override {}
+	void BindRenderPass(GraphicsRenderTarget *target, GraphicsRenderPass *renderPass, std::vector<glm::vec4>&& attachmentClearValues, char stencil) override {}
+	void NextSubpass() override {}
+	void EndRenderPass() override {}
+	void BeginQuery(GraphicsQuery *query) override {}
+	void EndQuery(GraphicsQuery *query) override {}
+	void ResetQuery(GraphicsQuery *query) override {}
+	void WriteTimestamp(GraphicsQuery *query) override {}
+	void WriteQueryToBuffer(GraphicsQuery *query, int32_t bufferOffset) override {}
+	void BindVertexBuffers(int32_t firstBinding, std::vector<GraphicsMemoryBuffer *> buffers, std::vector<int32_t> offsets) override {}
+	void BindIndexBuffer(GraphicsMemoryBuffer *buffer, bool dataType16bit) override {}
+	void PushShaderConstants(GraphicsShaderDataSet *set, int32_t constantIndex, int32_t constantOffset, int32_t constantCount, void *data) override {}
+	void BindRenderShaderResourceInstance(GraphicsShaderDataSet *set, GraphicsShaderResourceInstance *instance, int32_t viewIndex, int32_t offset) override {}
+	void BindComputeShaderResourceInstance(GraphicsShaderDataSet *set, GraphicsShaderResourceInstance *instance, int32_t viewIndex, int32_t offset) override {}
+	void DrawIndexed(int32_t vertexCount, int32_t instances, int32_t firstIndex, int32_t vertexOffset, int32_t firstInstance) override {}
+	void Draw(int32_t vertexCount, int32_t instanceCount, int32_t firstVertex, int32_t firstInstance) override {}
+	void DrawIndirect(GraphicsMemoryBuffer *buffer, int32_t offset, int32_t drawCount, int32_t stride) override {}
+	void DrawIndirectIndexed(GraphicsMemoryBuffer *buffer, int32_t offset, int32_t drawCount, int32_t stride) override {}
+	void DrawIndirectCount(GraphicsMemoryBuffer *buffer, int32_t offset, GraphicsMemoryBuffer *drawCountBuffer, int32_t drawCountBufferOffset, int32_t maxDrawCount, int32_t stride) override {}
+	void DrawIndirectIndexedCount(GraphicsMemoryBuffer *buffer, int32_t offset, GraphicsMemoryBuffer *drawCountBuffer, int32_t drawCountBufferOffset, int32_t maxDrawCount, int32_t stride) override {}
+	void DispatchCompute(int32_t x, int32_t y, int32_t z) override {}
+	void DispatchIndirect(GraphicsMemoryBuffer *buffer, int32_t offset) override {}
+	void UpdatePipelineDynamicViewport(glm::vec4 dimensions) override {}
+	void UpdatePipelineDynamicScissorBox(glm::vec4 dimensions) override {}
+	void UpdatePipelineDynamicLineWidth(float lineWidth) override {}
+	void UpdatePipelineDynamicStencilFrontFaceCompareMask(uint32_t mask) override {}
+	void UpdatePipelineDynamicStencilFrontFaceWriteMask(uint32_t mask) override {}
+	void UpdatePipelineDynamicStencilFrontFaceReference(uint32_t mask) override {}
+	void UpdatePipelineDynamicStencilBackFaceCompareMask(uint32_t mask) override {}
+	void UpdatePipelineDynamicStencilBackFaceWriteMask(uint32_t mask) override {}
+	void UpdatePipelineDynamicStencilBackFaceReference(uint32_t mask) override {}
+	void UpdatePipelineDynamicBlendConstant(glm::vec4 constants) override {}
+	void WaitOnFence(GraphicsSyncObject *sync) override {}
+	void SignalFence(GraphicsSyncObject *sync) override {}
+	void ResetFence(GraphicsSyncObject *sync) override {}
+	void SynchronizeMemory(MemoryBarrierBit from, MemoryBarrierBit to, bool byRegion) override {}
+	void ClearColor(GraphicsImageObject *image, glm::vec4 color, int32_t level, int32_t layer) override {}
+	void ClearDepthStencil(GraphicsImageObject *image, float depth, char stencil) override {}
+	void ClearAttachmentsColor(int32_t index, glm::vec4 color) override {}
+	void ClearAttachmentsDepthStencil(int32_t index, float depth, char stencil) override {}
+	void UpdateBufferData(GraphicsMemoryBuffer *buffer, int32_t offset, int32_t size, void *data) override {}
+	void CopyBufferToImageWithConversion(GraphicsMemoryBuffer *srcBuffer, VectorDataFormat srcFormat, GraphicsImageObject *destImage, std::vector<GraphicsBufferImageCopyRegion> regions) override {}
+	void CopyImageToBuffer(GraphicsImageObject *srcImage, GraphicsMemoryBuffer *destBuffer, std::vector<GraphicsBufferImageCopyRegion> regions) override {}
+	void CopyImageToImage(GraphicsImageObject *srcImage, GraphicsImageObject *destImage, glm::ivec3 srcOffset, glm::ivec3 destOffset, glm::ivec3 size,
+		int32_t srcLevel, int32_t destLevel, int32_t layers, bool color, bool depth, bool stencil) override {}
+	void CopyBufferToBuffer(GraphicsMemoryBuffer *src, GraphicsMemoryBuffer *dest, uint64_t srcOffset, uint64_t destOffset, int32_t size) override
+	{
+		Copies.push_back({ static_cast<NullGraphicsBuffer *>(src), static_cast<NullGraphicsBuffer *>(dest), srcOffset, destOffset, size });
+	}
+	void BeginRecording() override { Copies.clear(); }
+	void StopRecording() override {}
+	void ExecuteSubCommandBuffer(GraphicsCommandBuffer *commandBuffer) override {}
+
+	std::vector<NullBufferCopy> Copies;
+};
+
+class NullGraphicsContext : public GraphicsContext // Headless stand-in for allocator tests, buffers live in CPU memory and copies run on submission
+{
+public:
+	std::vector<GraphicsCommandBuffer *> CreateGraphicsCommandBuffers(int32_t count, bool graphics, bool compute, bool transfer) override
+	{
+		std::vector<GraphicsCommandBuffer *> buffers;
+		for (int32_t i = 0; i < count; ++i)
+			buffers.push_back(GetTransferBufferFromPool());
+		return buffers;
+	}
+	GraphicsCommandBuffer *GetTransferBufferFromPool() override { return m_commandBuffers.emplace_back(std::make_unique<NullGraphicsCommandBuffer>()).get(); }
+	GraphicsCommandBuffer *GetGraphicsBufferFromPool() override { return GetTransferBufferFromPool(); }
+	GraphicsCommandBuffer *GetComputeBufferFromPool() override { return GetTransferBufferFromPool(); }
+	GraphicsRenderPipeline *CreateGraphicsPipeline(GraphicsRenderPipelineState& state) override { return nullptr; }
+	GraphicsComputePipeline *CreateComputePipeline(GraphicsComputePipelineState& state) override { return nullptr; }
+	GraphicsMemoryBuffer *CreateBuffer(uint64_t byteSize, BufferUsageBit usage, GraphicsMemoryTypeBit mem) override
+	{
+		++BuffersCreated;
+		return new NullGraphicsBuffer(byteSize);
+	}
+	GraphicsImageObject *CreateImage(ImageType type, VectorDataFormat format, glm::ivec3 size, int32_t miplevels, ImageUsageBit usage) override { return nullptr; }
+	GraphicsRenderTarget *CreateRenderTarget(std::vector<GraphicsImageView *>&& attachments, GraphicsImageView *depthStencil, GraphicsRenderPass *renderPass, int32_t width, int32_t height, int32_t layers) override { return nullptr; }
+	GraphicsShaderDataSet *CreateShaderDataSet(std::vector<GraphicsShaderResourceViewData>&& resourceViews, std::vector<GraphicsShaderConstantData>&& constantData) override { return nullptr; }
+	GraphicsShaderResourceInstance *CreateShaderResourceInstance(GraphicsShaderResourceViewData& data) override { return nullptr; }
+	GraphicsSampler *CreateSampler(GraphicsSamplerState& state) override { return nullptr; }
+	GraphicsShader *CreateShader(GraphicsSpecificShaderCode *code) override { return nullptr; }
+	GraphicsRenderPass *CreateRenderPass(GraphicsRenderPassState& state) override { return nullptr; }
+	std::vector<GraphicsQuery *> CreateQueries(int32_t count, GraphicsQueryType type) override { return {}; }
+	GraphicsSyncObject *CreateSync(bool gpuQueueSync) override { return new NullGraphicsSync; }
+	GraphicsImageView *GetScreenImageView() override { return nullptr; }
+	glm::ivec2 GetScreenSize() override { return glm::ivec2(0); }
+	GraphicsSpecificStructure& GetSpecificStructure() override { return *static_cast<GraphicsSpecificStructure *>(nullptr); }
+	bool IsOpenGLTextureFlipYConvention() override { return false; }
+	bool IsOpenGLNDCConvention() override { return false; }
+	GraphicsIdentity GetIdentity() override { return GraphicsIdentity::Vulkan1_2; }
+	int32_t ConvertCubemapFaceToLayer(CubemapFace face) override { return static_cast<int32_t>(face); }
+	void UpdateShaderImageSamplerResourceInstance(GraphicsShaderResourceInstance *instance, std::vector<GraphicsImageView *>&& imageViews, std::vector<GraphicsSampler *>&& samplers) override {}
+	void UpdateShaderImageInputAttachmentInstance(GraphicsShaderResourceInstance *instance, std::vector<GraphicsImageView *>&& imageViews) override {}
+	void UpdateShaderImageLoadStoreResourceInstance(GraphicsShaderResourceInstance *instance, std::vector<GraphicsImageView *>&& imageViews) override {}
+	void UpdateShaderBufferResourceInstance(GraphicsShaderResourceInstance *instance, GraphicsMemoryBuffer *buffer, int32_t offset, int32_t range) override {}
+	void SubmitCommands(GraphicsCommandBuffer *commands, GraphicsQueueType queue) override
+	{
+		for (NullBufferCopy& copy : static_cast<NullGraphicsCommandBuffer *>(commands)->Copies) // One after another, as the transfer queue would
+			std::memcpy(copy.Dest->Bytes.data() + copy.DestOffset, copy.Source->Bytes.data() + copy.SourceOffset, copy.Size);
+		++Submissions;
+	}
+	void Present() override {}
+	void SyncWithCommandSubmissionThread() override {}
+
+	int32_t BuffersCreated = 0;
+	int32_t Submissions = 0;
+private:
+	std::vector<std::unique_ptr<NullGraphicsCommandBuffer>> m_commandBuffers; // Handed out from a pool in a real context, kept until the context goes here
+};
@@ -0,0 +1,39 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <RingAllocator.h>
+
+XTEST(RingReservesPastSkippedLapEnd) // An empty ring must take any region that fits, whatever the lap padding in front of it
+{
+	ConcurrentRingAllocator ring(100000);
+	RingReservation first = ring.Reserve(50000, 16);
+	XCHECK(first.Offset == 0);
+	ring.Release(first.End);
+
+	RingReservation second = ring.Reserve(60000, 16); // Does not fit behind the first, goes to the start of the next lap
+	XCHECK(second.Offset == 0);
+	XCHECK(second.Begin == first.End);
+	XCHECK(ring.Reserve(60000, 16).Offset < 0); // The first one is in flight, no room for another
+	ring.Release(second.End);
+
+	RingReservation third = ring.Reserve(60000, 16);
+	XCHECK(third.Offset == 0);
+	ring.Release(third.End);
+	return true;
+}
+
+XTEST(RingWaitsForInFlightRegions)
+{
+	ConcurrentRingAllocator ring(1000);
+	RingReservation first = ring.Reserve(400, 1);
+	RingReservation second = ring.Reserve(400, 1);
+	XCHECK(first.Offset == 0 && second.Offset == 400);
+	XCHECK(ring.Reserve(400, 1).Offset < 0); // Would wrap onto the first
+	ring.Release(first.End);
+
+	RingReservation third = ring.Reserve(400, 1);
+	XCHECK(third.Offset == 0);
+	XCHECK(ring.Reserve(200, 1).Offset < 0); // Right behind the third is where the second still is
+	ring.Release(second.End);
+	XCHECK(ring.Reserve(200, 1).Offset == 400);
+	return true;
+}
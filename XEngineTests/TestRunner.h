@@ -0,0 +1,55 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class TestCaseKind
+{
+	Test, Benchmark // Benchmarks take seconds each and only run when asked for
+};
+
+class TestCase
+{
+public:
+	const char *Name;
+	TestCaseKind Kind;
+	std::function<bool()> Run; // False if a check failed
+};
+
+inline std::vector<TestCase>& GetTestCases()
+{
+	static std::vector<TestCase> cases; // Filled by the registrars below before main runs
+	return cases;
+}
+
+inline std::map<std::string, std::string>& GetTestOptions()
+{
+	static std::map<std::string, std::string> options; // --name=value arguments, for cases that take input files
+	return options;
+}
+
+class TestCaseRegistrar
+{
+public:
+	TestCaseRegistrar(const char *name, TestCaseKind kind, std::function<bool()> run) { GetTestCases().push_back({ name, kind, run }); }
+};
+
+#define XTEST(name) static bool name(); static TestCaseRegistrar name##Registrar(#name, TestCaseKind::Test, name); static bool name()
+#define XBENCHMARK(name) static bool name(); static TestCaseRegistrar name##Registrar(#name, TestCaseKind::Benchmark, name); static bool name()
+#define XCHECK(condition) do { if (!(condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); return false; } } while (0)
+
+template<class F>
+double MeasureSeconds(F func, int32_t repeats = 1) // Best wall time of several calls, the first one often pays for page faults
+{
+	double best = 1e30;
+	for (int32_t i = 0; i < repeats; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <WorkerManager.h>
+
+constexpr int32_t TinyIterations = 1000000;
+
+class RequeueEachIterationTask : public InternalWorkerTask // The pool's original task path: claim one iteration, requeue, run it
+{
+public:
+	RequeueEachIterationTask(std::function<void(int32_t)> func, int32_t iterations) : m_func(func), m_iterations(iterations) { }
+	virtual void Execute(WorkerManager *manager) override
+	{
+		int32_t iteration = m_next++;
+		if (iteration + 1 < m_iterations)
+			manager->Push(this);
+		m_func(iteration);
+		++m_done;
+	}
+	virtual bool IsFree() override { return false; }
+	bool IsDone() { return m_done == m_iterations; }
+private:
+	std::function<void(int32_t)> m_func;
+	int32_t m_iterations;
+	std::atomic_int m_next = 0;
+	std::atomic_int m_done = 0;
+};
+
+static bool CheckTinyResults(std::vector<int32_t>& results)
+{
+	for (int32_t i = 0; i < results.size(); ++i)
+		XCHECK(results[i] == i * 3 + 1);
+	std::fill(results.begin(), results.end(), 0);
+	return true;
+}
+
+XBENCHMARK(ParallelForTinyIterations)
+{
+	int32_t threads = std::max<int32_t>(std::thread::hardware_concurrency() - 1, 1);
+	WorkerManager manager(threads);
+	std::vector<int32_t> results(TinyIterations);
+	auto tiny = [&results](int32_t i) { results[i] = i * 3 + 1; };
+
+	double serial = MeasureSeconds([&]()
+		{
+			for (int32_t i = 0; i < TinyIterations; ++i)
+				tiny(i);
+		}, 5);
+	XCHECK(CheckTinyResults(results));
+
+	double requeue = MeasureSeconds([&]()
+		{
+			RequeueEachIterationTask task(tiny, TinyIterations);
+			manager.Push(&task);
+			while (!task.IsDone()) // Waiting used to poll with a sleep
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+	XCHECK(CheckTinyResults(results));
+
+	double chunked = MeasureSeconds([&]()
+		{
+			WorkerTask<int32_t>& task = manager.EnqueueTask<int32_t>([&results](int32_t i) { return results[i] = i * 3 + 1; }, TinyIterations);
+			task.BlockUntilDone();
+			task.Destroy();
+			manager.CheckForFree();
+		}, 5);
+	XCHECK(CheckTinyResults(results));
+
+	double parallelFor = MeasureSeconds([&]()
+		{
+			manager.ParallelFor(0, TinyIterations, tiny).Wait();
+		}, 5);
+	XCHECK(CheckTinyResults(results));
+
+	printf("%d tiny iterations on %d workers plus the caller\n", TinyIterations, threads);
+	printf("  serial loop                 %9.3f ms\n", serial * 1e3);
+	printf("  requeue every iteration     %9.3f ms\n", requeue * 1e3);
+	printf("  EnqueueTask, chunked        %9.3f ms\n", chunked * 1e3);
+	printf("  ParallelFor, range split    %9.3f ms (%.1fx faster than requeueing)\n", parallelFor * 1e3, requeue / parallelFor);
+	return true;
+}
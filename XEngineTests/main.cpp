@@ -0,0 +1,38 @@
+#include "pch.h"
+#include "TestRunner.h"
+#include <cstring>
+
+int32_t main(int32_t argc, char **argv) // XEngineTests [--bench] [--option=value...] [name filter], tests run by default, benchmarks with --bench
+{
+	bool benchmarks = false;
+	const char *filter = nullptr;
+	for (int32_t i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--bench") == 0)
+			benchmarks = true;
+		else if (std::strncmp(argv[i], "--", 2) == 0 && std::strchr(argv[i], '='))
+		{
+			std::string option = argv[i] + 2;
+			GetTestOptions()[option.substr(0, option.find('='))] = option.substr(option.find('=') + 1);
+		}
+		else
+			filter = argv[i];
+	}
+
+	int32_t run = 0;
+	int32_t failed = 0;
+	for (TestCase& test : GetTestCases())
+	{
+		if ((test.Kind == TestCaseKind::Benchmark) != benchmarks || (filter && !std::strstr(test.Name, filter)))
+			continue;
+		printf("[ RUN  ] %s\n", test.Name);
+		fflush(stdout);
+		bool passed = test.Run();
+		printf(passed ? "[  OK  ] %s\n" : "[ FAIL ] %s\n", test.Name);
+		++run;
+		if (!passed)
+			++failed;
+	}
+	printf("%d of %d passed\n", run - failed, run);
+	return failed > 0 ? 1 : 0;
+}
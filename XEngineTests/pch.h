@@ -0,0 +1,3 @@
+#pragma once
+
+#include <XEngine.h>
\ No newline at end of file